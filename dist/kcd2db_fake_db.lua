@@ -19,7 +19,10 @@ local db_api_fields = {
     DelG = true,
     ExiG = true,
     AllG = true,
+    Prefetch = true,
+    PrefetchG = true,
     Dump = true,
+    CacheStats = true,
     Create = true
 }
 
@@ -365,11 +368,41 @@ local function make_db(existing_db)
     end
     M.AllG = wrap(allGImpl, 0, M)
 
+    -- The fake store keeps every value in memory; only a real LuaDB has anything to prefetch.
+    local function prefetch(method, prefix)
+        if type(LuaDB[method]) == "function" then
+            return LuaDB[method](prefix)
+        end
+        return 0
+    end
+
+    local function prefetchImpl(prefix)
+        return prefetch("Prefetch", prefix)
+    end
+    M.Prefetch = wrap(prefetchImpl, 1, M)
+
+    local function prefetchGImpl(prefix)
+        return prefetch("PrefetchG", prefix)
+    end
+    M.PrefetchG = wrap(prefetchGImpl, 1, M)
+
     local function dumpImpl()
         return LuaDB.Dump()
     end
     M.Dump = wrap(dumpImpl, 0, M)
 
+    -- The fake store never evicts anything; report an empty cache when LuaDB has no stats.
+    local function cacheStatsImpl()
+        if type(LuaDB.CacheStats) == "function" then
+            return LuaDB.CacheStats()
+        end
+        return {
+            residentBytes = 0, globalBytes = 0, saveBytes = 0, budgetBytes = 0,
+            hits = 0, misses = 0, hitRate = 1, evictions = 0, evictedBytes = 0
+        }
+    end
+    M.CacheStats = wrap(cacheStatsImpl, 0, M)
+
     setmetatable(M.L, create_metatable({
         getFunc = function(key)
             return M.Get(key)
@@ -499,6 +532,16 @@ local function make_db(existing_db)
         end
         instance.AllG = wrap(_allGImpl, 0, instance)
 
+        local function _prefetchImpl(key)
+            return prefetch("Prefetch", key == nil and namespace or prefix_key(key))
+        end
+        instance.Prefetch = wrap(_prefetchImpl, 1, instance)
+
+        local function _prefetchGImpl(key)
+            return prefetch("PrefetchG", key == nil and namespace or prefix_key(key))
+        end
+        instance.PrefetchG = wrap(_prefetchGImpl, 1, instance)
+
         local function _dumpImpl()
             log("INFO", "--- [Global Data For: " .. namespace:sub(1, -2) .. "] ---")
             local globalResult = instance.AllG()
@@ -0,0 +1,193 @@
+#include "BackupDriver.h"
+
+#include <system_error>
+#include <utility>
+
+#include <sqlite3.h>
+
+#include "../log/log.h"
+
+namespace
+{
+std::filesystem::path WithSuffix(const std::filesystem::path& path, const std::string& suffix)
+{
+    std::filesystem::path result = path;
+    result += suffix;
+    return result;
+}
+
+// Last write time of path, or the minimum when it does not exist.
+std::filesystem::file_time_type WriteTimeOf(const std::filesystem::path& path)
+{
+    std::error_code ec;
+    const auto time = std::filesystem::last_write_time(path, ec);
+    return ec ? std::filesystem::file_time_type::min() : time;
+}
+}
+
+BackupDriver::BackupDriver(BackupPolicy policy) :
+    m_policy(std::move(policy)),
+    m_nextStart(std::chrono::steady_clock::now())
+{
+    if (m_policy.pagesPerStep == 0)
+    {
+        m_policy.pagesPerStep = 1;
+    }
+    const auto newest = WriteTimeOf(GenerationPath(1));
+    if (newest == std::filesystem::file_time_type::min())
+    {
+        return;
+    }
+    // 上次运行留下的备份未过期时，按其时间安排下一次备份
+    const auto age = std::filesystem::file_time_type::clock::now() - newest;
+    if (age < m_policy.interval)
+    {
+        m_nextStart += std::chrono::duration_cast<std::chrono::steady_clock::duration>(m_policy.interval - age);
+    }
+    // 数据库文件（包括 WAL）在备份之后没有变化时，本次运行写入之前无需再备份
+    if (WriteTimeOf(m_policy.path) <= newest && WriteTimeOf(WithSuffix(m_policy.path, "-wal")) <= newest)
+    {
+        m_backedUpChanges = 0;
+    }
+}
+
+BackupDriver::~BackupDriver()
+{
+    if (m_backup)
+    {
+        Abort("shutdown");
+    }
+}
+
+std::filesystem::path BackupDriver::GenerationPath(const std::uint32_t generation) const
+{
+    return WithSuffix(m_policy.path, ".bak" + std::to_string(generation));
+}
+
+std::filesystem::path BackupDriver::TempPath() const
+{
+    return WithSuffix(m_policy.path, ".bak.tmp");
+}
+
+bool BackupDriver::Due(sqlite3* source) const
+{
+    if (m_backup)
+    {
+        return true;
+    }
+    return m_policy.generations > 0
+        && m_policy.interval.count() > 0
+        && std::chrono::steady_clock::now() >= m_nextStart
+        && sqlite3_total_changes64(source) != m_backedUpChanges;
+}
+
+bool BackupDriver::Start(sqlite3* source)
+{
+    const std::filesystem::path temp = TempPath();
+    std::error_code ec;
+    std::filesystem::remove(temp, ec);
+    if (sqlite3_open_v2(temp.string().c_str(), &m_dest, SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE, nullptr) != SQLITE_OK)
+    {
+        Abort(m_dest ? sqlite3_errmsg(m_dest) : "out of memory");
+        return false;
+    }
+    m_backup = sqlite3_backup_init(m_dest, "main", source, "main");
+    if (!m_backup)
+    {
+        Abort(sqlite3_errmsg(m_dest));
+        return false;
+    }
+    m_startChanges = sqlite3_total_changes64(source);
+    m_started = std::chrono::steady_clock::now();
+    m_steps = 0;
+    LogDebug("Backup of %s started.", m_policy.path.string().c_str());
+    return true;
+}
+
+bool BackupDriver::Step(sqlite3* source)
+{
+    if (!m_backup && (!Due(source) || !Start(source)))
+    {
+        return false;
+    }
+    ++m_steps;
+    switch (const int rc = sqlite3_backup_step(m_backup, static_cast<int>(m_policy.pagesPerStep)))
+    {
+    case SQLITE_OK:
+    case SQLITE_BUSY:
+    case SQLITE_LOCKED:
+        return true;
+    case SQLITE_DONE:
+        Finish();
+        return false;
+    default:
+        Abort(sqlite3_errstr(rc));
+        return false;
+    }
+}
+
+void BackupDriver::Finish()
+{
+    const int pages = sqlite3_backup_pagecount(m_backup);
+    const int rc = sqlite3_backup_finish(m_backup);
+    m_backup = nullptr;
+    if (rc != SQLITE_OK)
+    {
+        Abort(sqlite3_errmsg(m_dest));
+        return;
+    }
+    sqlite3_close_v2(m_dest);
+    m_dest = nullptr;
+    Rotate();
+    // 备份期间同一连接的写入已由 SQLite 同步到副本
+    m_backedUpChanges = m_startChanges;
+    m_nextStart = std::chrono::steady_clock::now() + m_policy.interval;
+    LogInfo("Backup written to %s: %d pages in %d steps over %lld ms.",
+            GenerationPath(1).string().c_str(),
+            pages,
+            m_steps,
+            static_cast<long long>(std::chrono::duration_cast<std::chrono::milliseconds>(
+                std::chrono::steady_clock::now() - m_started).count()));
+}
+
+void BackupDriver::Abort(const char* reason)
+{
+    LogWarn("Backup of %s not written: %s", m_policy.path.string().c_str(), reason);
+    if (m_backup)
+    {
+        sqlite3_backup_finish(m_backup);
+        m_backup = nullptr;
+    }
+    if (m_dest)
+    {
+        sqlite3_close_v2(m_dest);
+        m_dest = nullptr;
+    }
+    std::error_code ec;
+    std::filesystem::remove(TempPath(), ec);
+    m_nextStart = std::chrono::steady_clock::now() + m_policy.interval;
+}
+
+void BackupDriver::Rotate()
+{
+    // 最旧的一代被删除，其余依次后移，新备份成为第 1 代
+    std::error_code ec;
+    std::filesystem::remove(GenerationPath(m_policy.generations), ec);
+    for (std::uint32_t generation = m_policy.generations; generation > 1; --generation)
+    {
+        const std::filesystem::path older = GenerationPath(generation - 1);
+        if (std::filesystem::exists(older, ec))
+        {
+            std::filesystem::rename(older, GenerationPath(generation), ec);
+            if (ec)
+            {
+                LogWarn("Cannot rotate backup %s: %s", older.string().c_str(), ec.message().c_str());
+            }
+        }
+    }
+    std::filesystem::rename(TempPath(), GenerationPath(1), ec);
+    if (ec)
+    {
+        LogWarn("Cannot move backup to %s: %s", GenerationPath(1).string().c_str(), ec.message().c_str());
+    }
+}
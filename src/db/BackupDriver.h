@@ -0,0 +1,60 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <filesystem>
+#include <string>
+
+struct sqlite3;
+struct sqlite3_backup;
+
+// Rolling backups of the database next to it: <path>.bak1 is the newest of generations
+// files. 0 generations or a zero interval disables backups.
+struct BackupPolicy
+{
+    std::filesystem::path path;
+    std::uint32_t generations = 0;
+    std::chrono::minutes interval{0};
+    std::uint32_t pagesPerStep = 64;
+};
+
+// Copies the database into <path>.bak.tmp with the SQLite online backup API, a few pages per
+// step while the persistence writer is idle, and rotates it into the generations once
+// complete. Later writes through the same connection are applied to the copy by SQLite, so
+// the backup is consistent without blocking writers. A backup only starts when interval has
+// passed since the last one and the database changed since.
+class BackupDriver final
+{
+public:
+    explicit BackupDriver(BackupPolicy policy);
+    ~BackupDriver();
+
+    BackupDriver(const BackupDriver&) = delete;
+    BackupDriver& operator=(const BackupDriver&) = delete;
+
+    // True while a backup runs or one is due for source.
+    bool Due(sqlite3* source) const;
+    // Does one step of work. Runs on the writer thread outside any transaction and returns
+    // true while more steps are needed.
+    bool Step(sqlite3* source);
+
+    std::filesystem::path GenerationPath(std::uint32_t generation) const;
+
+private:
+    bool Start(sqlite3* source);
+    void Finish();
+    // Drops the unfinished copy and schedules the next attempt after interval.
+    void Abort(const char* reason);
+    void Rotate();
+    std::filesystem::path TempPath() const;
+
+    BackupPolicy m_policy;
+    sqlite3* m_dest = nullptr;
+    sqlite3_backup* m_backup = nullptr;
+    std::chrono::steady_clock::time_point m_nextStart;
+    // sqlite3_total_changes64 of the source when the last backup started; -1 when unknown.
+    std::int64_t m_backedUpChanges = -1;
+    std::int64_t m_startChanges = 0;
+    std::chrono::steady_clock::time_point m_started;
+    int m_steps = 0;
+};
@@ -0,0 +1,91 @@
+#include "CacheBudget.h"
+
+#include <algorithm>
+#include <utility>
+
+std::string CacheBudget::KeyOf(const Scope scope, const std::string_view prefix)
+{
+    std::string key(1, scope == Scope::Global ? 'G' : 'S');
+    key.append(prefix);
+    return key;
+}
+
+void CacheBudget::RecordAccess(const Scope scope, const std::string_view prefix, const bool hit, const Clock::time_point now)
+{
+    Heat& heat = m_heat[KeyOf(scope, prefix)];
+    if (heat.frequency < UINT32_MAX)
+    {
+        ++heat.frequency;
+    }
+    heat.lastAccess = now;
+    ++(hit ? m_stats.hits : m_stats.misses);
+}
+
+void CacheBudget::ResetScope(const Scope scope)
+{
+    const char tag = scope == Scope::Global ? 'G' : 'S';
+    std::erase_if(m_heat, [tag](const auto& entry) { return entry.first.front() == tag; });
+}
+
+void CacheBudget::Decay(const Clock::time_point now)
+{
+    if (now - m_lastDecay < kDecayInterval)
+    {
+        return;
+    }
+    m_lastDecay = now;
+    for (auto& [key, heat] : m_heat)
+    {
+        heat.frequency /= 2;
+    }
+}
+
+std::vector<CacheBudget::Candidate> CacheBudget::PickVictims(const std::size_t residentBytes,
+                                                             std::vector<Candidate> candidates,
+                                                             const Clock::time_point now)
+{
+    Decay(now);
+    std::vector<Candidate> victims;
+    if (!enabled() || residentBytes <= m_stats.budgetBytes)
+    {
+        return victims;
+    }
+    // 一次腾出到预算的 3/4，避免每帧都在预算边缘反复驱逐
+    const std::size_t target = m_stats.budgetBytes / 4 * 3;
+    struct Ranked
+    {
+        Candidate candidate;
+        Heat heat;
+    };
+    std::vector<Ranked> ranked;
+    ranked.reserve(candidates.size());
+    for (auto& candidate : candidates)
+    {
+        const auto it = m_heat.find(KeyOf(candidate.scope, candidate.prefix));
+        const Heat heat = it != m_heat.end() ? it->second : Heat{};
+        // 最近用过的命名空间保留在内存中
+        if (it != m_heat.end() && now - heat.lastAccess < kMinIdle)
+        {
+            continue;
+        }
+        ranked.push_back({std::move(candidate), heat});
+    }
+    std::sort(ranked.begin(), ranked.end(), [](const Ranked& a, const Ranked& b)
+    {
+        return a.heat.frequency != b.heat.frequency ? a.heat.frequency < b.heat.frequency : a.heat.lastAccess < b.heat.lastAccess;
+    });
+
+    std::size_t remaining = residentBytes;
+    for (auto& [candidate, heat] : ranked)
+    {
+        if (remaining <= target)
+        {
+            break;
+        }
+        remaining -= std::min(remaining, candidate.bytes);
+        ++m_stats.evictions;
+        m_stats.evictedBytes += candidate.bytes;
+        victims.push_back(std::move(candidate));
+    }
+    return victims;
+}
@@ -0,0 +1,76 @@
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+// Decides which namespaces of the global and save caches stay in memory. Every access to
+// a namespace bumps its frequency, which is halved every kDecayInterval so that old
+// popularity fades; once the caches exceed the budget, PickVictims chooses the coldest
+// namespaces not used for kMinIdle until enough memory would be freed. Evicted namespaces
+// are read from storage again on their next use: a cache miss. Not thread-safe.
+class CacheBudget final
+{
+public:
+    enum class Scope { Global, Save };
+
+    // A namespace that may be evicted, as listed by the caller.
+    struct Candidate
+    {
+        Scope scope;
+        std::string prefix;
+        std::size_t bytes = 0;
+    };
+
+    struct Stats
+    {
+        std::size_t budgetBytes = 0;
+        std::uint64_t hits = 0;
+        std::uint64_t misses = 0;
+        std::uint64_t evictions = 0;
+        std::uint64_t evictedBytes = 0;
+
+        double hitRate() const { return hits + misses > 0 ? static_cast<double>(hits) / static_cast<double>(hits + misses) : 1.0; }
+    };
+
+    using Clock = std::chrono::steady_clock;
+
+    static constexpr auto kDecayInterval = std::chrono::seconds(60);
+    static constexpr auto kMinIdle = std::chrono::seconds(30);
+
+    explicit CacheBudget(std::size_t maxBytes) { m_stats.budgetBytes = maxBytes; }
+
+    bool enabled() const { return m_stats.budgetBytes > 0; }
+    std::size_t maxBytes() const { return m_stats.budgetBytes; }
+
+    // Records a use of the namespace prefix. hit is false when it had to be read from storage.
+    void RecordAccess(Scope scope, std::string_view prefix, bool hit, Clock::time_point now);
+    // Forgets the access history of every namespace of scope, e.g. when another save is loaded.
+    void ResetScope(Scope scope);
+
+    // Returns the candidates to evict, coldest first, so that residentBytes drops to 3/4 of
+    // the budget; empty when it is within the budget. Records them as evicted.
+    std::vector<Candidate> PickVictims(std::size_t residentBytes, std::vector<Candidate> candidates, Clock::time_point now);
+
+    const Stats& stats() const { return m_stats; }
+
+private:
+    struct Heat
+    {
+        std::uint32_t frequency = 0;
+        Clock::time_point lastAccess;
+    };
+
+    static std::string KeyOf(Scope scope, std::string_view prefix);
+    void Decay(Clock::time_point now);
+
+    // Keyed by scope tag + prefix.
+    std::unordered_map<std::string, Heat> m_heat;
+    Clock::time_point m_lastDecay = Clock::now();
+    Stats m_stats;
+};
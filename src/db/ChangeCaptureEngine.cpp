@@ -0,0 +1,93 @@
+#include "ChangeCaptureEngine.h"
+
+#include <utility>
+
+ChangeCaptureEngine::ChangeCaptureEngine(std::unique_ptr<StorageEngine> engine, ChangeStreamWriter::Options options) :
+    m_engine(std::move(engine)),
+    m_stream(std::move(options))
+{
+}
+
+BatchResult ChangeCaptureEngine::ApplyBatch(const GlobalBatch& batch)
+{
+    const BatchResult result = m_engine->ApplyBatch(batch);
+    // 与引擎相同的顺序：先删除，再写入
+    for (const auto& k : batch.deletes)
+    {
+        m_stream.AppendDelete({}, k);
+    }
+    // 引擎跳过的写入未提交，不能出现在流中
+    auto failed = result.failedUpserts.begin();
+    for (std::size_t i = 0; i < batch.upserts.size(); ++i)
+    {
+        if (failed != result.failedUpserts.end() && *failed == i)
+        {
+            ++failed;
+            continue;
+        }
+        m_stream.AppendSet({}, batch.upserts[i].first, batch.upserts[i].second);
+    }
+    m_stream.Commit();
+    return result;
+}
+
+void ChangeCaptureEngine::SnapshotSave(const std::string& savefile, const ValueMap& entries)
+{
+    m_engine->SnapshotSave(savefile, entries);
+    m_stream.AppendReplaceSave(savefile, {}, {}, entries.size());
+    AppendEntries(savefile, entries);
+}
+
+void ChangeCaptureEngine::SnapshotSaveFrom(const std::string& savefile, const ValueMap& entries, const SaveCarryOver& carry)
+{
+    m_engine->SnapshotSaveFrom(savefile, entries, carry);
+    std::unordered_set<std::string> replaced = carry.loadedPrefixes;
+    for (const auto& [k, v] : entries)
+    {
+        replaced.emplace(k, 0, NamespacePrefixLength(k));
+    }
+    m_stream.AppendReplaceSave(savefile, carry.base, replaced, entries.size());
+    AppendEntries(savefile, entries);
+}
+
+void ChangeCaptureEngine::AppendEntries(const std::string& savefile, const ValueMap& entries)
+{
+    if (!m_stream.enabled())
+    {
+        return;
+    }
+    try
+    {
+        for (const auto& [k, v] : entries)
+        {
+            if (v.is_blob_ref())
+            {
+                // 从未读取的大值：写入流时才从引擎读出
+                m_stream.AppendSet(savefile, k, ScriptValue(m_engine->ReadBlob(v.as_blob_ref())));
+            }
+            else
+            {
+                m_stream.AppendSet(savefile, k, v);
+            }
+        }
+    }
+    catch (const std::exception& e)
+    {
+        // 存档已经写入，流中缺少的值无法补齐，只能停用流
+        m_stream.Fail("reading a stored value", e);
+        return;
+    }
+    m_stream.Commit();
+}
+
+std::uint64_t ChangeCaptureEngine::DeleteScope(const StoredSave& save, const std::uint32_t maxEntries)
+{
+    const std::uint64_t deleted = m_engine->DeleteScope(save, maxEntries);
+    if (deleted > 0)
+    {
+        // 存档分批删除，每批都记录整个存档被移除；重复的记录对读取方没有影响
+        m_stream.AppendDropSave(save.savefile);
+        m_stream.Commit();
+    }
+    return deleted;
+}
@@ -0,0 +1,43 @@
+#pragma once
+
+#include <memory>
+
+#include "ChangeStreamWriter.h"
+#include "StorageEngine.h"
+
+// Wraps another engine and writes every mutation it committed to a change stream, so tools
+// can follow LuaDB data without opening the database. Reads and maintenance are passed
+// through unchanged.
+class ChangeCaptureEngine final : public StorageEngine
+{
+public:
+    ChangeCaptureEngine(std::unique_ptr<StorageEngine> engine, ChangeStreamWriter::Options options);
+
+    const char* name() const override { return m_engine->name(); }
+
+    void LoadScope(const std::string& savefile, ValueMap& out) override { m_engine->LoadScope(savefile, out); }
+    void LoadNamespaces(const std::string& savefile, const std::vector<std::string>& prefixes, ValueMap& out) override
+    {
+        m_engine->LoadNamespaces(savefile, prefixes, out);
+    }
+    std::vector<std::string> ListNamespaces(const std::string& savefile) override { return m_engine->ListNamespaces(savefile); }
+    std::string ReadBlob(const BlobRef& ref) override { return m_engine->ReadBlob(ref); }
+    std::string LatestSave() override { return m_engine->LatestSave(); }
+    BatchResult ApplyBatch(const GlobalBatch& batch) override;
+    void SnapshotSave(const std::string& savefile, const ValueMap& entries) override;
+    void SnapshotSaveFrom(const std::string& savefile, const ValueMap& entries, const SaveCarryOver& carry) override;
+    std::vector<StoredSave> ListSaves() override { return m_engine->ListSaves(); }
+    std::uint64_t DeleteScope(const StoredSave& save, std::uint32_t maxEntries) override;
+    std::int64_t GlobalVersion() override { return m_engine->GlobalVersion(); }
+
+    bool HasIdleWork() const override { return m_engine->HasIdleWork(); }
+    bool Idle() override { return m_engine->Idle(); }
+    void AfterTask() override { m_engine->AfterTask(); }
+    void OnMaintenanceWindow() override { m_engine->OnMaintenanceWindow(); }
+
+private:
+    void AppendEntries(const std::string& savefile, const ValueMap& entries);
+
+    std::unique_ptr<StorageEngine> m_engine;
+    ChangeStreamWriter m_stream;
+};
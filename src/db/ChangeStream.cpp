@@ -0,0 +1,197 @@
+#include "ChangeStream.h"
+
+#include <algorithm>
+#include <charconv>
+#include <cstdio>
+#include <stdexcept>
+#include <system_error>
+
+namespace
+{
+constexpr std::string_view kFileSuffix = ".log";
+constexpr std::size_t kSequenceDigits = 20;
+
+std::string FilePrefix(const std::filesystem::path& stem)
+{
+    return stem.filename().string() + ".";
+}
+}
+
+namespace ChangeStream
+{
+void EncodeHeader(RecordWriter& record, const ChangeOp op, const std::uint64_t sequence, const std::string_view savefile)
+{
+    record.Clear();
+    record.PutU8(static_cast<std::uint8_t>(op));
+    record.PutI64(static_cast<std::int64_t>(sequence));
+    record.PutString(savefile);
+}
+
+bool Decode(const std::string_view payload, ChangeRecord& record)
+{
+    RecordReader reader(payload);
+    std::uint8_t op = 0;
+    std::int64_t sequence = 0;
+    if (!reader.GetU8(op) || !reader.GetI64(sequence) || !reader.GetString(record.savefile))
+    {
+        return false;
+    }
+    record.op = static_cast<ChangeOp>(op);
+    record.sequence = static_cast<std::uint64_t>(sequence);
+    switch (record.op)
+    {
+    case ChangeOp::Set:
+        if (!reader.GetString(record.key) || !reader.GetValue(record.value))
+        {
+            return false;
+        }
+        break;
+    case ChangeOp::Delete:
+        if (!reader.GetString(record.key))
+        {
+            return false;
+        }
+        break;
+    case ChangeOp::ReplaceSave:
+        {
+            std::uint32_t count = 0;
+            if (!reader.GetString(record.base) || !reader.GetU32(count))
+            {
+                return false;
+            }
+            record.replacedPrefixes.clear();
+            for (std::uint32_t i = 0; i < count; ++i)
+            {
+                if (!reader.GetString(record.replacedPrefixes.emplace_back()))
+                {
+                    return false;
+                }
+            }
+            std::int64_t entries = 0;
+            if (!reader.GetI64(entries))
+            {
+                return false;
+            }
+            record.entries = static_cast<std::uint64_t>(entries);
+            break;
+        }
+    case ChangeOp::DropSave:
+        break;
+    default:
+        return false;
+    }
+    return reader.done();
+}
+
+std::vector<File> ListFiles(const std::filesystem::path& stem)
+{
+    std::vector<File> files;
+    const std::filesystem::path directory = stem.has_parent_path() ? stem.parent_path() : std::filesystem::path(".");
+    const std::string prefix = FilePrefix(stem);
+    std::error_code ec;
+    for (std::filesystem::directory_iterator it(directory, ec), end; !ec && it != end; it.increment(ec))
+    {
+        const std::string name = it->path().filename().string();
+        if (name.size() != prefix.size() + kSequenceDigits + kFileSuffix.size()
+            || !name.starts_with(prefix)
+            || !name.ends_with(kFileSuffix))
+        {
+            continue;
+        }
+        const char* digits = name.data() + prefix.size();
+        std::uint64_t sequence = 0;
+        const auto [parsed, error] = std::from_chars(digits, digits + kSequenceDigits, sequence);
+        if (error == std::errc() && parsed == digits + kSequenceDigits)
+        {
+            files.push_back({it->path(), sequence});
+        }
+    }
+    std::sort(files.begin(), files.end(), [](const File& a, const File& b) { return a.firstSequence < b.firstSequence; });
+    return files;
+}
+
+std::filesystem::path FilePath(const std::filesystem::path& stem, const std::uint64_t firstSequence)
+{
+    char digits[kSequenceDigits + 1] = {};
+    std::snprintf(digits, sizeof(digits), "%020llu", static_cast<unsigned long long>(firstSequence));
+    std::filesystem::path path = stem;
+    path += std::string(".") + digits + std::string(kFileSuffix);
+    return path;
+}
+}
+
+ChangeStreamReader::ChangeStreamReader(std::filesystem::path stem, const std::uint64_t sequence) :
+    m_stem(std::move(stem)),
+    m_sequence(sequence)
+{
+}
+
+ChangeStreamReader::PollResult ChangeStreamReader::Poll(const Handler& handler)
+{
+    PollResult result;
+    const std::vector<ChangeStream::File> files = ChangeStream::ListFiles(m_stem);
+    if (files.empty())
+    {
+        return result;
+    }
+    auto current = std::find_if(files.begin(), files.end(), [this](const auto& file) { return file.path == m_file; });
+    if (current == files.end())
+    {
+        // 首次读取，或正在读的文件已被保留策略删除：从可能包含下一条记录的文件开始
+        current = files.begin();
+        for (auto it = files.begin(); it != files.end() && it->firstSequence <= m_sequence + 1; ++it)
+        {
+            current = it;
+        }
+        m_file = current->path;
+        m_offset = 0;
+    }
+
+    while (true)
+    {
+        const bool fromStart = m_offset == 0;
+        std::uint64_t lastInFile = 0;
+        const RecordLog::ReadResult read = RecordLog::Read(m_file, ChangeStream::kMagic, [&](const std::string_view payload)
+        {
+            ChangeRecord record;
+            if (!ChangeStream::Decode(payload, record))
+            {
+                throw std::runtime_error("malformed change stream record in " + m_file.string());
+            }
+            lastInFile = record.sequence;
+            if (record.sequence <= m_sequence)
+            {
+                return;
+            }
+            if (record.sequence != m_sequence + 1)
+            {
+                result.gap = true;
+            }
+            m_sequence = record.sequence;
+            ++result.records;
+            handler(record);
+        }, m_offset);
+        m_offset = read.validBytes;
+
+        if (std::next(current) != files.end())
+        {
+            // 写入方只在上一个文件写完之后才创建下一个文件
+            ++current;
+            m_file = current->path;
+            m_offset = 0;
+            continue;
+        }
+        if (fromStart && current->firstSequence <= m_sequence && lastInFile < m_sequence)
+        {
+            // 最新的文件不包含已读到的序号：文件被删除后流从头开始了
+            m_sequence = 0;
+            m_file.clear();
+            m_offset = 0;
+            PollResult restarted = Poll(handler);
+            restarted.records += result.records;
+            restarted.gap = true;
+            return restarted;
+        }
+        return result;
+    }
+}
@@ -0,0 +1,99 @@
+#pragma once
+
+#include <cstdint>
+#include <filesystem>
+#include <functional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "RecordLog.h"
+#include "ScriptValue.h"
+
+// Change stream: every mutation committed by the storage engine, in commit order, as
+// RecordLog records in rotating files <stem>.<first sequence, 20 digits>.log. Sequence
+// numbers increase by one per record across files. Tools read it with ChangeStreamReader
+// instead of opening the database.
+
+enum class ChangeOp : std::uint8_t
+{
+    // key of savefile was set to value.
+    Set = 1,
+    // key of savefile was deleted (tombstone).
+    Delete = 2,
+    // savefile was written as a whole. Its entries are now those of base in every namespace
+    // not listed in replacedPrefixes (none when base is empty), plus the entries Set by the
+    // next `entries` records.
+    ReplaceSave = 3,
+    // savefile was removed because its save file no longer exists.
+    DropSave = 4,
+};
+
+struct ChangeRecord
+{
+    std::uint64_t sequence = 0;
+    ChangeOp op = ChangeOp::Set;
+    // Empty for the global scope.
+    std::string savefile;
+    // Set and Delete.
+    std::string key;
+    // Set only; its storeType() is the stored value type.
+    ScriptValue value;
+    // ReplaceSave only.
+    std::string base;
+    std::vector<std::string> replacedPrefixes;
+    std::uint64_t entries = 0;
+};
+
+namespace ChangeStream
+{
+constexpr std::string_view kMagic = "KCDBCDC1";
+
+struct File
+{
+    std::filesystem::path path;
+    std::uint64_t firstSequence = 0;
+};
+
+// Starts a payload: u8 op, i64 sequence, savefile. Set continues with key and value, Delete
+// with key, ReplaceSave with base, u32 prefix count, the prefixes and i64 entries.
+void EncodeHeader(RecordWriter& record, ChangeOp op, std::uint64_t sequence, std::string_view savefile);
+bool Decode(std::string_view payload, ChangeRecord& record);
+
+// Files of the stream at stem, oldest first.
+std::vector<File> ListFiles(const std::filesystem::path& stem);
+std::filesystem::path FilePath(const std::filesystem::path& stem, std::uint64_t firstSequence);
+}
+
+// Follows a change stream from a sequence number on. Only reads the files, so it can run in
+// another process while the game writes them.
+class ChangeStreamReader final
+{
+public:
+    using Handler = std::function<void(const ChangeRecord& record)>;
+
+    struct PollResult
+    {
+        std::uint64_t records = 0;
+        // Records after the cursor were dropped by retention, or the stream was started
+        // over. The consumer should read the database again before relying on the records.
+        bool gap = false;
+    };
+
+    // Delivers records after sequence; 0 starts with the oldest record still kept.
+    explicit ChangeStreamReader(std::filesystem::path stem, std::uint64_t sequence = 0);
+
+    // Calls handler for every complete record appended since the last call, oldest first.
+    // Throws when a file is not a change stream file.
+    PollResult Poll(const Handler& handler);
+
+    // Sequence of the last record delivered.
+    std::uint64_t sequence() const { return m_sequence; }
+
+private:
+    std::filesystem::path m_stem;
+    std::uint64_t m_sequence = 0;
+    // File being read and the end of its last complete record; empty before the first Poll.
+    std::filesystem::path m_file;
+    std::uint64_t m_offset = 0;
+};
@@ -0,0 +1,192 @@
+#include "ChangeStreamWriter.h"
+
+#include <algorithm>
+#include <system_error>
+#include <vector>
+
+#include "../log/log.h"
+
+ChangeStreamWriter::ChangeStreamWriter(Options options) :
+    m_options(std::move(options))
+{
+    m_options.keepFiles = std::max<std::uint32_t>(m_options.keepFiles, 1);
+    try
+    {
+        const std::vector<ChangeStream::File> files = ChangeStream::ListFiles(m_options.stem);
+        if (files.empty())
+        {
+            OpenFile(1);
+        }
+        else
+        {
+            // 序号接着最新文件中的最后一条记录；空文件则接着它的起始序号
+            m_lastSequence = files.back().firstSequence - 1;
+            m_log = std::make_unique<RecordLog>(files.back().path, ChangeStream::kMagic, [this](const std::string_view payload)
+            {
+                ChangeRecord record;
+                if (ChangeStream::Decode(payload, record))
+                {
+                    m_lastSequence = std::max(m_lastSequence, record.sequence);
+                }
+            });
+            if (m_log->size() >= m_options.rotateBytes)
+            {
+                OpenFile(m_lastSequence + 1);
+            }
+        }
+        ApplyRetention();
+        LogDebug("LuaDB change stream opened: %s, next sequence %llu.",
+                 m_log->path().string().c_str(),
+                 static_cast<unsigned long long>(m_lastSequence + 1));
+    }
+    catch (const std::exception& e)
+    {
+        Fail("opening", e);
+    }
+}
+
+ChangeStreamWriter::~ChangeStreamWriter()
+{
+    Commit();
+}
+
+void ChangeStreamWriter::Fail(const char* action, const std::exception& e)
+{
+    if (m_failed)
+    {
+        return;
+    }
+    LogError("LuaDB change stream disabled after %s failed: %s", action, e.what());
+    m_failed = true;
+    m_log.reset();
+}
+
+void ChangeStreamWriter::OpenFile(const std::uint64_t firstSequence)
+{
+    m_log.reset();
+    m_log = std::make_unique<RecordLog>(ChangeStream::FilePath(m_options.stem, firstSequence),
+                                        ChangeStream::kMagic,
+                                        [](std::string_view) {});
+}
+
+void ChangeStreamWriter::ApplyRetention()
+{
+    const std::vector<ChangeStream::File> files = ChangeStream::ListFiles(m_options.stem);
+    const auto now = std::filesystem::file_time_type::clock::now();
+    std::size_t removed = 0;
+    // 正在写入的最新文件始终保留
+    for (std::size_t i = 0; i + 1 < files.size(); ++i)
+    {
+        std::error_code ec;
+        bool expired = files.size() - i > m_options.keepFiles;
+        if (!expired && m_options.maxAge.count() > 0)
+        {
+            const auto written = std::filesystem::last_write_time(files[i].path, ec);
+            expired = !ec && now - written > m_options.maxAge;
+        }
+        if (!expired)
+        {
+            continue;
+        }
+        if (std::filesystem::remove(files[i].path, ec))
+        {
+            ++removed;
+        }
+        else if (ec)
+        {
+            LogWarn("Cannot remove change stream file %s: %s", files[i].path.string().c_str(), ec.message().c_str());
+        }
+    }
+    if (removed > 0)
+    {
+        LogDebug("Removed %zu change stream files beyond the retention limits.", removed);
+    }
+}
+
+void ChangeStreamWriter::Append()
+{
+    try
+    {
+        m_log->Append(m_record.data());
+        ++m_lastSequence;
+    }
+    catch (const std::exception& e)
+    {
+        Fail("writing", e);
+    }
+}
+
+void ChangeStreamWriter::AppendSet(const std::string_view savefile, const std::string_view key, const ScriptValue& value)
+{
+    if (m_failed)
+    {
+        return;
+    }
+    ChangeStream::EncodeHeader(m_record, ChangeOp::Set, m_lastSequence + 1, savefile);
+    m_record.PutString(key);
+    m_record.PutValue(value);
+    Append();
+}
+
+void ChangeStreamWriter::AppendDelete(const std::string_view savefile, const std::string_view key)
+{
+    if (m_failed)
+    {
+        return;
+    }
+    ChangeStream::EncodeHeader(m_record, ChangeOp::Delete, m_lastSequence + 1, savefile);
+    m_record.PutString(key);
+    Append();
+}
+
+void ChangeStreamWriter::AppendReplaceSave(const std::string_view savefile,
+                                           const std::string_view base,
+                                           const std::unordered_set<std::string>& replacedPrefixes,
+                                           const std::uint64_t entries)
+{
+    if (m_failed)
+    {
+        return;
+    }
+    ChangeStream::EncodeHeader(m_record, ChangeOp::ReplaceSave, m_lastSequence + 1, savefile);
+    m_record.PutString(base);
+    m_record.PutU32(static_cast<std::uint32_t>(replacedPrefixes.size()));
+    for (const auto& prefix : replacedPrefixes)
+    {
+        m_record.PutString(prefix);
+    }
+    m_record.PutI64(static_cast<std::int64_t>(entries));
+    Append();
+}
+
+void ChangeStreamWriter::AppendDropSave(const std::string_view savefile)
+{
+    if (m_failed)
+    {
+        return;
+    }
+    ChangeStream::EncodeHeader(m_record, ChangeOp::DropSave, m_lastSequence + 1, savefile);
+    Append();
+}
+
+void ChangeStreamWriter::Commit()
+{
+    if (m_failed)
+    {
+        return;
+    }
+    try
+    {
+        // 交给操作系统后，其他进程即可读到这些记录
+        m_log->Flush();
+        if (m_log->size() >= m_options.rotateBytes)
+        {
+            OpenFile(m_lastSequence + 1);
+            ApplyRetention();
+        }
+    }
+    catch (const std::exception& e)
+    {
+        Fail("flushing", e);
+    }
+}
@@ -0,0 +1,68 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <filesystem>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <unordered_set>
+
+#include "ChangeStream.h"
+#include "RecordLog.h"
+#include "ScriptValue.h"
+
+// Appends records to a change stream (see ChangeStream.h) on the persistence writer thread.
+// The records of one engine call are handed to the OS together by Commit, which then starts
+// a new file once the current one reached rotateBytes and deletes files beyond the retention
+// limits. Sequence numbers continue from the newest file found when opening.
+//
+// Records are written after the engine committed, so a crash in between can lose the last
+// changes from the stream but never records changes that were not committed. Failures are
+// logged and disable the stream; they never fail the engine call.
+class ChangeStreamWriter final
+{
+public:
+    struct Options
+    {
+        std::filesystem::path stem;
+        std::uint64_t rotateBytes = 16 * 1024 * 1024;
+        // Files kept, including the one being written. At least 1.
+        std::uint32_t keepFiles = 8;
+        // Files last written longer ago than this are deleted when the stream opens or rotates,
+        // even within keepFiles; 0 keeps them regardless of age.
+        std::chrono::hours maxAge{0};
+    };
+
+    explicit ChangeStreamWriter(Options options);
+    ~ChangeStreamWriter();
+    ChangeStreamWriter(const ChangeStreamWriter&) = delete;
+    ChangeStreamWriter& operator=(const ChangeStreamWriter&) = delete;
+
+    void AppendSet(std::string_view savefile, std::string_view key, const ScriptValue& value);
+    void AppendDelete(std::string_view savefile, std::string_view key);
+    void AppendReplaceSave(std::string_view savefile,
+                           std::string_view base,
+                           const std::unordered_set<std::string>& replacedPrefixes,
+                           std::uint64_t entries);
+    void AppendDropSave(std::string_view savefile);
+    // Hands the records appended since the last call to the OS, then rotates if needed.
+    void Commit();
+
+    // Logs e and disables the stream, e.g. when a change cannot be written completely.
+    void Fail(const char* action, const std::exception& e);
+
+    bool enabled() const { return !m_failed; }
+    std::uint64_t lastSequence() const { return m_lastSequence; }
+
+private:
+    void Append();
+    void OpenFile(std::uint64_t firstSequence);
+    void ApplyRetention();
+
+    Options m_options;
+    std::unique_ptr<RecordLog> m_log;
+    RecordWriter m_record;
+    std::uint64_t m_lastSequence = 0;
+    bool m_failed = false;
+};
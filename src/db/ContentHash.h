@@ -0,0 +1,113 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <string_view>
+
+// XXH64 with seed 0. Used as the content address of values stored in the Blobs table;
+// collisions are resolved by the caller, so this only needs to be fast and well mixed.
+namespace ContentHash
+{
+namespace detail
+{
+constexpr std::uint64_t kPrime1 = 0x9E3779B185EBCA87ull;
+constexpr std::uint64_t kPrime2 = 0xC2B2AE3D27D4EB4Full;
+constexpr std::uint64_t kPrime3 = 0x165667B19E3779F9ull;
+constexpr std::uint64_t kPrime4 = 0x85EBCA77C2B2AE63ull;
+constexpr std::uint64_t kPrime5 = 0x27D4EB2F165667C5ull;
+
+inline std::uint64_t Rotl(const std::uint64_t value, const int bits)
+{
+    return (value << bits) | (value >> (64 - bits));
+}
+
+inline std::uint64_t Read64(const char* p)
+{
+    std::uint64_t value;
+    std::memcpy(&value, p, sizeof(value));
+    return value;
+}
+
+inline std::uint32_t Read32(const char* p)
+{
+    std::uint32_t value;
+    std::memcpy(&value, p, sizeof(value));
+    return value;
+}
+
+inline std::uint64_t Round(std::uint64_t acc, const std::uint64_t input)
+{
+    acc += input * kPrime2;
+    acc = Rotl(acc, 31);
+    return acc * kPrime1;
+}
+
+inline std::uint64_t MergeRound(std::uint64_t acc, const std::uint64_t value)
+{
+    acc ^= Round(0, value);
+    return acc * kPrime1 + kPrime4;
+}
+}
+
+inline std::uint64_t Hash64(const std::string_view data)
+{
+    using namespace detail;
+    const char* p = data.data();
+    const char* const end = p + data.size();
+    std::uint64_t h;
+
+    if (data.size() >= 32)
+    {
+        std::uint64_t v1 = kPrime1 + kPrime2;
+        std::uint64_t v2 = kPrime2;
+        std::uint64_t v3 = 0;
+        std::uint64_t v4 = 0 - kPrime1;
+        const char* const limit = end - 32;
+        do
+        {
+            v1 = Round(v1, Read64(p));
+            v2 = Round(v2, Read64(p + 8));
+            v3 = Round(v3, Read64(p + 16));
+            v4 = Round(v4, Read64(p + 24));
+            p += 32;
+        }
+        while (p <= limit);
+        h = Rotl(v1, 1) + Rotl(v2, 7) + Rotl(v3, 12) + Rotl(v4, 18);
+        h = MergeRound(h, v1);
+        h = MergeRound(h, v2);
+        h = MergeRound(h, v3);
+        h = MergeRound(h, v4);
+    }
+    else
+    {
+        h = kPrime5;
+    }
+
+    h += static_cast<std::uint64_t>(data.size());
+    while (p + 8 <= end)
+    {
+        h ^= Round(0, Read64(p));
+        h = Rotl(h, 27) * kPrime1 + kPrime4;
+        p += 8;
+    }
+    if (p + 4 <= end)
+    {
+        h ^= static_cast<std::uint64_t>(Read32(p)) * kPrime1;
+        h = Rotl(h, 23) * kPrime2 + kPrime3;
+        p += 4;
+    }
+    while (p < end)
+    {
+        h ^= static_cast<std::uint64_t>(static_cast<unsigned char>(*p)) * kPrime5;
+        h = Rotl(h, 11) * kPrime1;
+        ++p;
+    }
+
+    h ^= h >> 33;
+    h *= kPrime2;
+    h ^= h >> 29;
+    h *= kPrime3;
+    h ^= h >> 32;
+    return h;
+}
+}
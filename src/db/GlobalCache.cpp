@@ -0,0 +1,355 @@
+#include "GlobalCache.h"
+
+#include <utility>
+
+GlobalCache::Partition& GlobalCache::PartitionFor(const std::string& key)
+{
+    const std::string_view prefix = PrefixOf(key);
+    if (const auto it = m_partitions.find(prefix); it != m_partitions.end())
+    {
+        return it->second;
+    }
+    return m_partitions.emplace(std::string(prefix), Partition{}).first->second;
+}
+
+const GlobalCache::Partition* GlobalCache::FindPartition(const std::string_view prefix) const
+{
+    const auto it = m_partitions.find(prefix);
+    return it != m_partitions.end() ? &it->second : nullptr;
+}
+
+std::optional<ScriptValueView> GlobalCache::FindInSnapshot(const std::string_view key) const
+{
+    if (!m_snapshot || (!m_hiddenSnapshotKeys.empty() && m_hiddenSnapshotKeys.contains(std::string(key))))
+    {
+        return std::nullopt;
+    }
+    return m_snapshot->Find(key);
+}
+
+std::optional<ScriptValueView> GlobalCache::Find(const std::string& key) const
+{
+    if (const Partition* partition = FindPartition(PrefixOf(key)))
+    {
+        if (const auto it = partition->entries.find(key); it != partition->entries.end())
+        {
+            return ScriptValueView::Of(it->second);
+        }
+    }
+    return FindInSnapshot(key);
+}
+
+void GlobalCache::Set(const std::string& key, ScriptValue value)
+{
+    Partition& partition = PartitionFor(key);
+    const std::size_t bytes = EstimateEntryBytes(key, value);
+    if (const auto it = partition.entries.find(key); it != partition.entries.end())
+    {
+        RemoveBytes(partition, EstimateEntryBytes(key, it->second));
+        it->second = std::move(value);
+    }
+    else
+    {
+        partition.entries.emplace(key, std::move(value));
+        // 快照中的值在首次写入时才复制到分区
+        if (!FindInSnapshot(key))
+        {
+            ++m_size;
+        }
+    }
+    AddBytes(partition, bytes);
+    partition.deletedKeys.erase(key);
+    partition.dirtyKeys.emplace(key);
+    m_changedNamespaces.emplace(PrefixOf(key));
+}
+
+bool GlobalCache::Erase(const std::string& key)
+{
+    const bool inSnapshot = FindInSnapshot(key).has_value();
+    const auto it = m_partitions.find(PrefixOf(key));
+    bool inPartition = false;
+    if (it != m_partitions.end())
+    {
+        if (const auto entry = it->second.entries.find(key); entry != it->second.entries.end())
+        {
+            RemoveBytes(it->second, EstimateEntryBytes(key, entry->second));
+            it->second.entries.erase(entry);
+            inPartition = true;
+        }
+    }
+    if (!inPartition && !inSnapshot)
+    {
+        return false;
+    }
+    if (inSnapshot)
+    {
+        m_hiddenSnapshotKeys.emplace(key);
+    }
+    --m_size;
+    Partition& partition = inPartition ? it->second : PartitionFor(key);
+    partition.dirtyKeys.erase(key);
+    partition.deletedKeys.emplace(key);
+    m_changedNamespaces.emplace(PrefixOf(key));
+    return true;
+}
+
+void GlobalCache::Resolve(const std::string& key, std::string value)
+{
+    if (const auto it = m_partitions.find(PrefixOf(key)); it != m_partitions.end())
+    {
+        if (const auto entry = it->second.entries.find(key); entry != it->second.entries.end())
+        {
+            if (entry->second.is_blob_ref())
+            {
+                RemoveBytes(it->second, EstimateEntryBytes(key, entry->second));
+                entry->second = ScriptValue(std::move(value));
+                AddBytes(it->second, EstimateEntryBytes(key, entry->second));
+            }
+            return;
+        }
+    }
+    // 快照中的大值只有 BlobRef：读取后放入分区遮住快照，但不计为新键，也不标记写入
+    if (const auto inSnapshot = FindInSnapshot(key); inSnapshot && inSnapshot->type == ScriptValue::Type::BLOB_REF)
+    {
+        Partition& partition = PartitionFor(key);
+        const auto entry = partition.entries.emplace(key, ScriptValue(std::move(value))).first;
+        AddBytes(partition, EstimateEntryBytes(key, entry->second));
+    }
+}
+
+bool GlobalCache::HasPendingChange(const std::string& key) const
+{
+    const Partition* partition = FindPartition(PrefixOf(key));
+    return partition && (partition->dirtyKeys.contains(key) || partition->deletedKeys.contains(key));
+}
+
+bool GlobalCache::MarkChanged(const std::string& key)
+{
+    if (HasPendingChange(key))
+    {
+        return false;
+    }
+    Partition& partition = PartitionFor(key);
+    if (Find(key))
+    {
+        partition.dirtyKeys.emplace(key);
+    }
+    else
+    {
+        partition.deletedKeys.emplace(key);
+    }
+    m_changedNamespaces.emplace(PrefixOf(key));
+    return true;
+}
+
+bool GlobalCache::IsLoaded(const std::string_view prefix) const
+{
+    if (m_allLoaded)
+    {
+        return true;
+    }
+    if (const Partition* partition = FindPartition(prefix); partition && partition->loaded)
+    {
+        return true;
+    }
+    // 快照中没有的命名空间在存储中也没有数据；校验失败的命名空间改从存储引擎读取
+    return m_snapshot && m_snapshot->Verify(prefix);
+}
+
+bool GlobalCache::IsFullyLoaded() const
+{
+    return m_allLoaded || (m_snapshot && m_snapshot->VerifyAll());
+}
+
+void GlobalCache::AddLoaded(const std::string& key, ScriptValue&& value)
+{
+    Partition& partition = PartitionFor(key);
+    // 加载前 SetG/DelG 的键比存储中的值新
+    if (partition.entries.contains(key) || partition.deletedKeys.contains(key))
+    {
+        return;
+    }
+    AddBytes(partition, EstimateEntryBytes(key, value));
+    partition.entries.emplace(key, std::move(value));
+    ++m_size;
+}
+
+void GlobalCache::AddBytes(Partition& partition, const std::size_t bytes)
+{
+    partition.bytes += bytes;
+    m_bytes += bytes;
+}
+
+void GlobalCache::RemoveBytes(Partition& partition, const std::size_t bytes)
+{
+    partition.bytes -= bytes;
+    m_bytes -= bytes;
+}
+
+void GlobalCache::LoadNamespaces(ValueMap&& loaded, const std::vector<std::string>& prefixes)
+{
+    for (auto& [key, value] : loaded)
+    {
+        if (!IsLoaded(PrefixOf(key)))
+        {
+            AddLoaded(key, std::move(value));
+        }
+    }
+    for (const auto& prefix : prefixes)
+    {
+        Partition& partition = PartitionFor(prefix);
+        // 校验失败的快照命名空间计入了 m_size，其条目现在由存储引擎读取的分区提供
+        if (!partition.loaded && m_snapshot && !m_snapshot->Verify(prefix))
+        {
+            m_size -= m_snapshot->NamespaceSize(prefix);
+        }
+        partition.loaded = true;
+    }
+}
+
+void GlobalCache::LoadAll(ValueMap&& loaded)
+{
+    for (auto& [key, value] : loaded)
+    {
+        // 已加载的命名空间以缓存为准，其中被删除并已写入的键不能恢复
+        if (!IsLoaded(PrefixOf(key)))
+        {
+            AddLoaded(key, std::move(value));
+        }
+    }
+    for (auto& [prefix, partition] : m_partitions)
+    {
+        partition.loaded = true;
+    }
+    m_allLoaded = true;
+    if (m_snapshot)
+    {
+        // 校验失败的快照命名空间不再可见，重新计数
+        std::size_t count = 0;
+        ForEach("", [&count](std::string_view, const ScriptValueView&) { ++count; });
+        m_size = count;
+    }
+}
+
+void GlobalCache::LoadSnapshot(std::unique_ptr<GlobalSnapshot> snapshot)
+{
+    m_snapshot = std::move(snapshot);
+    m_hiddenSnapshotKeys.clear();
+    m_size = m_snapshot->size();
+    for (const auto& [prefix, partition] : m_partitions)
+    {
+        // 初始化期间的 SetG/DelG 优先于快照
+        for (const auto& key : partition.deletedKeys)
+        {
+            if (m_snapshot->Find(key))
+            {
+                m_hiddenSnapshotKeys.emplace(key);
+                --m_size;
+            }
+        }
+        for (const auto& [key, value] : partition.entries)
+        {
+            if (!m_snapshot->Find(key))
+            {
+                ++m_size;
+            }
+        }
+    }
+}
+
+void GlobalCache::ForEachNamespace(const std::function<void(std::string_view prefix, std::size_t bytes, bool clean)>& visit) const
+{
+    for (const auto& [prefix, partition] : m_partitions)
+    {
+        if (!partition.entries.empty())
+        {
+            visit(prefix, partition.bytes, (partition.loaded || m_allLoaded) && partition.dirtyKeys.empty() && partition.deletedKeys.empty());
+        }
+    }
+}
+
+std::size_t GlobalCache::Evict(const std::string_view prefix)
+{
+    const auto it = m_partitions.find(prefix);
+    if (m_snapshot || it == m_partitions.end())
+    {
+        return 0;
+    }
+    const Partition& partition = it->second;
+    if (!(partition.loaded || m_allLoaded) || !partition.dirtyKeys.empty() || !partition.deletedKeys.empty())
+    {
+        return 0;
+    }
+    const std::size_t bytes = partition.bytes;
+    m_size -= partition.entries.size();
+    m_bytes -= bytes;
+    // 整个分区连同已加载标记一起移除，下次使用时重新从存储引擎读取
+    m_partitions.erase(it);
+    m_allLoaded = false;
+    return bytes;
+}
+
+void GlobalCache::TakeChanges(std::vector<Changes>& out)
+{
+    out.reserve(out.size() + m_changedNamespaces.size());
+    for (const auto& prefix : m_changedNamespaces)
+    {
+        const auto it = m_partitions.find(prefix);
+        if (it == m_partitions.end())
+        {
+            continue;
+        }
+        // 交换而不是复制：取走变更的代价与脏键数量无关
+        Changes& changes = out.emplace_back();
+        changes.prefix = prefix;
+        changes.dirtyKeys.swap(it->second.dirtyKeys);
+        changes.deletedKeys.swap(it->second.deletedKeys);
+    }
+    m_changedNamespaces.clear();
+}
+
+void GlobalCache::ForEach(const std::string_view prefix, const Visitor& visit) const
+{
+    const auto visitPartition = [&](const Partition& partition)
+    {
+        for (const auto& [key, value] : partition.entries)
+        {
+            if (key.starts_with(prefix))
+            {
+                visit(key, ScriptValueView::Of(value));
+            }
+        }
+    };
+    // 不含完整的 "Name:" 前缀时匹配的键可能分布在多个分区；否则都在同一个分区
+    const std::string_view ns = PrefixOf(prefix);
+    if (ns.empty())
+    {
+        for (const auto& [partitionPrefix, partition] : m_partitions)
+        {
+            visitPartition(partition);
+        }
+    }
+    else if (const Partition* partition = FindPartition(ns))
+    {
+        visitPartition(*partition);
+    }
+
+    if (m_snapshot)
+    {
+        m_snapshot->ForEachInNamespace(ns, [&](const std::string_view key, const ScriptValueView& value)
+        {
+            if (!key.starts_with(prefix))
+            {
+                return;
+            }
+            // 已写入分区或被删除的键以分区为准
+            const std::string ownedKey(key);
+            const Partition* partition = FindPartition(PrefixOf(key));
+            if ((partition && partition->entries.contains(ownedKey)) || m_hiddenSnapshotKeys.contains(ownedKey))
+            {
+                return;
+            }
+            visit(key, value);
+        });
+    }
+}
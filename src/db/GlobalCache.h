@@ -0,0 +1,134 @@
+#pragma once
+
+#include <cstddef>
+#include <functional>
+#include <memory>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include "GlobalSnapshot.h"
+#include "ScriptValue.h"
+#include "StorageEngine.h"
+
+// The SetG/GetG cache, partitioned by the "Name:" prefix DB.Create puts in front of keys
+// (see NamespacePrefixLength). Every partition tracks the keys written or deleted since
+// its last flush, so a flush only visits the namespaces that changed: a mod calling SetG
+// every frame costs nothing for the data of the others.
+//
+// Without a snapshot, the stored entries of a namespace are only loaded once it is first
+// used (see IsLoaded), so the data of mods that are no longer installed stays on disk.
+//
+// The cache may sit on top of a mapped GlobalSnapshot: its entries are served from the
+// mapping until they are written, deleted or, for BlobRefs, read, and only then
+// materialized in a partition.
+// Not thread-safe.
+class GlobalCache final
+{
+public:
+    // Changes of one namespace taken by TakeChanges; a key is in at most one set.
+    struct Changes
+    {
+        std::string prefix;
+        std::unordered_set<std::string> dirtyKeys;
+        std::unordered_set<std::string> deletedKeys;
+    };
+
+    using Visitor = std::function<void(std::string_view key, const ScriptValueView& value)>;
+
+    // The view is valid until the cache changes. Keys passed to visitors are NUL-terminated.
+    std::optional<ScriptValueView> Find(const std::string& key) const;
+    bool Contains(const std::string& key) const { return Find(key).has_value(); }
+    // SetG: stores value and marks key for the next flush.
+    void Set(const std::string& key, ScriptValue value);
+    // DelG: removes key and marks it for the next flush; false when it was not cached.
+    bool Erase(const std::string& key);
+    // Replaces the BlobRef cached for key by the string it stands for, without marking key
+    // for the next flush; a BlobRef of the snapshot is replaced in the partition of key.
+    // Does nothing when key no longer holds a BlobRef.
+    void Resolve(const std::string& key, std::string value);
+    // True when key was set or deleted since it was last taken by TakeChanges.
+    bool HasPendingChange(const std::string& key) const;
+    // Marks key for the next flush again with its cached state, after a flush failed to
+    // store it. Returns false, doing nothing, when key has a newer pending change.
+    bool MarkChanged(const std::string& key);
+
+    // False until the stored entries of the namespace prefix were added by LoadNamespaces or
+    // LoadAll, or are served from a snapshot. Entries set before that are kept. A namespace
+    // of the snapshot that fails its checksum is not loaded, so it is read from storage.
+    bool IsLoaded(std::string_view prefix) const;
+    bool IsFullyLoaded() const;
+    // Adds the stored entries of the namespaces prefixes and marks them loaded. Keys that
+    // are cached already or pending deletion keep the cached state, as do namespaces that
+    // are loaded already.
+    void LoadNamespaces(ValueMap&& loaded, const std::vector<std::string>& prefixes);
+    // Adds the stored entries of every namespace not loaded yet and marks all of them loaded.
+    void LoadAll(ValueMap&& loaded);
+    // Serves every key without a pending change from snapshot, which must reflect storage.
+    void LoadSnapshot(std::unique_ptr<GlobalSnapshot> snapshot);
+
+    // Calls visit for every namespace with entries in memory. clean is true when it is loaded
+    // and has no pending change, so Evict may drop it.
+    void ForEachNamespace(const std::function<void(std::string_view prefix, std::size_t bytes, bool clean)>& visit) const;
+    // Drops the entries of a clean namespace from memory; it is loaded again on next use.
+    // Returns the bytes freed, 0 when it is not clean or the cache sits on a snapshot, whose
+    // entries would shadow the newer ones stored since.
+    std::size_t Evict(std::string_view prefix);
+
+    bool HasChanges() const { return !m_changedNamespaces.empty(); }
+    // Moves the pending changes of every namespace that has any into out, one element per
+    // namespace, and clears them.
+    void TakeChanges(std::vector<Changes>& out);
+
+    // Calls visit for every entry whose key starts with prefix; all entries when it is empty.
+    // Namespaces that are not loaded only contribute the entries set since.
+    void ForEach(std::string_view prefix, const Visitor& visit) const;
+    std::size_t size() const { return m_size; }
+    // Approximate heap usage of the entries in memory (see EstimateEntryBytes); entries
+    // served from a mapped snapshot are not counted.
+    std::size_t bytes() const { return m_bytes; }
+    std::size_t namespaceCount() const { return m_partitions.size(); }
+    const GlobalSnapshot* snapshot() const { return m_snapshot.get(); }
+
+private:
+    struct Partition
+    {
+        ValueMap entries;
+        std::unordered_set<std::string> dirtyKeys;
+        std::unordered_set<std::string> deletedKeys;
+        bool loaded = false;
+        std::size_t bytes = 0;
+    };
+
+    // Lets partitions be looked up by a string_view of the key prefix without a copy.
+    struct PrefixHash
+    {
+        using is_transparent = void;
+        std::size_t operator()(const std::string_view prefix) const { return std::hash<std::string_view>{}(prefix); }
+    };
+    using PartitionMap = std::unordered_map<std::string, Partition, PrefixHash, std::equal_to<>>;
+
+    static std::string_view PrefixOf(const std::string_view key) { return key.substr(0, NamespacePrefixLength(key)); }
+    Partition& PartitionFor(const std::string& key);
+    // Adds a stored entry unless key is cached already or pending deletion.
+    void AddLoaded(const std::string& key, ScriptValue&& value);
+    void AddBytes(Partition& partition, std::size_t bytes);
+    void RemoveBytes(Partition& partition, std::size_t bytes);
+    const Partition* FindPartition(std::string_view prefix) const;
+    // The snapshot value of key unless it was deleted since the snapshot was loaded.
+    std::optional<ScriptValueView> FindInSnapshot(std::string_view key) const;
+
+    PartitionMap m_partitions;
+    // Prefixes of the partitions with pending changes.
+    std::unordered_set<std::string> m_changedNamespaces;
+    std::unique_ptr<GlobalSnapshot> m_snapshot;
+    // Snapshot keys deleted by DelG; keys set by SetG are shadowed by their partition entry.
+    std::unordered_set<std::string> m_hiddenSnapshotKeys;
+    // Set by LoadAll: every namespace is loaded, including those no key was seen for yet.
+    bool m_allLoaded = false;
+    std::size_t m_size = 0;
+    std::size_t m_bytes = 0;
+};
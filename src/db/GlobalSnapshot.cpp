@@ -0,0 +1,514 @@
+#include "GlobalSnapshot.h"
+
+#include <cstdio>
+#include <cstring>
+#include <stdexcept>
+#include <system_error>
+#include <vector>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include "../log/log.h"
+#include "ContentHash.h"
+
+namespace
+{
+constexpr std::string_view kSnapshotMagic = "KCDBGSN2";
+constexpr std::size_t kNamespaceBytes = 3 * sizeof(std::uint64_t) + 2 * sizeof(std::uint32_t);
+constexpr std::size_t kEntryHeaderBytes = sizeof(std::uint32_t) + sizeof(std::uint8_t) + sizeof(std::uint32_t);
+constexpr std::size_t kFooterBytes = 6 * sizeof(std::uint64_t);
+// 不在快照中的大值只记录 BlobRef，类型 id 与 StoreValueType 不冲突
+constexpr std::uint8_t kBlobRefType = 0xFF;
+constexpr std::size_t kBlobRefBytes = sizeof(std::int64_t) + sizeof(std::int32_t) + sizeof(std::uint64_t);
+
+template <typename T>
+void Put(std::string& out, const T value)
+{
+    out.append(reinterpret_cast<const char*>(&value), sizeof(value));
+}
+
+template <typename T>
+void PutAt(std::string& out, const std::size_t offset, const T value)
+{
+    std::memcpy(out.data() + offset, &value, sizeof(value));
+}
+
+template <typename T>
+T Get(const char* data, const std::size_t offset)
+{
+    T value;
+    std::memcpy(&value, data + offset, sizeof(value));
+    return value;
+}
+
+std::size_t BucketCount(const std::size_t entries)
+{
+    // 装载因子不超过 1/2，探测链保持很短
+    std::size_t buckets = 16;
+    while (buckets < entries * 2)
+    {
+        buckets *= 2;
+    }
+    return buckets;
+}
+
+std::FILE* OpenFile(const std::filesystem::path& path, const char* mode)
+{
+#ifdef _WIN32
+    const std::wstring wideMode(mode, mode + std::strlen(mode));
+    return _wfopen(path.c_str(), wideMode.c_str());
+#else
+    return std::fopen(path.c_str(), mode);
+#endif
+}
+}
+
+struct GlobalSnapshot::Mapping
+{
+#ifdef _WIN32
+    HANDLE file = INVALID_HANDLE_VALUE;
+    HANDLE mapping = nullptr;
+#else
+    int fd = -1;
+#endif
+    void* view = nullptr;
+    std::size_t size = 0;
+
+    ~Mapping()
+    {
+#ifdef _WIN32
+        if (view)
+        {
+            UnmapViewOfFile(view);
+        }
+        if (mapping)
+        {
+            CloseHandle(mapping);
+        }
+        if (file != INVALID_HANDLE_VALUE)
+        {
+            CloseHandle(file);
+        }
+#else
+        if (view)
+        {
+            munmap(view, size);
+        }
+        if (fd >= 0)
+        {
+            close(fd);
+        }
+#endif
+    }
+
+    // False when the file is missing, empty or cannot be mapped.
+    bool Map(const std::filesystem::path& path)
+    {
+#ifdef _WIN32
+        file = CreateFileW(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+        LARGE_INTEGER fileSize{};
+        if (file == INVALID_HANDLE_VALUE || !GetFileSizeEx(file, &fileSize) || fileSize.QuadPart <= 0)
+        {
+            return false;
+        }
+        size = static_cast<std::size_t>(fileSize.QuadPart);
+        mapping = CreateFileMappingW(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+        view = mapping ? MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0) : nullptr;
+        return view != nullptr;
+#else
+        fd = open(path.c_str(), O_RDONLY);
+        struct stat st{};
+        if (fd < 0 || fstat(fd, &st) != 0 || st.st_size <= 0)
+        {
+            return false;
+        }
+        size = static_cast<std::size_t>(st.st_size);
+        view = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (view == MAP_FAILED)
+        {
+            view = nullptr;
+            return false;
+        }
+        return true;
+#endif
+    }
+};
+
+GlobalSnapshot::~GlobalSnapshot() = default;
+
+GlobalSnapshot::Builder::Builder(std::filesystem::path path, const std::int64_t version) :
+    m_path(std::move(path)),
+    m_version(version)
+{
+    m_tmpPath = m_path;
+    m_tmpPath += ".tmp";
+    m_file = OpenFile(m_tmpPath, "wb");
+    if (!m_file)
+    {
+        throw std::runtime_error("cannot create global snapshot");
+    }
+    // 条目从魔数之后开始，偏移量 0 因此可以表示空桶
+    Append(kSnapshotMagic);
+}
+
+GlobalSnapshot::Builder::~Builder()
+{
+    if (m_file)
+    {
+        std::fclose(m_file);
+    }
+    if (!m_finished)
+    {
+        std::error_code ec;
+        std::filesystem::remove(m_tmpPath, ec);
+    }
+}
+
+void GlobalSnapshot::Builder::Append(const std::string_view data)
+{
+    if (!data.empty() && std::fwrite(data.data(), data.size(), 1, m_file) != 1)
+    {
+        throw std::runtime_error("cannot write global snapshot");
+    }
+    m_offset += data.size();
+}
+
+void GlobalSnapshot::Builder::AddNamespace(const std::string_view prefix, const ValueMap& entries)
+{
+    if (entries.empty())
+    {
+        return;
+    }
+    // 同一命名空间的条目连续存放，按命名空间遍历和校验时只读对应的区间
+    const std::size_t first = m_offset;
+    std::string out;
+    for (const auto& [key, value] : entries)
+    {
+        const std::size_t offset = out.size();
+        Put<std::uint32_t>(out, static_cast<std::uint32_t>(key.size()));
+        Put<std::uint8_t>(out, value.is_blob_ref() ? kBlobRefType : static_cast<std::uint8_t>(value.storeType()));
+        const std::size_t valueLengthOffset = out.size();
+        Put<std::uint32_t>(out, 0);
+        out.append(key);
+        out.push_back('\0');
+        const std::size_t valueOffset = out.size();
+        switch (value.type())
+        {
+        case ScriptValue::Type::BOOL: Put<std::uint8_t>(out, value.as_bool() ? 1 : 0); break;
+        case ScriptValue::Type::NUMBER: Put<float>(out, value.as_number()); break;
+        case ScriptValue::Type::STRING: out.append(value.as_string()); break;
+        case ScriptValue::Type::BLOB_REF:
+        {
+            const BlobRef& ref = value.as_blob_ref();
+            Put<std::int64_t>(out, ref.id);
+            Put<std::int32_t>(out, ref.storedType);
+            Put<std::uint64_t>(out, ref.storedBytes);
+            break;
+        }
+        }
+        PutAt<std::uint32_t>(out, valueLengthOffset, static_cast<std::uint32_t>(out.size() - valueOffset));
+        out.push_back('\0');
+        m_index.emplace_back(ContentHash::Hash64(key), first + offset);
+    }
+    Append(out);
+
+    Put<std::uint64_t>(m_namespaceTable, first);
+    Put<std::uint64_t>(m_namespaceTable, m_offset);
+    Put<std::uint64_t>(m_namespaceTable, ContentHash::Hash64(out));
+    Put<std::uint32_t>(m_namespaceTable, static_cast<std::uint32_t>(prefix.size()));
+    Put<std::uint32_t>(m_namespaceTable, static_cast<std::uint32_t>(entries.size()));
+    m_prefixes.append(prefix);
+    ++m_namespaces;
+}
+
+void GlobalSnapshot::Builder::Finish()
+{
+    const std::size_t buckets = BucketCount(m_index.size());
+    const std::size_t tableOffset = m_offset;
+    std::string index = std::move(m_namespaceTable);
+    index.append(m_prefixes);
+    const std::size_t bucketOffset = index.size();
+    index.resize(bucketOffset + buckets * sizeof(std::uint64_t), '\0');
+    for (const auto& [hash, offset] : m_index)
+    {
+        std::size_t bucket = hash & (buckets - 1);
+        while (Get<std::uint64_t>(index.data(), bucketOffset + bucket * sizeof(std::uint64_t)) != 0)
+        {
+            bucket = (bucket + 1) & (buckets - 1);
+        }
+        PutAt<std::uint64_t>(index, bucketOffset + bucket * sizeof(std::uint64_t), offset);
+    }
+    Put<std::int64_t>(index, m_version);
+    Put<std::uint64_t>(index, m_index.size());
+    Put<std::uint64_t>(index, m_namespaces);
+    Put<std::uint64_t>(index, buckets);
+    Put<std::uint64_t>(index, tableOffset);
+    Put<std::uint64_t>(index, ContentHash::Hash64(index));
+    Append(index);
+
+    // 快照只是加速用的副本，不需要 fsync；写到一半的文件会被校验和发现
+    const bool closed = std::fclose(m_file) == 0;
+    m_file = nullptr;
+    std::error_code ec;
+    if (closed)
+    {
+        std::filesystem::rename(m_tmpPath, m_path, ec);
+    }
+    if (!closed || ec)
+    {
+        throw std::runtime_error("cannot write global snapshot");
+    }
+    m_finished = true;
+}
+
+std::unique_ptr<GlobalSnapshot> GlobalSnapshot::Open(const std::filesystem::path& path,
+                                                     const std::int64_t expectedVersion,
+                                                     std::string& reason)
+{
+    std::unique_ptr<GlobalSnapshot> snapshot(new GlobalSnapshot());
+    snapshot->m_mapping = std::make_unique<Mapping>();
+    if (!snapshot->m_mapping->Map(path))
+    {
+        reason = "missing";
+        return nullptr;
+    }
+    const char* data = static_cast<const char*>(snapshot->m_mapping->view);
+    const std::size_t size = snapshot->m_mapping->size;
+    if (size < kSnapshotMagic.size() + kFooterBytes || std::string_view(data, kSnapshotMagic.size()) != kSnapshotMagic)
+    {
+        reason = "not a snapshot";
+        return nullptr;
+    }
+    snapshot->m_data = data;
+    snapshot->m_size = size;
+
+    const std::size_t footer = size - kFooterBytes;
+    std::size_t offset = footer;
+    snapshot->m_version = Get<std::int64_t>(data, offset);
+    snapshot->m_entries = Get<std::uint64_t>(data, offset += sizeof(std::uint64_t));
+    const auto namespaces = Get<std::uint64_t>(data, offset += sizeof(std::uint64_t));
+    snapshot->m_buckets = Get<std::uint64_t>(data, offset += sizeof(std::uint64_t));
+    const auto tableOffset = Get<std::uint64_t>(data, offset += sizeof(std::uint64_t));
+    const auto checksum = Get<std::uint64_t>(data, offset += sizeof(std::uint64_t));
+    if (tableOffset < kSnapshotMagic.size() || tableOffset > footer)
+    {
+        reason = "malformed footer";
+        return nullptr;
+    }
+    if (checksum != ContentHash::Hash64(std::string_view(data + tableOffset, size - sizeof(std::uint64_t) - tableOffset)))
+    {
+        reason = "checksum mismatch";
+        return nullptr;
+    }
+
+    const std::size_t buckets = snapshot->m_buckets;
+    if (buckets == 0 || (buckets & (buckets - 1)) != 0 || snapshot->m_entries >= buckets
+        || namespaces > (footer - tableOffset) / kNamespaceBytes)
+    {
+        reason = "malformed header";
+        return nullptr;
+    }
+    std::size_t prefixOffset = tableOffset + namespaces * kNamespaceBytes;
+    snapshot->m_namespaces.reserve(namespaces);
+    for (std::size_t i = 0; i < namespaces; ++i)
+    {
+        const std::size_t record = tableOffset + i * kNamespaceBytes;
+        Namespace ns;
+        ns.first = static_cast<std::size_t>(Get<std::uint64_t>(data, record));
+        ns.end = static_cast<std::size_t>(Get<std::uint64_t>(data, record + sizeof(std::uint64_t)));
+        ns.checksum = Get<std::uint64_t>(data, record + 2 * sizeof(std::uint64_t));
+        const auto prefixLength = Get<std::uint32_t>(data, record + 3 * sizeof(std::uint64_t));
+        ns.entries = Get<std::uint32_t>(data, record + 3 * sizeof(std::uint64_t) + sizeof(std::uint32_t));
+        if (ns.first < kSnapshotMagic.size() || ns.first > ns.end || ns.end > tableOffset || prefixLength > footer - prefixOffset)
+        {
+            reason = "malformed namespace table";
+            return nullptr;
+        }
+        ns.prefix = std::string_view(data + prefixOffset, prefixLength);
+        if (!snapshot->m_namespaceIndex.emplace(ns.prefix, i).second)
+        {
+            reason = "malformed namespace table";
+            return nullptr;
+        }
+        prefixOffset += prefixLength;
+        snapshot->m_namespaces.push_back(ns);
+    }
+    snapshot->m_verified.assign(snapshot->m_namespaces.size(), 0);
+    snapshot->m_bucketOffset = prefixOffset;
+    if (buckets > footer / sizeof(std::uint64_t) || footer - prefixOffset != buckets * sizeof(std::uint64_t))
+    {
+        reason = "malformed header";
+        return nullptr;
+    }
+    if (snapshot->m_version != expectedVersion)
+    {
+        reason = "stale";
+        return nullptr;
+    }
+    // 条目区间在首次使用时才校验，打开快照的代价与数据量无关
+    return snapshot;
+}
+
+bool GlobalSnapshot::Verify(const std::size_t index) const
+{
+    if (m_verified[index] == 0)
+    {
+        const Namespace& ns = m_namespaces[index];
+        const bool valid = ContentHash::Hash64(std::string_view(m_data + ns.first, ns.end - ns.first)) == ns.checksum;
+        m_verified[index] = valid ? 1 : 2;
+        if (!valid)
+        {
+            LogWarn("Global snapshot: the %zu entries of namespace \"%.*s\" fail their checksum; loading them from storage.",
+                    ns.entries,
+                    static_cast<int>(ns.prefix.size()),
+                    ns.prefix.data());
+        }
+    }
+    return m_verified[index] == 1;
+}
+
+bool GlobalSnapshot::Verify(const std::string_view prefix) const
+{
+    const auto it = m_namespaceIndex.find(prefix);
+    return it == m_namespaceIndex.end() || Verify(it->second);
+}
+
+bool GlobalSnapshot::VerifyAll() const
+{
+    bool valid = true;
+    for (std::size_t i = 0; i < m_namespaces.size(); ++i)
+    {
+        valid = Verify(i) && valid;
+    }
+    return valid;
+}
+
+std::size_t GlobalSnapshot::NamespaceSize(const std::string_view prefix) const
+{
+    const auto it = m_namespaceIndex.find(prefix);
+    return it != m_namespaceIndex.end() ? m_namespaces[it->second].entries : 0;
+}
+
+std::size_t GlobalSnapshot::ReadEntry(const std::size_t offset,
+                                      const std::size_t end,
+                                      std::string_view& key,
+                                      ScriptValueView& value) const
+{
+    if (offset > end || end - offset < kEntryHeaderBytes)
+    {
+        return 0;
+    }
+    const auto keyLength = Get<std::uint32_t>(m_data, offset);
+    const auto type = Get<std::uint8_t>(m_data, offset + sizeof(std::uint32_t));
+    const auto valueLength = Get<std::uint32_t>(m_data, offset + sizeof(std::uint32_t) + sizeof(std::uint8_t));
+    const std::size_t keyOffset = offset + kEntryHeaderBytes;
+    const std::size_t valueOffset = keyOffset + keyLength + 1;
+    if (static_cast<std::size_t>(keyLength) + valueLength + 2 > end - keyOffset)
+    {
+        return 0;
+    }
+    key = std::string_view(m_data + keyOffset, keyLength);
+    value = {};
+    switch (type)
+    {
+    case StoreValueType::kBool:
+        value.type = ScriptValue::Type::BOOL;
+        value.boolean = m_data[valueOffset] != 0;
+        break;
+    case StoreValueType::kNumber:
+        value.type = ScriptValue::Type::NUMBER;
+        value.number = Get<float>(m_data, valueOffset);
+        break;
+    case StoreValueType::kString:
+        value.type = ScriptValue::Type::STRING;
+        value.string = std::string_view(m_data + valueOffset, valueLength);
+        break;
+    case kBlobRefType:
+        if (valueLength != kBlobRefBytes)
+        {
+            return 0;
+        }
+        value.type = ScriptValue::Type::BLOB_REF;
+        value.blob.id = Get<std::int64_t>(m_data, valueOffset);
+        value.blob.storedType = Get<std::int32_t>(m_data, valueOffset + sizeof(std::int64_t));
+        value.blob.storedBytes = Get<std::uint64_t>(m_data, valueOffset + sizeof(std::int64_t) + sizeof(std::int32_t));
+        break;
+    default:
+        return 0;
+    }
+    return valueOffset + valueLength + 1;
+}
+
+std::optional<ScriptValueView> GlobalSnapshot::Find(const std::string_view key) const
+{
+    // 键所在的命名空间不在快照中时不必探测索引
+    const auto it = m_namespaceIndex.find(key.substr(0, NamespacePrefixLength(key)));
+    if (it == m_namespaceIndex.end() || !Verify(it->second))
+    {
+        return std::nullopt;
+    }
+    const Namespace& ns = m_namespaces[it->second];
+    const std::size_t mask = m_buckets - 1;
+    std::size_t bucket = ContentHash::Hash64(key) & mask;
+    for (std::size_t probes = 0; probes < m_buckets; ++probes, bucket = (bucket + 1) & mask)
+    {
+        const auto offset = static_cast<std::size_t>(Get<std::uint64_t>(m_data, m_bucketOffset + bucket * sizeof(std::uint64_t)));
+        if (offset == 0)
+        {
+            break;
+        }
+        if (offset < ns.first || offset >= ns.end)
+        {
+            continue;
+        }
+        std::string_view entryKey;
+        ScriptValueView value;
+        if (ReadEntry(offset, ns.end, entryKey, value) != 0 && entryKey == key)
+        {
+            return value;
+        }
+    }
+    return std::nullopt;
+}
+
+void GlobalSnapshot::VisitNamespace(const std::size_t index, const Visitor& visit) const
+{
+    if (!Verify(index))
+    {
+        return;
+    }
+    const Namespace& ns = m_namespaces[index];
+    std::string_view key;
+    ScriptValueView value;
+    for (std::size_t offset = ns.first; offset < ns.end;)
+    {
+        offset = ReadEntry(offset, ns.end, key, value);
+        if (offset == 0)
+        {
+            break;
+        }
+        visit(key, value);
+    }
+}
+
+void GlobalSnapshot::ForEachInNamespace(const std::string_view prefix, const Visitor& visit) const
+{
+    if (prefix.empty())
+    {
+        for (std::size_t i = 0; i < m_namespaces.size(); ++i)
+        {
+            VisitNamespace(i, visit);
+        }
+    }
+    else if (const auto it = m_namespaceIndex.find(prefix); it != m_namespaceIndex.end())
+    {
+        VisitNamespace(it->second, visit);
+    }
+}
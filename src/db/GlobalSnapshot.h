@@ -0,0 +1,136 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <filesystem>
+#include <functional>
+#include <memory>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "ScriptValue.h"
+#include "StorageEngine.h"
+
+// A read-only, memory-mapped image of the global scope. Lookups hash into an index in the
+// file and return views of the mapped bytes, so opening a snapshot costs a checksum of the
+// index instead of a SQL scan plus one allocation per entry. The entries of a namespace are
+// checked against their own checksum when it is first used; a namespace that fails it is
+// treated as not in the snapshot.
+//
+// File layout (integers little-endian):
+//   magic       "KCDBGSN2"
+//   entries     grouped by namespace: u32 key length, u8 type, u32 value length, key, NUL,
+//               value, NUL. type is the StoreValueType of a u8 bool, f32 number or string,
+//               or 0xFF for a string left in storage, whose BlobRef is i64 id, i32 stored
+//               type, u64 stored bytes
+//   namespaces  per "Name:" prefix: u64 first entry offset, u64 end offset, u64 XXH64 of
+//               the entries in between, u32 prefix length, u32 entry count
+//   prefixes    the prefixes of the namespace table, in its order
+//   buckets     u64 entry offset per bucket, 0 when empty; linear probing on XXH64 of the key
+//   footer      u64 version, u64 entries, u64 namespaces, u64 buckets, u64 offset of the
+//               namespace table, u64 XXH64 of the namespace table up to this field
+//
+// version is the StorageEngine::GlobalVersion() the snapshot was taken at: a snapshot whose
+// version differs from the engine's is stale and must not be used.
+class GlobalSnapshot final
+{
+public:
+    using Visitor = std::function<void(std::string_view key, const ScriptValueView& value)>;
+
+    // Writes a snapshot one namespace at a time, so only the namespace being added is held
+    // in memory, plus 16 bytes per entry for the index. Strings stored out of line stay
+    // BlobRefs and are not read. The file replaces path once Finish succeeded; until then it
+    // is a temporary file, removed by the destructor.
+    class Builder final
+    {
+    public:
+        Builder(std::filesystem::path path, std::int64_t version);
+        ~Builder();
+        Builder(const Builder&) = delete;
+        Builder& operator=(const Builder&) = delete;
+
+        // Appends the entries of the namespace prefix; every key must start with it.
+        void AddNamespace(std::string_view prefix, const ValueMap& entries);
+        void Finish();
+
+        std::size_t size() const { return m_index.size(); }
+        std::size_t bytes() const { return m_offset; }
+
+    private:
+        void Append(std::string_view data);
+
+        std::filesystem::path m_path;
+        std::filesystem::path m_tmpPath;
+        std::FILE* m_file = nullptr;
+        std::int64_t m_version = 0;
+        std::size_t m_offset = 0;
+        // XXH64 of the key and offset of every entry.
+        std::vector<std::pair<std::uint64_t, std::uint64_t>> m_index;
+        std::string m_namespaceTable;
+        std::string m_prefixes;
+        std::size_t m_namespaces = 0;
+        bool m_finished = false;
+    };
+
+    // Maps path. Returns null and sets reason when the file is missing, its index is
+    // corrupt or it is not at expectedVersion.
+    static std::unique_ptr<GlobalSnapshot> Open(const std::filesystem::path& path,
+                                                std::int64_t expectedVersion,
+                                                std::string& reason);
+
+    ~GlobalSnapshot();
+    GlobalSnapshot(const GlobalSnapshot&) = delete;
+    GlobalSnapshot& operator=(const GlobalSnapshot&) = delete;
+
+    std::optional<ScriptValueView> Find(std::string_view key) const;
+    // Calls visit for every entry of the namespace prefix, or of every namespace when prefix
+    // is empty. Keys are NUL-terminated; values may be BlobRefs.
+    void ForEachInNamespace(std::string_view prefix, const Visitor& visit) const;
+    // False when the entries of the namespace prefix fail their checksum; true when they
+    // pass it or the snapshot has no such namespace. The result is cached.
+    bool Verify(std::string_view prefix) const;
+    // Verify for every namespace.
+    bool VerifyAll() const;
+    // Entries of the namespace prefix, whether or not they pass their checksum.
+    std::size_t NamespaceSize(std::string_view prefix) const;
+
+    std::int64_t version() const { return m_version; }
+    std::size_t size() const { return m_entries; }
+    std::size_t bytes() const { return m_size; }
+
+private:
+    struct Mapping;
+    struct Namespace
+    {
+        std::string_view prefix;
+        std::size_t first = 0;
+        std::size_t end = 0;
+        std::uint64_t checksum = 0;
+        std::size_t entries = 0;
+    };
+
+    GlobalSnapshot() = default;
+    // Decodes the entry at offset of a namespace ending at end; returns the offset of the
+    // next entry, 0 when the entry is malformed.
+    std::size_t ReadEntry(std::size_t offset, std::size_t end, std::string_view& key, ScriptValueView& value) const;
+    bool Verify(std::size_t index) const;
+    void VisitNamespace(std::size_t index, const Visitor& visit) const;
+
+    std::unique_ptr<Mapping> m_mapping;
+    const char* m_data = nullptr;
+    std::size_t m_size = 0;
+    std::int64_t m_version = 0;
+    std::size_t m_entries = 0;
+    std::size_t m_buckets = 0;
+    std::size_t m_bucketOffset = 0;
+    std::vector<Namespace> m_namespaces;
+    // Per namespace: 0 not checked yet, 1 valid, 2 corrupt.
+    mutable std::vector<std::uint8_t> m_verified;
+    // Prefix views into the mapped prefix block, to m_namespaces indices.
+    std::unordered_map<std::string_view, std::size_t> m_namespaceIndex;
+};
@@ -0,0 +1,84 @@
+#include "HydrationPool.h"
+
+#include <utility>
+
+HydrationPool::HydrationPool(const std::size_t threads)
+{
+    m_threads.reserve(threads);
+    for (std::size_t i = 0; i < threads; ++i)
+    {
+        m_threads.emplace_back(&HydrationPool::ThreadMain, this, i);
+    }
+}
+
+HydrationPool::~HydrationPool()
+{
+    {
+        std::lock_guard lock(m_mutex);
+        m_stopping = true;
+    }
+    m_jobAdded.notify_all();
+    for (auto& thread : m_threads)
+    {
+        thread.join();
+    }
+}
+
+void HydrationPool::Submit(Job job)
+{
+    {
+        std::unique_lock lock(m_mutex);
+        m_jobDone.wait(lock, [this] { return m_queue.size() < 2 * m_threads.size(); });
+        m_queue.push_back(std::move(job));
+    }
+    m_jobAdded.notify_one();
+}
+
+void HydrationPool::Wait()
+{
+    std::unique_lock lock(m_mutex);
+    m_jobDone.wait(lock, [this] { return m_queue.empty() && m_running == 0; });
+    if (m_error)
+    {
+        std::rethrow_exception(std::exchange(m_error, nullptr));
+    }
+}
+
+void HydrationPool::ThreadMain(const std::size_t worker)
+{
+    while (true)
+    {
+        Job job;
+        {
+            std::unique_lock lock(m_mutex);
+            m_jobAdded.wait(lock, [this] { return m_stopping || !m_queue.empty(); });
+            if (m_queue.empty())
+            {
+                return;
+            }
+            job = std::move(m_queue.front());
+            m_queue.pop_front();
+            ++m_running;
+        }
+        // 队列已腾出位置，唤醒等待提交的读取线程
+        m_jobDone.notify_all();
+        std::exception_ptr error;
+        try
+        {
+            job(worker);
+        }
+        catch (...)
+        {
+            error = std::current_exception();
+        }
+        {
+            std::lock_guard lock(m_mutex);
+            --m_running;
+            if (error && !m_error)
+            {
+                m_error = error;
+            }
+        }
+        m_jobDone.notify_all();
+    }
+}
@@ -0,0 +1,44 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Worker threads that decode loaded rows while the persistence thread keeps reading them
+// from storage. Each job is told the index of the worker running it, so jobs can fill
+// per-worker state without locking. The first exception thrown by a job is rethrown by Wait.
+class HydrationPool final
+{
+public:
+    using Job = std::function<void(std::size_t worker)>;
+
+    explicit HydrationPool(std::size_t threads);
+    ~HydrationPool();
+
+    HydrationPool(const HydrationPool&) = delete;
+    HydrationPool& operator=(const HydrationPool&) = delete;
+
+    std::size_t size() const { return m_threads.size(); }
+    // Queues job, blocking while 2 jobs per worker are already waiting so that a reader
+    // faster than the workers does not buffer the whole result.
+    void Submit(Job job);
+    // Waits until every submitted job finished and rethrows the first exception of one.
+    void Wait();
+
+private:
+    void ThreadMain(std::size_t worker);
+
+    std::vector<std::thread> m_threads;
+    std::mutex m_mutex;
+    std::condition_variable m_jobAdded;
+    std::condition_variable m_jobDone;
+    std::deque<Job> m_queue;
+    std::size_t m_running = 0;
+    std::exception_ptr m_error;
+    bool m_stopping = false;
+};
@@ -0,0 +1,203 @@
+#include "LogEngine.h"
+
+#include <chrono>
+#include <stdexcept>
+
+#include "../log/log.h"
+
+namespace
+{
+constexpr std::string_view kLogMagic = "KCDBLOG1";
+// Compaction starts once the log is twice its compacted size plus this much.
+constexpr std::uint64_t kCompactionSlackBytes = 1024 * 1024;
+
+void EncodeScope(RecordWriter& record, const std::string& savefile, const std::int64_t version, const ValueMap& entries)
+{
+    record.PutString(savefile);
+    record.PutI64(version);
+    record.PutU32(static_cast<std::uint32_t>(entries.size()));
+    for (const auto& [k, v] : entries)
+    {
+        record.PutString(k);
+        record.PutValue(v);
+    }
+}
+}
+
+LogEngine::LogEngine(const std::filesystem::path& path) :
+    m_log(path, kLogMagic, [this](const std::string_view payload) { Replay(payload); })
+{
+    m_compactedSize = m_log.size();
+    LogDebug("LuaDB log opened: %llu records, %llu bytes, %zu scopes.",
+             static_cast<unsigned long long>(m_log.recordCount()),
+             static_cast<unsigned long long>(m_log.size()),
+             m_scopes.size());
+}
+
+void LogEngine::Replay(const std::string_view payload)
+{
+    RecordReader reader(payload);
+    std::uint8_t op = 0;
+    reader.GetU8(op);
+    switch (static_cast<Op>(op))
+    {
+    case Op::GlobalBatch:
+        {
+            GlobalBatch batch;
+            std::uint32_t count = 0;
+            reader.GetU32(count);
+            for (std::uint32_t i = 0; i < count; ++i)
+            {
+                if (!reader.GetString(batch.deletes.emplace_back()))
+                {
+                    break;
+                }
+            }
+            reader.GetU32(count);
+            for (std::uint32_t i = 0; i < count; ++i)
+            {
+                auto& [k, v] = batch.upserts.emplace_back();
+                if (!reader.GetString(k) || !reader.GetValue(v))
+                {
+                    break;
+                }
+            }
+            if (reader.done())
+            {
+                MemoryEngine::ApplyBatch(batch);
+                return;
+            }
+            break;
+        }
+    case Op::Snapshot:
+        {
+            std::string savefile;
+            std::int64_t version = 0;
+            std::uint32_t count = 0;
+            ValueMap entries;
+            if (reader.GetString(savefile) && reader.GetI64(version) && reader.GetU32(count))
+            {
+                entries.reserve(count);
+                for (std::uint32_t i = 0; i < count; ++i)
+                {
+                    std::string k;
+                    ScriptValue v;
+                    if (!reader.GetString(k) || !reader.GetValue(v))
+                    {
+                        break;
+                    }
+                    entries.insert_or_assign(std::move(k), std::move(v));
+                }
+            }
+            if (reader.done())
+            {
+                PutScope(savefile, std::move(entries), version);
+                return;
+            }
+            break;
+        }
+    case Op::DeleteScope:
+        {
+            std::string savefile;
+            std::int64_t version = 0;
+            if (reader.GetString(savefile) && reader.GetI64(version) && reader.done())
+            {
+                MemoryEngine::DeleteScope({savefile, 0, version}, 0);
+                return;
+            }
+            break;
+        }
+    }
+    // 校验和正确但内容无法解析，说明文件由不兼容的版本写入，不能忽略
+    // m_log 在回放期间尚未构造完成，不能在这里使用
+    throw std::runtime_error("malformed LuaDB log record");
+}
+
+void LogEngine::Commit(const RecordWriter& record)
+{
+    // 先写日志并落盘，再修改内存状态；写入失败时内存保持原样
+    m_log.Append(record.data());
+    m_log.Sync();
+}
+
+BatchResult LogEngine::ApplyBatch(const GlobalBatch& batch)
+{
+    RecordWriter record;
+    record.PutU8(static_cast<std::uint8_t>(Op::GlobalBatch));
+    record.PutU32(static_cast<std::uint32_t>(batch.deletes.size()));
+    for (const auto& k : batch.deletes)
+    {
+        record.PutString(k);
+    }
+    record.PutU32(static_cast<std::uint32_t>(batch.upserts.size()));
+    for (const auto& [k, v] : batch.upserts)
+    {
+        record.PutString(k);
+        record.PutValue(v);
+    }
+    Commit(record);
+    return MemoryEngine::ApplyBatch(batch);
+}
+
+void LogEngine::SnapshotSave(const std::string& savefile, const ValueMap& entries)
+{
+    const std::int64_t version = NextVersion();
+    RecordWriter record;
+    record.PutU8(static_cast<std::uint8_t>(Op::Snapshot));
+    EncodeScope(record, savefile, version, entries);
+    Commit(record);
+    PutScope(savefile, entries, version);
+    LogInfo("Data saved: %zu entries", entries.size());
+}
+
+std::uint64_t LogEngine::DeleteScope(const StoredSave& save, const std::uint32_t maxEntries)
+{
+    const auto it = m_scopes.find(save.savefile);
+    if (save.savefile.empty() || it == m_scopes.end() || it->second.version != save.version)
+    {
+        return 0;
+    }
+    RecordWriter record;
+    record.PutU8(static_cast<std::uint8_t>(Op::DeleteScope));
+    record.PutString(save.savefile);
+    record.PutI64(save.version);
+    Commit(record);
+    return MemoryEngine::DeleteScope(save, maxEntries);
+}
+
+bool LogEngine::HasIdleWork() const
+{
+    return m_log.size() > 2 * m_compactedSize + kCompactionSlackBytes;
+}
+
+bool LogEngine::Idle()
+{
+    if (HasIdleWork())
+    {
+        Compact();
+    }
+    return false;
+}
+
+void LogEngine::Compact()
+{
+    const auto start = std::chrono::steady_clock::now();
+    const std::uint64_t before = m_log.size();
+    RecordWriter record;
+    m_log.Rewrite([&](const RecordLog::RecordSink& sink)
+    {
+        for (const auto& [savefile, scope] : m_scopes)
+        {
+            record.Clear();
+            record.PutU8(static_cast<std::uint8_t>(Op::Snapshot));
+            EncodeScope(record, savefile, scope.version, scope.entries);
+            sink(record.data());
+        }
+    });
+    m_compactedSize = m_log.size();
+    LogInfo("LuaDB log compacted from %llu to %llu bytes in %lld ms.",
+            static_cast<unsigned long long>(before),
+            static_cast<unsigned long long>(m_compactedSize),
+            static_cast<long long>(std::chrono::duration_cast<std::chrono::milliseconds>(
+                std::chrono::steady_clock::now() - start).count()));
+}
@@ -0,0 +1,43 @@
+#pragma once
+
+#include <cstdint>
+#include <filesystem>
+#include <string_view>
+
+#include "MemoryEngine.h"
+#include "RecordLog.h"
+
+// Log-structured storage engine: every operation is appended to a single RecordLog and
+// fsynced before it is applied to the in-memory scopes, which are rebuilt by replaying the
+// log on startup. Once the log grows well past its size after the last compaction, Idle()
+// rewrites it as one snapshot record per scope.
+class LogEngine final : public MemoryEngine
+{
+public:
+    explicit LogEngine(const std::filesystem::path& path);
+
+    const char* name() const override { return "log"; }
+
+    BatchResult ApplyBatch(const GlobalBatch& batch) override;
+    void SnapshotSave(const std::string& savefile, const ValueMap& entries) override;
+    std::uint64_t DeleteScope(const StoredSave& save, std::uint32_t maxEntries) override;
+
+    bool HasIdleWork() const override;
+    bool Idle() override;
+
+private:
+    enum class Op : std::uint8_t
+    {
+        GlobalBatch = 1,
+        Snapshot = 2,
+        DeleteScope = 3,
+    };
+
+    void Replay(std::string_view payload);
+    void Commit(const RecordWriter& record);
+    void Compact();
+
+    RecordLog m_log;
+    // Log size right after opening or the last compaction.
+    std::uint64_t m_compactedSize = 0;
+};
@@ -5,13 +5,22 @@
 #include "LuaDB.h"
 #include <cryengine/IConsole.h>
 #include <cryengine/IGame.h>
+#include <algorithm>
 #include <cwchar>
 #include <cstdint>
-#include <ranges>
 #include <sstream>
 #include <unordered_set>
 #include <string>
+#include <utility>
+#include <vector>
 #include <windows.h>
+#include "ChangeCaptureEngine.h"
+#include "GlobalSnapshot.h"
+#include "LogEngine.h"
+#include "LuaDBOptions.h"
+#include "MemoryEngine.h"
+#include "RedoLog.h"
+#include "SqliteEngine.h"
 #include "../lua/db.h"
 #include "../lua/LuaRunner.h"
 
@@ -19,6 +28,21 @@ namespace
 {
 constexpr char kDatabasePath[] = "./kcd2db.db";
 constexpr wchar_t kDatabasePathWide[] = L".\\kcd2db.db";
+// kcd2db.log is taken by the plugin log.
+constexpr char kLogEnginePath[] = "./kcd2db.kvlog";
+constexpr char kRedoLogPath[] = "./kcd2db.redo";
+// Change stream files are named kcd2db.changes.<first sequence>.log.
+constexpr char kChangeStreamStem[] = "./kcd2db.changes";
+// Two slots: the one mapped by the running game is never replaced, the other one is.
+constexpr const char* kGlobalSnapshotPaths[] = {"./kcd2db.global0.snap", "./kcd2db.global1.snap"};
+// How long global data must stay unchanged before the snapshot is rewritten.
+constexpr auto kGlobalSnapshotQuietTime = std::chrono::seconds(5);
+// Memory the recent save caches kept by SaveCacheLru may take.
+constexpr std::size_t kSaveLruMaxBytes = std::size_t{64} << 20;
+// Minimum time between save garbage collection passes started by OnSaveGame.
+constexpr auto kSaveCollectorInterval = std::chrono::minutes(10);
+// 全局写入失败的键重新写入的最短间隔
+constexpr auto kGlobalRetryInterval = std::chrono::seconds(10);
 
 std::string WideToUtf8(const wchar_t* value)
 {
@@ -105,6 +129,50 @@ std::unique_ptr<SQLite::Database> OpenDatabase()
     }
 }
 
+std::string QueryJournalMode(SQLite::Database& db, const char* pragma)
+{
+    SQLite::Statement stmt(db, pragma);
+    return stmt.executeStep() ? stmt.getColumn(0).getString() : std::string();
+}
+
+// WAL turns each commit into a single append to kcd2db.db-wal. synchronous=NORMAL skips
+// the per-commit fsync (the database stays consistent; only the last commits can be lost
+// on power failure), and automatic checkpoints are left to SqliteEngine.
+CheckpointPolicy ConfigureJournal(SQLite::Database& db)
+{
+    const LuaDBOptions& options = GetLuaDBOptions();
+    if (options.journalMode == JournalMode::Rollback)
+    {
+        LogDebug("SQLite journal mode: %s (requested rollback).", QueryJournalMode(db, "PRAGMA journal_mode=DELETE").c_str());
+        return {};
+    }
+
+    try
+    {
+        if (const std::string mode = QueryJournalMode(db, "PRAGMA journal_mode=WAL"); mode != "wal")
+        {
+            LogWarn("SQLite WAL mode is unavailable; journal mode is %s.", mode.c_str());
+            return {};
+        }
+        const std::uint64_t walLimitBytes = static_cast<std::uint64_t>(options.walLimitMB) * 1024 * 1024;
+        db.exec("PRAGMA synchronous=NORMAL");
+        db.exec("PRAGMA wal_autocheckpoint=0");
+        db.exec("PRAGMA journal_size_limit=" + std::to_string(walLimitBytes));
+        LogDebug("SQLite journal mode: wal, checkpoint idle delay=%u ms, WAL limit=%u MB.",
+                 options.checkpointIdleMs,
+                 options.walLimitMB);
+        return CheckpointPolicy{
+            .enabled = true,
+            .walLimitBytes = walLimitBytes,
+        };
+    }
+    catch (const std::exception& e)
+    {
+        LogWarn("Failed to enable SQLite WAL mode: %s", e.what());
+        return {};
+    }
+}
+
 void LogDatabaseList(SQLite::Database& db)
 {
     try
@@ -124,42 +192,91 @@ void LogDatabaseList(SQLite::Database& db)
     }
 }
 
-class TempTableGuard
+std::unique_ptr<StorageEngine> CreateEngine()
 {
-public:
-    TempTableGuard(SQLite::Database& db, const std::string& tableName, const std::string& schema) :
-        m_db(db),
-        m_tableName(tableName)
+    switch (GetLuaDBOptions().engine)
     {
-        const std::string createSql = "CREATE TEMP TABLE IF NOT EXISTS " + m_tableName + " " + schema;
-        SQLite::Statement createStmt(m_db, createSql.c_str());
-        createStmt.exec();
+    case StorageEngineKind::Log:
+        LogDebug("Opening LuaDB log: %s", kLogEnginePath);
+        return std::make_unique<LogEngine>(kLogEnginePath);
+    case StorageEngineKind::Memory:
+        LogWarn("LuaDB memory engine selected: data will not be persisted.");
+        return std::make_unique<MemoryEngine>();
+    case StorageEngineKind::Sqlite:
+    default:
+        {
+            auto db = OpenDatabase();
+            LogDatabaseList(*db);
+            // 仅对新建的空数据库立即生效；已有数据库由 kcd2db_tool compact 重建时转换
+            db->exec("PRAGMA auto_vacuum=INCREMENTAL");
+            const CheckpointPolicy checkpointPolicy = ConfigureJournal(*db);
+            const CompressionPolicy compressionPolicy{.minBytes = GetLuaDBOptions().compressMinBytes};
+            const LazyValuePolicy lazyValuePolicy{.minBytes = GetLuaDBOptions().lazyMinBytes};
+            const BackupPolicy backupPolicy{
+                .path = kDatabasePath,
+                .generations = GetLuaDBOptions().backupGenerations,
+                .interval = std::chrono::minutes(GetLuaDBOptions().backupMinutes),
+            };
+            // 游戏本身需要大部分处理器，解码线程最多占一半
+            const HydrationPolicy hydrationPolicy{
+                .threads = std::min<std::size_t>(GetLuaDBOptions().loadThreads,
+                                                 std::max(1u, std::thread::hardware_concurrency() / 2)),
+            };
+            auto engine = std::make_unique<SqliteEngine>(
+                std::move(db), checkpointPolicy, compressionPolicy, lazyValuePolicy, backupPolicy, hydrationPolicy);
+            LogDebug("LuaDB schema initialization completed.");
+            LogDatabaseFileDiagnostics("schema initialization");
+            return engine;
+        }
     }
+}
 
-    ~TempTableGuard()
+// engine, wrapped so that its changes reach the change stream when -kcd2dbChangeStreamMB
+// enables it.
+std::unique_ptr<StorageEngine> WithChangeStream(std::unique_ptr<StorageEngine> engine)
+{
+    const LuaDBOptions& options = GetLuaDBOptions();
+    if (options.changeStreamMB == 0)
     {
-        try
-        {
-            const std::string dropSql = "DROP TABLE IF EXISTS " + m_tableName;
-            SQLite::Statement dropStmt(m_db, dropSql.c_str());
-            dropStmt.exec();
-        }
-        catch (...)
-        {
-        }
+        return engine;
     }
+    return std::make_unique<ChangeCaptureEngine>(std::move(engine), ChangeStreamWriter::Options{
+        .stem = kChangeStreamStem,
+        .rotateBytes = std::uint64_t{options.changeStreamMB} << 20,
+        .keepFiles = options.changeStreamFiles,
+        .maxAge = std::chrono::hours(options.changeStreamHours),
+    });
+}
 
-    void Clear() const
+// Null when the redo log is disabled, pointless (memory engine) or cannot be opened.
+std::unique_ptr<RedoLog> CreateRedoLog()
+{
+    const LuaDBOptions& options = GetLuaDBOptions();
+    if (options.redoSync == RedoSync::Off || options.engine == StorageEngineKind::Memory)
+    {
+        return nullptr;
+    }
+    try
+    {
+        return std::make_unique<RedoLog>(RedoLog::Options{
+            .path = kRedoLogPath,
+            .sync = options.redoSync,
+            .syncInterval = std::chrono::milliseconds(options.redoSyncMs),
+        });
+    }
+    catch (const std::exception& e)
     {
-        const std::string clearSql = "DELETE FROM " + m_tableName;
-        SQLite::Statement clearStmt(m_db, clearSql.c_str());
-        clearStmt.exec();
+        LogError("LuaDB redo log unavailable, SetG/DelG are durable only after the next flush: %s", e.what());
+        return nullptr;
     }
+}
 
-private:
-    SQLite::Database& m_db;
-    std::string m_tableName;
-};
+std::unique_ptr<PersistenceWriter> CreateWriter()
+{
+    return std::make_unique<PersistenceWriter>(
+        WithChangeStream(CreateEngine()),
+        std::chrono::milliseconds(GetLuaDBOptions().checkpointIdleMs));
+}
 
 const char* ScriptAnyTypeName(const ScriptAnyType type)
 {
@@ -215,170 +332,450 @@ std::string formatValue(const ScriptValue& value)
     }
 }
 
-ScriptValue parseValue(const int type, const std::string& value)
+static_assert(StoreValueType::kBool == ANY_TBOOLEAN
+              && StoreValueType::kNumber == ANY_TNUMBER
+              && StoreValueType::kString == ANY_TSTRING);
+
+// 调用方保证 value 是 bool、number 或 string（IsSupportedRawLuaDBValue）
+ScriptValue FromAnyValue(const ScriptAnyValue& value)
 {
-    try
+    switch (value.type)
     {
-        switch (type)
-        {
-        case ANY_TBOOLEAN:
-            return ScriptValue(std::stoi(value) != 0);
-        case ANY_TNUMBER:
-            return ScriptValue(std::stof(value));
-        case ANY_TSTRING:
-            return ScriptValue(value);
-        default:
-            return {};
-        }
+    case ANY_TBOOLEAN: return ScriptValue(value.b);
+    case ANY_TNUMBER: return ScriptValue(value.number);
+    case ANY_TSTRING: return ScriptValue(value.str ? value.str : "");
+    default: return {};
     }
-    catch (...)
+}
+
+ScriptAnyValue ToAnyValue(const ScriptValue& value)
+{
+    switch (value.type())
     {
-        LogWarn("Failed to parse value: %s", value.c_str());
-        return {};
+    case ScriptValue::Type::BOOL: return {value.as_bool()};
+    case ScriptValue::Type::NUMBER: return {value.as_number()};
+    case ScriptValue::Type::STRING: return {value.as_string().c_str()};
+    default: return {};
     }
 }
 
-std::string serializeValue(const ScriptValue& any)
+// 视图中的字符串以 NUL 结尾，可以直接作为 C 字符串传递
+ScriptAnyValue ToAnyValue(const ScriptValueView& value)
 {
-    switch (any.type())
+    switch (value.type)
     {
-    case ScriptValue::Type::BOOL:
-        return any.as_bool() ? "1" : "0";
-    case ScriptValue::Type::NUMBER:
-        return std::to_string(any.as_number());
-    case ScriptValue::Type::STRING:
-        return any.as_string();
-    default:
-        return "";
+    case ScriptValue::Type::BOOL: return {value.boolean};
+    case ScriptValue::Type::NUMBER: return {value.number};
+    case ScriptValue::Type::STRING: return {value.string.data()};
+    default: return {};
+    }
+}
+
+void LoadScope(StorageEngine& engine, std::unordered_map<std::string, ScriptValue>& cache, const std::string& savefile)
+{
+    engine.LoadScope(savefile, cache);
+    LogInfo("Loaded %zu entries from %s", cache.size(), savefile.empty() ? "[Global]" : savefile.c_str());
+}
+
+// Maps the snapshot slot taken at the engine's current global version and sets slot to
+// its index; null when snapshots are disabled or none is current.
+std::unique_ptr<GlobalSnapshot> OpenGlobalSnapshot(const std::int64_t version, int& slot)
+{
+    if (GetLuaDBOptions().globalSnapshotSec == 0 || version == 0)
+    {
+        return nullptr;
+    }
+    std::string reasons;
+    for (int i = 0; i < static_cast<int>(std::size(kGlobalSnapshotPaths)); ++i)
+    {
+        std::string reason;
+        if (auto snapshot = GlobalSnapshot::Open(kGlobalSnapshotPaths[i], version, reason))
+        {
+            LogInfo("Mapped %zu global entries from %s (%zu bytes, version %lld).",
+                    snapshot->size(),
+                    kGlobalSnapshotPaths[i],
+                    snapshot->bytes(),
+                    static_cast<long long>(version));
+            slot = i;
+            return snapshot;
+        }
+        reasons += (reasons.empty() ? "" : ", ") + std::string(kGlobalSnapshotPaths[i]) + ": " + reason;
     }
+    LogInfo("Global snapshot not used (%s); loading global data from storage.", reasons.c_str());
+    return nullptr;
 }
 
-int BatchOperation(SQLite::Database& db, const std::unordered_map<std::string, ScriptValue>& cache,
-                   const std::string& savefile)
+LuaDB::~LuaDB()
 {
-    static constexpr auto UPSERT_SQL = R"sql(
-        INSERT INTO Store (key, savefile, type, value, updated_at)
-        VALUES (?, ?, ?, ?, CURRENT_TIMESTAMP)
-        ON CONFLICT DO UPDATE SET
-            type = excluded.type,
-            value = excluded.value,
-            updated_at = excluded.updated_at
-    )sql";
+    LogDebug("LuaDB destructor called");
+    if (m_initThread.joinable())
+    {
+        m_initThread.join();
+    }
+    m_saveCollector.reset();
+    // 排队中的全局写入任务会使用重做日志
+    m_writer.reset();
+    m_redoLog.reset();
+}
 
-    SQLite::Statement stmt(db, UPSERT_SQL);
-    int count = 0;
+// Database.cpp 优化版本
+LuaDB::LuaDB() :
+    m_cacheBudget(std::size_t{GetLuaDBOptions().cacheBudgetMB} << 20),
+    m_saveLru(GetLuaDBOptions().saveLruSize, kSaveLruMaxBytes),
+    m_lastSaveTime(std::chrono::steady_clock::now())
+{
+    // 数据库打开、迁移和缓存加载在后台进行，不占用游戏启动时间
+    m_initThread = std::thread(&LuaDB::InitializeStorage, this);
+}
 
-    for (auto it = cache.begin(); it != cache.end();)
+void LuaDB::InitializeStorage()
+{
+    const auto start = std::chrono::steady_clock::now();
+    try
     {
-        constexpr size_t BATCH_SIZE = 100;
-        SQLite::Transaction transaction(db);
+        // 先于数据库打开重做日志，初始化期间的 SetG/DelG 同样写入日志
+        if (auto redoLog = CreateRedoLog())
+        {
+            std::lock_guard lock(m_mutex);
+            m_redoLog = std::move(redoLog);
+        }
+        auto writer = CreateWriter();
+        std::unique_ptr<GlobalSnapshot> snapshot;
+        int snapshotSlot = -1;
+        bool snapshotSupported = false;
+        writer->Run([&](StorageEngine& engine)
+        {
+            // 快照与存储引擎版本一致时直接映射，省去逐行读取；
+            // 否则各命名空间在首次使用时才从存储引擎读取
+            const std::int64_t version = engine.GlobalVersion();
+            snapshotSupported = version != 0;
+            snapshot = OpenGlobalSnapshot(version, snapshotSlot);
+        });
 
-        for (size_t batchCount = 0; it != cache.end() && batchCount < BATCH_SIZE; ++it, ++batchCount)
+        std::lock_guard lock(m_mutex);
+        m_writer = std::move(writer);
+        // 初始化期间的 SetG/DelG 优先于数据库中的旧值
+        if (snapshot)
         {
-            const auto& [k, v] = *it;
-            try
-            {
-                stmt.bind(1, k);
-                stmt.bind(2, savefile);
-                stmt.bind(3, v.anyType());
-                stmt.bind(4, serializeValue(v));
-                stmt.exec();
-                stmt.reset();
-                ++count;
-            }
-            catch (const std::exception& e)
-            {
-                LogError("Failed to batch insert for %s: %s", k.c_str(), e.what());
-            }
+            m_globalCache.LoadSnapshot(std::move(snapshot));
+            m_lastGlobalSnapshotTime = std::chrono::steady_clock::now();
+        }
+        else
+        {
+            // 快照缺失或过期时不受最小间隔限制，全局数据平静后即重写
+            m_globalSnapshotStale = snapshotSupported;
+        }
+        m_globalSnapshotSlot = snapshotSlot == 0 ? 1 : 0;
+        // 上次退出前尚未写入存储引擎的 SetG/DelG；初始化期间追加的调用已是脏键，重放时跳过
+        if (m_redoLog)
+        {
+            ReplayRedoLogLocked(*m_redoLog);
+        }
+        m_initState = InitState::Ready;
+
+        // 初始化期间 DB.Create 的命名空间在后台读取
+        std::vector<std::string> preload;
+        std::copy_if(m_activeNamespaces.begin(), m_activeNamespaces.end(), std::back_inserter(preload), [this](const std::string& prefix)
+        {
+            return !m_globalCache.IsLoaded(prefix) && !m_pendingGlobalLoads.contains(prefix);
+        });
+        if (!preload.empty())
+        {
+            QueueNamespaceLoadLocked(std::move(preload), true);
+        }
+
+        // 预热最近更新的存档，玩家通常会继续最近的进度
+        PrefetchSaveLocked({}, "startup");
+
+        // 清理磁盘上已不存在的存档留下的数据
+        if (const auto& options = GetLuaDBOptions(); options.saveGcMode != SaveGcMode::Off && !options.saveDir.empty())
+        {
+            m_saveCollector = std::make_unique<SaveCollector>(
+                *m_writer,
+                SaveCollector::Options{options.saveDir, options.saveGcMode == SaveGcMode::DryRun});
+            m_saveCollector->Start({});
         }
-        transaction.commit();
+        LogInfo("LuaDB storage ready in %lld ms: %zu global entries in %zu namespaces%s.",
+                static_cast<long long>(std::chrono::duration_cast<std::chrono::milliseconds>(
+                    std::chrono::steady_clock::now() - start).count()),
+                m_globalCache.size(),
+                m_globalCache.namespaceCount(),
+                m_globalCache.snapshot() ? " (mapped)" : ", the others load on first use");
+    }
+    catch (const std::exception& e)
+    {
+        LogError("LuaDB storage initialization failed, data will not be persisted: %s", e.what());
+        std::lock_guard lock(m_mutex);
+        m_initState = InitState::Failed;
+    }
+    m_initChanged.notify_all();
+}
+
+bool LuaDB::WaitForStorageLocked(std::unique_lock<std::mutex>& lock, const char* reason)
+{
+    if (m_initState == InitState::Pending)
+    {
+        const auto waitStart = std::chrono::steady_clock::now();
+        m_initChanged.wait(lock, [this] { return m_initState != InitState::Pending; });
+        LogInfo("%s waited %lld ms for LuaDB storage initialization.",
+                reason,
+                static_cast<long long>(std::chrono::duration_cast<std::chrono::milliseconds>(
+                    std::chrono::steady_clock::now() - waitStart).count()));
+    }
+    return m_initState == InitState::Ready;
+}
+
+void LuaDB::OnSavegameFileLoadedInMemory(const char* pLevelName)
+{
+    // 存档数据已读入内存，OnLoadGame 即将到来；回调只提供关卡名，因此预取最近更新的存档
+    std::lock_guard lock(m_mutex);
+    if (!StorageReadyLocked())
+    {
+        return;
+    }
+    if (m_savePrefetch && m_savePrefetch->namespaces == m_activeNamespaces)
+    {
+        LogDebug("Savegame for level %s loaded in memory; save prefetch already pending.", pLevelName ? pLevelName : "<unknown>");
+        return;
     }
-    return count;
+    PrefetchSaveLocked({}, "savegame in memory");
 }
 
-void CheckAndVacuum(SQLite::Database& db)
+void LuaDB::PrefetchSaveLocked(const std::string& savefile, const char* reason)
 {
-    bool shouldVacuum = false;
-    // 查询最后执行时间
+    auto prefetch = std::make_shared<SavePrefetch>();
+    prefetch->savefile = savefile;
+    // 只读取本次会话用到的命名空间，已卸载模组的数据留在存储中
+    prefetch->namespaces = m_activeNamespaces;
+    m_savePrefetch = prefetch;
+    m_savePrefetchTicket = ExecuteTransaction("Save prefetch", [prefetch, reason, keepPristine = m_saveLru.enabled()](StorageEngine& engine)
     {
-        if (SQLite::Statement query(db, "SELECT value FROM Meta WHERE key = 'last_vacuum_time'"); query.executeStep())
+        if (prefetch->savefile.empty())
         {
-            time_t lastVacuumTime = 0;
-            const std::string valueStr = query.getColumn(0).getString();
-            lastVacuumTime = std::stol(valueStr);
-            if (const time_t now_t = std::chrono::system_clock::to_time_t(std::chrono::system_clock::now());
-                now_t - lastVacuumTime > 7 * 24 * 3600)
+            prefetch->savefile = engine.LatestSave();
+            if (prefetch->savefile.empty())
             {
-                shouldVacuum = true;
+                LogDebug("Save prefetch (%s) skipped: no save data stored.", reason);
+                return;
             }
         }
-        else
+        if (!prefetch->namespaces.empty())
+        {
+            engine.LoadNamespaces(prefetch->savefile,
+                                  {prefetch->namespaces.begin(), prefetch->namespaces.end()},
+                                  prefetch->cache);
+        }
+        if (keepPristine)
         {
-            shouldVacuum = true; // 无记录时触发第一次VACUUM
+            prefetch->pristine = std::make_shared<const Cache>(prefetch->cache);
         }
+        prefetch->ready = true;
+        LogDebug("Save prefetch (%s) ready: %s, %zu entries in %zu namespaces",
+                 reason,
+                 prefetch->savefile.c_str(),
+                 prefetch->cache.size(),
+                 prefetch->namespaces.size());
+    });
+}
+
+bool LuaDB::TakeSavePrefetchLocked(const std::string& savefile)
+{
+    const std::shared_ptr<SavePrefetch> prefetch = std::exchange(m_savePrefetch, nullptr);
+    if (!prefetch)
+    {
+        LogInfo("Save prefetch miss for %s: nothing prefetched.", savefile.c_str());
+        return false;
     }
 
-    // 执行优化逻辑
-    if (shouldVacuum)
+    // 预取任务可能仍在持久化线程上执行，等待它完成
+    const auto waitStart = std::chrono::steady_clock::now();
+    m_writer->Wait(m_savePrefetchTicket);
+    const auto waitedUs = std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now() - waitStart).count();
+    if (!prefetch->ready || prefetch->savefile != savefile)
     {
-        try
-        {
-            // VACUUM命令不能在事务中执行
-            db.exec("VACUUM");
-            // 更新执行时间戳
-            const time_t now_t = std::chrono::system_clock::to_time_t(std::chrono::system_clock::now());
-            SQLite::Statement update(db,
-                                     "INSERT OR REPLACE INTO Meta (key, value) VALUES ('last_vacuum_time', ?)");
-            update.bind(1, std::to_string(now_t));
-            update.exec();
-        }
-        catch (const std::exception& e)
+        LogInfo("Save prefetch miss for %s: prefetched %s.",
+                savefile.c_str(),
+                prefetch->ready ? prefetch->savefile.c_str() : "nothing");
+        return false;
+    }
+
+    m_saveCache = std::move(prefetch->cache);
+    m_saveNamespaces = prefetch->namespaces;
+    m_saveLru.Put(savefile, {
+        .values = std::move(prefetch->pristine),
+        .writeTicket = 0,
+        .written = nullptr,
+        .namespaces = std::make_shared<const NamespaceSet>(std::move(prefetch->namespaces)),
+    });
+    LogInfo("Save prefetch hit for %s: %zu entries, waited %lld us.",
+            savefile.c_str(),
+            m_saveCache.size(),
+            static_cast<long long>(waitedUs));
+    return true;
+}
+
+bool LuaDB::TakeCachedSaveLocked(const std::string& savefile)
+{
+    const SaveCacheLru::Entry* entry = m_saveLru.Find(savefile);
+    if (!entry)
+    {
+        return false;
+    }
+    if (entry->written && !*entry->written)
+    {
+        // 写入该存档的任务可能仍在排队；写入失败时以存储引擎中的数据为准
+        m_writer->Wait(entry->writeTicket);
+        if (!*entry->written)
         {
-            LogError("VACUUM failed: %s", e.what());
+            LogWarn("Recent save cache for %s dropped: the save was not stored.", savefile.c_str());
+            m_saveLru.Erase(savefile);
+            return false;
         }
     }
+    // 缓存中保存的是存储时的状态，复制一份供本次游戏修改
+    const auto start = std::chrono::steady_clock::now();
+    m_saveCache = *entry->values;
+    m_saveNamespaces.reset();
+    if (entry->namespaces)
+    {
+        m_saveNamespaces = *entry->namespaces;
+    }
+    LogInfo("Recent save cache hit for %s: %zu entries copied in %lld us (%zu saves, %zu KB cached).",
+            savefile.c_str(),
+            m_saveCache.size(),
+            static_cast<long long>(std::chrono::duration_cast<std::chrono::microseconds>(
+                std::chrono::steady_clock::now() - start).count()),
+            m_saveLru.size(),
+            m_saveLru.bytes() >> 10);
+    return true;
 }
 
-LuaDB::~LuaDB()
+void LuaDB::AdjustSaveBytesLocked(const std::string_view key, const std::size_t added, const std::size_t removed)
 {
-    LogDebug("LuaDB destructor called");
+    std::size_t& bytes = m_saveNamespaceBytes[std::string(key.substr(0, NamespacePrefixLength(key)))];
+    bytes = bytes + added - removed;
+    m_saveBytes = m_saveBytes + added - removed;
 }
 
-// Database.cpp 优化版本
-LuaDB::LuaDB() :
-    m_db(OpenDatabase()),
-    m_lastSaveTime(std::chrono::steady_clock::now())
+void LuaDB::ResetSaveTrackingLocked()
 {
-    LogDatabaseList(*m_db);
-
-    ExecuteTransaction([](SQLite::Database& db)
-    {
-        db.exec(R"(
-            CREATE TABLE IF NOT EXISTS Store (
-                key TEXT NOT NULL,
-                savefile TEXT,
-                type INTEGER,
-                value TEXT,
-                created_at INTEGER DEFAULT CURRENT_TIMESTAMP,
-                updated_at INTEGER DEFAULT CURRENT_TIMESTAMP,
-                UNIQUE (key, savefile)
-            )
-        )");
-        db.exec("CREATE INDEX IF NOT EXISTS idx_store_savefile ON Store(savefile)");
-        db.exec(R"(
-            CREATE TABLE IF NOT EXISTS Meta (
-                key TEXT PRIMARY KEY,
-                value TEXT
-            )
-        )");
-    });
-    LogDebug("LuaDB schema initialization completed.");
-    LogDatabaseFileDiagnostics("schema initialization");
+    m_saveNamespaceBytes.clear();
+    m_saveBytes = 0;
+    for (const auto& [k, v] : m_saveCache)
+    {
+        AdjustSaveBytesLocked(k, EstimateEntryBytes(k, v), 0);
+    }
+    // 读档后缓存与存储一致；上一个存档的访问记录不再适用
+    m_dirtySaveNamespaces.clear();
+    m_lastSaveWritten.reset();
+    m_cacheBudget.ResetScope(CacheBudget::Scope::Save);
+}
+
+void LuaDB::EnforceCacheBudgetLocked()
+{
+    using namespace std::chrono;
+    const auto now = steady_clock::now();
+    if (!m_cacheBudget.enabled() || now - m_lastBudgetCheck < seconds(1))
+    {
+        return;
+    }
+    m_lastBudgetCheck = now;
+    const std::size_t resident = m_globalCache.bytes() + m_saveBytes;
+    if (resident <= m_cacheBudget.maxBytes())
+    {
+        return;
+    }
+
+    // 只驱逐与存储一致的命名空间，下次使用时重新读取即可恢复
+    std::vector<CacheBudget::Candidate> candidates;
+    // 准备中或排队中的全局写入已从缓存取走变更但尚未写入存储；写入失败的键重新标记之前缓存中有存储缺少的数据
+    bool failedKeys = false;
+    {
+        std::lock_guard failedLock(m_failedGlobalKeys->mutex);
+        failedKeys = !m_failedGlobalKeys->keys.empty();
+    }
+    if (!m_globalFlush && m_writer->Finished(m_lastGlobalFlushTicket) && !failedKeys)
+    {
+        m_globalCache.ForEachNamespace([&candidates](const std::string_view prefix, const std::size_t bytes, const bool clean)
+        {
+            if (clean)
+            {
+                candidates.push_back({CacheBudget::Scope::Global, std::string(prefix), bytes});
+            }
+        });
+    }
+    if (!m_saveCacheFileName.empty() && (!m_lastSaveWritten || *m_lastSaveWritten))
+    {
+        for (const auto& [prefix, bytes] : m_saveNamespaceBytes)
+        {
+            if (bytes > 0 && !m_dirtySaveNamespaces.contains(prefix))
+            {
+                candidates.push_back({CacheBudget::Scope::Save, prefix, bytes});
+            }
+        }
+    }
+    const std::vector<CacheBudget::Candidate> victims = m_cacheBudget.PickVictims(resident, std::move(candidates), now);
+    if (victims.empty())
+    {
+        return;
+    }
 
-    SyncCacheWithDatabase();
+    std::size_t freed = 0;
+    std::vector<std::string> savePrefixes;
+    for (const auto& victim : victims)
+    {
+        if (victim.scope == CacheBudget::Scope::Global)
+        {
+            freed += m_globalCache.Evict(victim.prefix);
+        }
+        else
+        {
+            savePrefixes.push_back(victim.prefix);
+            freed += victim.bytes;
+        }
+    }
+    EvictSaveNamespacesLocked(savePrefixes);
+    const CacheBudget::Stats& stats = m_cacheBudget.stats();
+    LogInfo("Cache over budget: evicted %zu namespace(s), %zu KB; %zu KB of %zu KB resident, hit rate %.1f%%.",
+            victims.size(),
+            freed >> 10,
+            (m_globalCache.bytes() + m_saveBytes) >> 10,
+            m_cacheBudget.maxBytes() >> 10,
+            stats.hitRate() * 100.0);
+}
 
-    CheckAndVacuum(*m_db);
-    LogDebug("LuaDB vacuum check completed");
+void LuaDB::EvictSaveNamespacesLocked(const std::vector<std::string>& prefixes)
+{
+    if (prefixes.empty())
+    {
+        return;
+    }
+    if (!m_saveNamespaces)
+    {
+        // 缓存持有整个存档时改为逐个命名空间跟踪，被驱逐的命名空间保存时从存储复制
+        NamespaceSet loaded;
+        for (const auto& [prefix, bytes] : m_saveNamespaceBytes)
+        {
+            loaded.insert(prefix);
+        }
+        loaded.insert(m_dirtySaveNamespaces.begin(), m_dirtySaveNamespaces.end());
+        m_saveNamespaces = std::move(loaded);
+    }
+    std::erase_if(m_saveCache, [&prefixes](const auto& entry)
+    {
+        const std::string_view prefix = std::string_view(entry.first).substr(0, NamespacePrefixLength(entry.first));
+        return std::find(prefixes.begin(), prefixes.end(), prefix) != prefixes.end();
+    });
+    for (const auto& prefix : prefixes)
+    {
+        if (const auto it = m_saveNamespaceBytes.find(prefix); it != m_saveNamespaceBytes.end())
+        {
+            m_saveBytes -= it->second;
+            m_saveNamespaceBytes.erase(it);
+        }
+        m_saveNamespaces->erase(prefix);
+    }
 }
 
 bool LuaDB::isRegistered() const
@@ -412,7 +809,7 @@ void LuaDB::RegisterLuaAPI()
     LogDebug("Registered LuaDB method Del");
     SCRIPT_REG_TEMPLFUNC(Exi, "key");
     LogDebug("Registered LuaDB method Exi");
-    SCRIPT_REG_TEMPLFUNC(All, "");
+    SCRIPT_REG_TEMPLFUNC(All, "[prefix]");
     LogDebug("Registered LuaDB method All");
 
     // 全局数据方法（跨存档）
@@ -424,12 +821,20 @@ void LuaDB::RegisterLuaAPI()
     LogDebug("Registered LuaDB method DelG");
     SCRIPT_REG_TEMPLFUNC(ExiG, "key");
     LogDebug("Registered LuaDB method ExiG");
-    SCRIPT_REG_TEMPLFUNC(AllG, "");
+    SCRIPT_REG_TEMPLFUNC(AllG, "[prefix]");
     LogDebug("Registered LuaDB method AllG");
+    SCRIPT_REG_TEMPLFUNC(Prefetch, "[prefix]");
+    LogDebug("Registered LuaDB method Prefetch");
+    SCRIPT_REG_TEMPLFUNC(PrefetchG, "[prefix]");
+    LogDebug("Registered LuaDB method PrefetchG");
+    SCRIPT_REG_TEMPLFUNC(Preload, "prefix");
+    LogDebug("Registered LuaDB method Preload");
 
     // 工具方法
     SCRIPT_REG_TEMPLFUNC(Dump, "");
     LogDebug("Registered LuaDB method Dump");
+    SCRIPT_REG_TEMPLFUNC(CacheStats, "");
+    LogDebug("Registered LuaDB method CacheStats");
 
     if (m_pSS->ExecuteBuffer(db_lua, strlen(db_lua), "db.lua"))
     {
@@ -446,76 +851,336 @@ void LuaDB::RegisterLuaAPI()
     LogInfo("LuaDB loading completed.");
 }
 
-void LuaDB::SyncCacheWithDatabase()
+void LuaDB::LoadSaveCacheLocked()
 {
-    std::lock_guard lock(m_mutex);
-    SyncCacheWithDatabaseLocked();
+    // Loads are queued behind earlier saves, so a save is always readable by the load that
+    // follows it. The global cache is authoritative and is never reloaded: storage only
+    // holds what it flushed.
+    m_saveCache.clear();
+    m_saveNamespaces.reset();
+    if (m_saveCacheFileName.empty())
+    {
+        return;
+    }
+    m_saveNamespaces.emplace();
+    LoadSaveNamespacesLocked({m_activeNamespaces.begin(), m_activeNamespaces.end()});
+    if (m_saveLru.enabled())
+    {
+        m_saveLru.Put(m_saveCacheFileName, {
+            .values = std::make_shared<const Cache>(m_saveCache),
+            .writeTicket = 0,
+            .written = nullptr,
+            .namespaces = std::make_shared<const NamespaceSet>(*m_saveNamespaces),
+        });
+    }
 }
 
-void LuaDB::SyncCacheWithDatabaseLocked()
+void LuaDB::UseNamespaceLocked(const std::string_view key, const bool isGlobal)
 {
-    auto LoadCache = [&](auto& cache, const std::string& savefile)
+    const std::string prefix(key.substr(0, NamespacePrefixLength(key)));
+    m_activeNamespaces.insert(prefix);
+    const bool loaded = isGlobal ? m_globalCache.IsLoaded(prefix) : !m_saveNamespaces || m_saveNamespaces->contains(prefix);
+    m_cacheBudget.RecordAccess(isGlobal ? CacheBudget::Scope::Global : CacheBudget::Scope::Save,
+                               prefix,
+                               loaded,
+                               std::chrono::steady_clock::now());
+    if (loaded)
     {
-        static constexpr auto SELECT_SQL = R"(
-            SELECT key, type, value FROM Store
-            WHERE savefile = ? ORDER BY rowid
-        )";
-
-        SQLite::Statement stmt(*m_db, SELECT_SQL);
-        stmt.bind(1, savefile);
-
-        while (stmt.executeStep())
-        {
-            SQLite::Column keyCol = stmt.getColumn(0);
-            SQLite::Column typeCol = stmt.getColumn(1);
-            SQLite::Column valueCol = stmt.getColumn(2);
-            cache.emplace(
-                keyCol.getString(),
-                parseValue(typeCol.getInt(), valueCol.getString())
-            );
-        }
-        LogInfo("Loaded %zu entries from %s", cache.size(), savefile.empty() ? "[Global]" : savefile.c_str());
-    };
-
-    m_globalCache.clear();
-    LoadCache(m_globalCache, "");
-    if (!m_saveCacheFileName.empty())
+        return;
+    }
+    if (isGlobal)
+    {
+        LoadGlobalNamespacesLocked({prefix});
+    }
+    else
     {
-        m_saveCache.clear();
-        LoadCache(m_saveCache, m_saveCacheFileName);
+        LoadSaveNamespacesLocked({prefix});
     }
 }
 
-int LuaDB::GenericAccess(IFunctionHandler* pH, const AccessType action, const bool isGlobal)
+void LuaDB::UseNamespacesLocked(const std::string_view prefix, const bool isGlobal)
 {
-    constexpr auto ArgError = [](auto* handler) { return handler->EndFunction(false); };
-    constexpr auto ActionName = [](const AccessType action)
+    if (NamespacePrefixLength(prefix) > 0)
     {
-        switch (action)
-        {
-        case AccessType::Set: return "Set";
-        case AccessType::Get: return "Get";
-        case AccessType::Del: return "Del";
-        case AccessType::Exi: return "Exi";
-        case AccessType::All: return "All";
-        default: return "Unknown";
-        }
-    };
-
-    try
+        UseNamespaceLocked(prefix, isGlobal);
+    }
+    else if (isGlobal)
     {
-        const char* key = nullptr;
-        ScriptAnyValue value;
-        const char* funcName = pH->GetFuncName();
-        const DWORD threadId = GetCurrentThreadId();
+        LoadAllGlobalLocked();
+    }
+    else
+    {
+        LoadAllSaveLocked();
+    }
+}
 
-        if ((action != AccessType::All && !pH->GetParam(1, key)) || (action == AccessType::Set && !pH->
-            GetParamAny(2, value)))
-        {
-            LogWarn("LuaDB.%s invalid arguments on thread %lu: action=%s, scope=%s, key=%s, valueType=%s",
-                    funcName ? funcName : "<unknown>",
-                    threadId,
-                    ActionName(action),
+void LuaDB::LoadGlobalNamespacesLocked(const std::vector<std::string>& prefixes)
+{
+    std::vector<std::string> missing;
+    std::copy_if(prefixes.begin(), prefixes.end(), std::back_inserter(missing), [this](const std::string& prefix)
+    {
+        return !m_globalCache.IsLoaded(prefix);
+    });
+    if (missing.empty() || !m_writer)
+    {
+        return;
+    }
+    const auto start = std::chrono::steady_clock::now();
+    std::vector<std::string> unqueued;
+    std::copy_if(missing.begin(), missing.end(), std::back_inserter(unqueued), [this](const std::string& prefix)
+    {
+        return !m_pendingGlobalLoads.contains(prefix);
+    });
+    if (!unqueued.empty())
+    {
+        QueueNamespaceLoadLocked(std::move(unqueued), true);
+    }
+    AwaitNamespaceLoadsLocked(missing, true);
+    LogDebug("Loaded %zu global namespace(s) on first use, waited %lld us.",
+             missing.size(),
+             static_cast<long long>(std::chrono::duration_cast<std::chrono::microseconds>(
+                 std::chrono::steady_clock::now() - start).count()));
+}
+
+void LuaDB::LoadSaveNamespacesLocked(const std::vector<std::string>& prefixes)
+{
+    if (!m_saveNamespaces || !m_writer)
+    {
+        return;
+    }
+    std::vector<std::string> missing;
+    std::copy_if(prefixes.begin(), prefixes.end(), std::back_inserter(missing), [this](const std::string& prefix)
+    {
+        return !m_saveNamespaces->contains(prefix);
+    });
+    if (missing.empty())
+    {
+        return;
+    }
+    const auto start = std::chrono::steady_clock::now();
+    std::vector<std::string> unqueued;
+    std::copy_if(missing.begin(), missing.end(), std::back_inserter(unqueued), [this](const std::string& prefix)
+    {
+        return !m_pendingSaveLoads.contains(prefix);
+    });
+    if (!unqueued.empty())
+    {
+        QueueNamespaceLoadLocked(std::move(unqueued), false);
+    }
+    AwaitNamespaceLoadsLocked(missing, false);
+    LogDebug("Loaded %zu namespace(s) of %s on first use, waited %lld us.",
+             missing.size(),
+             m_saveCacheFileName.c_str(),
+             static_cast<long long>(std::chrono::duration_cast<std::chrono::microseconds>(
+                 std::chrono::steady_clock::now() - start).count()));
+}
+
+void LuaDB::QueueNamespaceLoadLocked(std::vector<std::string> prefixes, const bool isGlobal)
+{
+    auto load = std::make_shared<NamespaceLoad>();
+    load->prefixes = std::move(prefixes);
+    // 任务排在之前提交的存档写入之后，读到的是其后的状态
+    const std::string savefile = isGlobal ? std::string() : m_saveCacheFileName;
+    const std::uint64_t ticket = ExecuteTransaction("Namespace load", [load, savefile](StorageEngine& engine)
+    {
+        engine.LoadNamespaces(savefile, load->prefixes, load->entries);
+        load->done = true;
+        LogDebug("Read %zu entries of %zu namespace(s) from %s.",
+                 load->entries.size(),
+                 load->prefixes.size(),
+                 savefile.empty() ? "[Global]" : savefile.c_str());
+    });
+    auto& pending = isGlobal ? m_pendingGlobalLoads : m_pendingSaveLoads;
+    for (const auto& prefix : load->prefixes)
+    {
+        pending.insert_or_assign(prefix, PendingLoad{ticket, load});
+    }
+}
+
+void LuaDB::AwaitNamespaceLoadsLocked(const std::vector<std::string>& prefixes, const bool isGlobal)
+{
+    auto& pending = isGlobal ? m_pendingGlobalLoads : m_pendingSaveLoads;
+    std::uint64_t ticket = 0;
+    std::vector<std::shared_ptr<NamespaceLoad>> loads;
+    for (const auto& prefix : prefixes)
+    {
+        if (const auto it = pending.find(prefix); it != pending.end())
+        {
+            ticket = std::max(ticket, it->second.ticket);
+            if (std::find(loads.begin(), loads.end(), it->second.load) == loads.end())
+            {
+                loads.push_back(it->second.load);
+            }
+        }
+    }
+    if (loads.empty())
+    {
+        return;
+    }
+    // 只等待读取这些命名空间的任务，不等待之后排队的写入
+    m_writer->Wait(ticket);
+
+    for (const auto& load : loads)
+    {
+        // 同一任务读取的其他命名空间也一并加入缓存
+        std::vector<std::string> loaded;
+        for (const auto& prefix : load->prefixes)
+        {
+            const auto it = pending.find(prefix);
+            if (it == pending.end() || it->second.load != load)
+            {
+                continue;
+            }
+            pending.erase(it);
+            const bool cached = isGlobal ? m_globalCache.IsLoaded(prefix) : !m_saveNamespaces || m_saveNamespaces->contains(prefix);
+            if (load->done && !cached)
+            {
+                loaded.push_back(prefix);
+            }
+        }
+        if (loaded.empty())
+        {
+            continue;
+        }
+        // 缓存中已有的键由 LoadNamespaces 跳过；任务读取后被 DelG 删除的键不能恢复
+        Cache entries;
+        for (auto& [k, v] : load->entries)
+        {
+            const std::string_view prefix = std::string_view(k).substr(0, NamespacePrefixLength(k));
+            if (std::find(loaded.begin(), loaded.end(), prefix) != loaded.end() && !load->deletedKeys.contains(k))
+            {
+                entries.emplace(k, std::move(v));
+            }
+        }
+        if (isGlobal)
+        {
+            m_globalCache.LoadNamespaces(std::move(entries), loaded);
+            continue;
+        }
+        // 命名空间加载前不会有键被写入，保险起见仍以缓存中的值为准
+        for (const auto& [k, v] : entries)
+        {
+            if (!m_saveCache.contains(k))
+            {
+                AdjustSaveBytesLocked(k, EstimateEntryBytes(k, v), 0);
+            }
+        }
+        m_saveCache.merge(entries);
+        m_saveNamespaces->insert(loaded.begin(), loaded.end());
+    }
+}
+
+void LuaDB::LoadAllGlobalLocked()
+{
+    if (m_globalCache.IsFullyLoaded() || !m_writer)
+    {
+        return;
+    }
+    auto loaded = std::make_shared<Cache>();
+    m_writer->Wait(ExecuteTransaction("Global load", [loaded](StorageEngine& engine)
+    {
+        LoadScope(engine, *loaded, "");
+    }));
+    m_globalCache.LoadAll(std::move(*loaded));
+    // 排队中的命名空间读取不再需要
+    m_pendingGlobalLoads.clear();
+}
+
+void LuaDB::LoadAllSaveLocked()
+{
+    if (!m_saveNamespaces || !m_writer)
+    {
+        return;
+    }
+    auto loaded = std::make_shared<Cache>();
+    m_writer->Wait(ExecuteTransaction("Save load", [loaded, savefile = m_saveCacheFileName](StorageEngine& engine)
+    {
+        LoadScope(engine, *loaded, savefile);
+    }));
+    // 已加载的命名空间以缓存为准，其中被删除的键不能恢复
+    for (auto& [k, v] : *loaded)
+    {
+        if (!m_saveNamespaces->contains(k.substr(0, NamespacePrefixLength(k))))
+        {
+            const std::size_t bytes = EstimateEntryBytes(k, v);
+            if (m_saveCache.emplace(k, std::move(v)).second)
+            {
+                AdjustSaveBytesLocked(k, bytes, 0);
+            }
+        }
+    }
+    m_saveNamespaces.reset();
+    m_pendingSaveLoads.clear();
+}
+
+void LuaDB::ReplayRedoLogLocked(RedoLog& redoLog)
+{
+    // 同一个键只保留最后一次调用
+    std::unordered_map<std::string, std::optional<ScriptValue>> replayed;
+    redoLog.Replay([&](const std::string& key, const ScriptValue* value)
+    {
+        replayed.insert_or_assign(key, value ? std::optional(*value) : std::nullopt);
+    });
+    // 删除需要知道键是否存在，先一次读取涉及的命名空间
+    std::unordered_set<std::string> prefixes;
+    for (const auto& [k, v] : replayed)
+    {
+        prefixes.emplace(k.substr(0, NamespacePrefixLength(k)));
+    }
+    m_activeNamespaces.insert(prefixes.begin(), prefixes.end());
+    LoadGlobalNamespacesLocked({prefixes.begin(), prefixes.end()});
+    for (auto& [k, v] : replayed)
+    {
+        // 已是脏键的值比日志更新
+        if (m_globalCache.HasPendingChange(k))
+        {
+            continue;
+        }
+        if (v)
+        {
+            m_globalCache.Set(k, std::move(*v));
+        }
+        else
+        {
+            m_globalCache.Erase(k);
+        }
+    }
+}
+
+int LuaDB::GenericAccess(IFunctionHandler* pH, const AccessType action, const bool isGlobal)
+{
+    constexpr auto ArgError = [](auto* handler) { return handler->EndFunction(false); };
+    constexpr auto ActionName = [](const AccessType action)
+    {
+        switch (action)
+        {
+        case AccessType::Set: return "Set";
+        case AccessType::Get: return "Get";
+        case AccessType::Del: return "Del";
+        case AccessType::Exi: return "Exi";
+        case AccessType::All: return "All";
+        case AccessType::Prefetch: return "Prefetch";
+        default: return "Unknown";
+        }
+    };
+
+    try
+    {
+        const char* key = nullptr;
+        ScriptAnyValue value;
+        const char* funcName = pH->GetFuncName();
+        const DWORD threadId = GetCurrentThreadId();
+
+        // All/AllG 与 Prefetch/PrefetchG 的可选参数为键前缀，DB.Create 实例只取自己命名空间的键
+        const bool prefixAction = action == AccessType::All || action == AccessType::Prefetch;
+        if ((prefixAction && pH->GetParamCount() >= 1 && !pH->GetParam(1, key))
+            || (!prefixAction && !pH->GetParam(1, key))
+            || (action == AccessType::Set && !pH->GetParamAny(2, value)))
+        {
+            LogWarn("LuaDB.%s invalid arguments on thread %lu: action=%s, scope=%s, key=%s, valueType=%s",
+                    funcName ? funcName : "<unknown>",
+                    threadId,
+                    ActionName(action),
                     isGlobal ? "global" : "save",
                     key ? key : "<missing>",
                     action == AccessType::Set ? ScriptAnyTypeName(value.type) : "n/a");
@@ -544,48 +1209,178 @@ int LuaDB::GenericAccess(IFunctionHandler* pH, const AccessType action, const bo
                      action == AccessType::Set ? ScriptAnyTypeName(value.type) : "n/a");
         }
 
-        std::lock_guard lock(m_mutex);
-        auto& cache = isGlobal ? m_globalCache : m_saveCache;
+        std::unique_lock lock(m_mutex);
+        // SetG/DelG 在初始化期间只记入脏键；读取全局数据需要等待缓存加载完成
+        if (isGlobal && action != AccessType::Set && action != AccessType::Del)
+        {
+            WaitForStorageLocked(lock, funcName ? funcName : "LuaDB read");
+        }
 
         switch (action)
         {
         case AccessType::Set:
             {
-                const auto it = ScriptValue(value);
-                cache[key] = it;
+                // 全局值直接覆盖存储中的旧值，无需先加载；存档值写入前必须加载其命名空间，
+                // 否则保存时整个命名空间会被缓存中的内容替换
+                if (isGlobal)
+                {
+                    m_activeNamespaces.emplace(key, NamespacePrefixLength(key));
+                }
+                else
+                {
+                    UseNamespaceLocked(key, false);
+                }
+                const auto it = FromAnyValue(value);
                 LogDebug(isGlobal ? "Set Global %s = %s" : "Set %s = %s", key, formatValue(it).c_str());
                 if (isGlobal)
                 {
-                    m_globalDirty = true;
+                    m_globalCache.Set(key, it);
+                    if (m_redoLog)
+                    {
+                        m_redoLog->AppendSet(key, it);
+                    }
+                }
+                else
+                {
+                    const auto [slot, inserted] = m_saveCache.try_emplace(key);
+                    const std::size_t replaced = inserted ? 0 : EstimateEntryBytes(key, slot->second);
+                    slot->second = it;
+                    AdjustSaveBytesLocked(key, EstimateEntryBytes(key, it), replaced);
+                    m_dirtySaveNamespaces.emplace(key, NamespacePrefixLength(key));
                 }
                 return pH->EndFunction(true);
             }
         case AccessType::Get:
             {
-                const auto it = cache.find(key);
-                return it != cache.end() ? pH->EndFunction(it->second.toAnyValue()) : pH->EndFunction();
+                UseNamespaceLocked(key, isGlobal);
+                if (isGlobal)
+                {
+                    auto found = m_globalCache.Find(key);
+                    if (found && found->type == ScriptValue::Type::BLOB_REF)
+                    {
+                        ResolveBlobStubsLocked({{key, found->blob}}, true);
+                        found = m_globalCache.Find(key);
+                    }
+                    return found ? pH->EndFunction(ToAnyValue(*found)) : pH->EndFunction();
+                }
+                const auto it = m_saveCache.find(key);
+                if (it != m_saveCache.end() && it->second.is_blob_ref())
+                {
+                    ResolveBlobStubsLocked({{key, it->second.as_blob_ref()}}, false);
+                }
+                return it != m_saveCache.end() ? pH->EndFunction(ToAnyValue(it->second)) : pH->EndFunction();
             }
         case AccessType::Del:
             {
-                const bool erased = cache.erase(key) > 0;
+                if (!isGlobal)
+                {
+                    UseNamespaceLocked(key, false);
+                }
+                bool erased = false;
+                if (isGlobal)
+                {
+                    erased = m_globalCache.Erase(key);
+                }
+                else if (const auto it = m_saveCache.find(key); it != m_saveCache.end())
+                {
+                    AdjustSaveBytesLocked(key, 0, EstimateEntryBytes(key, it->second));
+                    m_saveCache.erase(it);
+                    m_dirtySaveNamespaces.emplace(key, NamespacePrefixLength(key));
+                    erased = true;
+                }
+                if (isGlobal && !erased)
+                {
+                    // 键可能尚未加载，等待初始化并加载其命名空间后才能得知是否存在
+                    WaitForStorageLocked(lock, funcName ? funcName : "LuaDB delete");
+                    UseNamespaceLocked(key, true);
+                    erased = m_globalCache.Erase(key);
+                }
                 LogDebug(isGlobal ? "Delete Global %s: %s" : "Delete %s: %s", key, erased ? "OK" : "Not found");
                 if (isGlobal && erased)
                 {
-                    m_globalDirty = true;
+                    if (const auto it = m_pendingGlobalLoads.find(std::string(key, NamespacePrefixLength(key))); it != m_pendingGlobalLoads.end())
+                    {
+                        it->second.load->deletedKeys.insert(key);
+                    }
+                    if (m_redoLog)
+                    {
+                        m_redoLog->AppendDelete(key);
+                    }
                 }
                 return pH->EndFunction(erased);
             }
         case AccessType::Exi:
-            return pH->EndFunction(cache.contains(key));
+            UseNamespaceLocked(key, isGlobal);
+            return pH->EndFunction(isGlobal ? m_globalCache.Contains(key) : m_saveCache.contains(key));
         case AccessType::All:
             {
+                const std::string_view prefix = key ? key : "";
+                UseNamespacesLocked(prefix, isGlobal);
+                // 一次读取范围内所有尚未加载的大值
+                if (const BlobStubs stubs = CollectBlobStubsLocked(prefix, isGlobal); !stubs.empty())
+                {
+                    ResolveBlobStubsLocked(stubs, isGlobal);
+                }
                 const auto table = m_pSS->CreateTable();
-                for (const auto& [k, v] : cache)
+                // 键以 NUL 结尾
+                const auto addEntry = [&table](const std::string_view k, const ScriptValueView& v)
                 {
-                    table->SetValue(k.c_str(), v.toAnyValue());
+                    table->SetValue(k.data(), ToAnyValue(v));
+                };
+                if (isGlobal)
+                {
+                    m_globalCache.ForEach(prefix, addEntry);
+                }
+                else
+                {
+                    for (const auto& [k, v] : m_saveCache)
+                    {
+                        if (k.starts_with(prefix))
+                        {
+                            addEntry(k, ScriptValueView::Of(v));
+                        }
+                    }
                 }
                 return pH->EndFunction(table);
             }
+        case AccessType::Prefetch:
+            {
+                BlobStubs stubs = CollectBlobStubsLocked(key ? key : "", isGlobal);
+                if (stubs.empty())
+                {
+                    return pH->EndFunction(0);
+                }
+                const int queued = static_cast<int>(stubs.size());
+                std::vector<std::int64_t> ids;
+                ids.reserve(stubs.size());
+                for (const auto& [k, ref] : stubs)
+                {
+                    ids.push_back(ref.id);
+                }
+                const std::uint64_t ticket = ExecuteTransaction("Value prefetch", [fetched = m_fetchedBlobs, stubs = std::move(stubs)](StorageEngine& engine)
+                {
+                    for (const auto& [k, ref] : stubs)
+                    {
+                        try
+                        {
+                            std::string value = engine.ReadBlob(ref);
+                            std::lock_guard fetchedLock(fetched->mutex);
+                            fetched->values.insert_or_assign(ref.id, std::move(value));
+                        }
+                        catch (const std::exception& e)
+                        {
+                            LogWarn("Prefetch of %s failed: %s", k.c_str(), e.what());
+                        }
+                    }
+                });
+                // 首次读取时只需等待这个任务
+                for (const auto id : ids)
+                {
+                    m_valuePrefetchTickets.insert_or_assign(id, ticket);
+                }
+                LogDebug(isGlobal ? "Prefetch Global %s: %d values queued" : "Prefetch %s: %d values queued", key ? key : "<all>", queued);
+                return pH->EndFunction(queued);
+            }
         }
     }
     catch (const std::exception& e)
@@ -613,9 +1408,30 @@ void LuaDB::OnLoadGame(ILoadGame* pLoadGame)
         const std::string loadFileName = fileName;
         LogInfo("Load Game on thread %lu: %s", GetCurrentThreadId(), loadFileName.c_str());
         // 记录当前本地缓存对应的存档文件名。
-        std::lock_guard lock(m_mutex);
+        std::unique_lock lock(m_mutex);
         m_saveCacheFileName = loadFileName;
-        SyncCacheWithDatabaseLocked();
+        // 排队中的读取针对上一个存档
+        m_pendingSaveLoads.clear();
+        if (!WaitForStorageLocked(lock, "Load game"))
+        {
+            m_saveCache.clear();
+            ResetSaveTrackingLocked();
+            return;
+        }
+        if (TakeCachedSaveLocked(loadFileName))
+        {
+            // 预取的数据不再需要
+            m_savePrefetch.reset();
+        }
+        else if (!TakeSavePrefetchLocked(loadFileName))
+        {
+            LoadSaveCacheLocked();
+        }
+        // 缓存或预取之后才开始使用的命名空间一次读取
+        LoadSaveNamespacesLocked({m_activeNamespaces.begin(), m_activeNamespaces.end()});
+        ResetSaveTrackingLocked();
+        // 加载画面期间写入较少，适合合并 WAL
+        m_writer->RequestMaintenance();
     }
     catch (const std::exception& e)
     {
@@ -639,42 +1455,46 @@ void LuaDB::OnSaveGame(ISaveGame* pSaveGame)
     const std::string newSave = fileName;
     LogInfo("Save Game on thread %lu: %s", GetCurrentThreadId(), newSave.c_str());
     // 将当前缓存作为完整快照写入，避免同名存档复用时残留旧键。
-    std::lock_guard lock(m_mutex);
-    try
+    // 游戏线程只复制快照，存储写入由持久化线程完成。
+    std::unique_lock lock(m_mutex);
+    if (!WaitForStorageLocked(lock, "Save game"))
     {
-        ExecuteTransaction([this, &newSave](SQLite::Database& db)
-        {
-            SQLite::Statement deleteStmt(db, "DELETE FROM Store WHERE savefile = ?");
-            deleteStmt.bind(1, newSave);
-            deleteStmt.exec();
-
-            if (m_saveCache.empty())
-            {
-                return;
-            }
-
-            SQLite::Statement stmt(db,
-                                   "INSERT INTO Store (key, savefile, type, value, updated_at) "
-                                   "VALUES (?, ?, ?, ?, CURRENT_TIMESTAMP)");
-            for (const auto& [k, v] : m_saveCache)
-            {
-                stmt.bind(1, k);
-                stmt.bind(2, newSave);
-                stmt.bind(3, v.anyType());
-                stmt.bind(4, serializeValue(v));
-                stmt.exec();
-                stmt.reset();
-            }
-        });
-        LogInfo("Data saved: %zu entries", m_saveCache.size());
+        m_saveCacheFileName = newSave;
+        return;
     }
-    catch (const std::exception& e)
+    // 新的存档写入后，之前预取的数据可能已过期
+    m_savePrefetch.reset();
+    auto snapshot = std::make_shared<const Cache>(m_saveCache);
+    auto written = std::make_shared<std::atomic<bool>>(false);
+    // 未加载的命名空间由存储引擎从当前存档逐行复制，不经过游戏线程
+    std::shared_ptr<const SaveCarryOver> carry;
+    std::shared_ptr<const NamespaceSet> namespaces;
+    if (m_saveNamespaces)
     {
-        LogError("Save data failed: %s", e.what());
+        carry = std::make_shared<const SaveCarryOver>(SaveCarryOver{m_saveCacheFileName, *m_saveNamespaces});
+        namespaces = std::make_shared<const NamespaceSet>(*m_saveNamespaces);
     }
-    catch (...)
+    const std::uint64_t ticket = ExecuteTransaction("Save data", [snapshot, newSave, written, carry](StorageEngine& engine)
+    {
+        if (carry)
+        {
+            engine.SnapshotSaveFrom(newSave, *snapshot, *carry);
+        }
+        else
+        {
+            engine.SnapshotSave(newSave, *snapshot);
+        }
+        written->store(true);
+    });
+    // 写入的快照同时作为该存档最近的缓存，死亡后重新读档时不必再读取存储引擎
+    // 写入完成前当前存档的命名空间不能被驱逐：存储中还没有它们
+    m_lastSaveWritten = written;
+    m_dirtySaveNamespaces.clear();
+    m_saveLru.Put(newSave, {snapshot, ticket, std::move(written), std::move(namespaces)});
+    if (m_saveCollector)
     {
-        LogError("Save data failed: Unknown error");
+        // 游戏可能在保存时轮换掉旧的自动存档
+        m_saveCollector->Start({newSave, m_saveCacheFileName}, kSaveCollectorInterval);
     }
     m_saveCacheFileName = newSave;
 }
@@ -687,128 +1507,567 @@ void LuaDB::OnPostUpdate(float /*fDeltaTime*/)
     LuaRunner::Instance().ExecuteQueuedScripts(gEnv ? gEnv->pScriptSystem : nullptr);
 
     std::lock_guard lock(m_mutex);
-    if (!m_globalDirty) return;
-    if (const auto now = steady_clock::now(); now - m_lastSaveTime < SAVE_INTERVAL) return;
+    if (!StorageReadyLocked()) return;
+    RetryFailedGlobalKeysLocked();
+    EnforceCacheBudgetLocked();
+    if (!m_globalFlush)
+    {
+        ScheduleGlobalSnapshotLocked();
+        if (!m_globalCache.HasChanges()) return;
+        if (const auto now = steady_clock::now(); now - m_lastSaveTime < SAVE_INTERVAL) return;
+        LogDebug("OnPostUpdate flushing global data on thread %lu.", GetCurrentThreadId());
+        BeginGlobalFlushLocked();
+    }
+    const std::uint32_t budgetUs = GetLuaDBOptions().flushBudgetUs;
+    ContinueGlobalFlushLocked(budgetUs == 0 ? microseconds::max() : microseconds(budgetUs));
+}
 
-    LogDebug("OnPostUpdate flushing global data on thread %lu.", GetCurrentThreadId());
-    try
+void LuaDB::BeginGlobalFlushLocked()
+{
+    auto flush = std::make_unique<GlobalFlush>();
+    flush->batch = std::make_shared<GlobalBatch>();
+    // 只取有变更的命名空间，其他模组的数据不参与本次写入
+    m_globalCache.TakeChanges(flush->namespaces);
+    flush->namespaceCount = flush->namespaces.size();
+    std::size_t upserts = 0;
+    std::size_t deletes = 0;
+    for (const auto& changes : flush->namespaces)
     {
-        int successCount = 0;
-        ExecuteTransaction([this, &successCount](SQLite::Database& db)
-        {
-            // 创建临时表来保存当前所有的键，并在作用域结束后自动释放
-            TempTableGuard tempKeys(db, "TempKeys", "(key TEXT PRIMARY KEY)");
-            tempKeys.Clear();
-            // 将当前缓存中的键插入临时表
-            SQLite::Statement insertTempStmt(db, "INSERT INTO TempKeys (key) VALUES (?)");
-            for (const auto& k : m_globalCache | std::views::keys)
-            {
-                insertTempStmt.bind(1, k);
-                insertTempStmt.exec();
-                insertTempStmt.reset();
-            }
-            // 删除掉不在当前缓存中的键对应的记录
-            SQLite::Statement deleteStmt(db,
-                                         "DELETE FROM Store WHERE savefile = '' AND key NOT IN (SELECT key FROM TempKeys)");
-            deleteStmt.exec();
-
-            // 插入或更新现有的键
-            SQLite::Statement stmt(db,
-                                   "INSERT INTO Store (key, savefile, type, value) "
-                                   "VALUES (?, '', ?, ?) "
-                                   "ON CONFLICT(key, savefile) DO UPDATE SET "
-                                   "type=excluded.type, value=excluded.value, updated_at=CURRENT_TIMESTAMP");
-            for (const auto& [k, v] : m_globalCache)
-            {
-                try
-                {
-                    stmt.bind(1, k);
-                    stmt.bind(2, v.anyType());
-                    stmt.bind(3, serializeValue(v));
-                    stmt.exec();
-                    stmt.reset();
-                    successCount++;
-                }
-                catch (const std::exception& e)
+        upserts += changes.dirtyKeys.size();
+        deletes += changes.deletedKeys.size();
+    }
+    flush->batch->upserts.reserve(upserts);
+    flush->batch->deletes.reserve(deletes);
+    // 批次包含此序号之前的所有重做日志记录，提交后这些记录可以被压缩掉。
+    // 之后的 SetG/DelG 记入新的脏键集合，由下一次写入处理。
+    flush->redoSequence = m_redoLog ? m_redoLog->lastSequence() : 0;
+    flush->started = std::chrono::steady_clock::now();
+    m_globalFlush = std::move(flush);
+}
+
+void LuaDB::ContinueGlobalFlushLocked(const std::chrono::microseconds budget)
+{
+    using namespace std::chrono;
+    // 每处理这么多个键检查一次时间
+    constexpr int kKeysPerClockCheck = 32;
+
+    GlobalFlush& flush = *m_globalFlush;
+    const auto frameStart = steady_clock::now();
+    const auto overBudget = [&] { return steady_clock::now() - frameStart >= budget; };
+    int sinceCheck = 0;
+    bool paused = false;
+    // 在锁内只生成变更批次，写入由持久化线程完成。
+    // 批次分帧生成，每帧最多占用 budget；键的值在处理到它时才复制，因此总是最新值。
+    while (!paused && !flush.namespaces.empty())
+    {
+        GlobalCache::Changes& changes = flush.namespaces.back();
+        while (!paused && !changes.deletedKeys.empty())
+        {
+            flush.batch->deletes.push_back(std::move(changes.deletedKeys.extract(changes.deletedKeys.begin()).value()));
+            paused = ++sinceCheck == kKeysPerClockCheck && (sinceCheck = 0, overBudget());
+        }
+        while (!paused && !changes.dirtyKeys.empty())
+        {
+            auto node = changes.dirtyKeys.extract(changes.dirtyKeys.begin());
+            // 写入开始后被 DelG 删除的键已在新的删除集合中
+            if (const auto value = m_globalCache.Find(node.value()))
+            {
+                flush.batch->upserts.emplace_back(std::move(node.value()), value->ToValue());
+            }
+            paused = ++sinceCheck == kKeysPerClockCheck && (sinceCheck = 0, overBudget());
+        }
+        if (changes.deletedKeys.empty() && changes.dirtyKeys.empty())
+        {
+            flush.namespaces.pop_back();
+        }
+    }
+
+    const auto frameUs = duration_cast<microseconds>(steady_clock::now() - frameStart).count();
+    ++flush.frames;
+    flush.totalUs += frameUs;
+    flush.maxFrameUs = std::max<long long>(flush.maxFrameUs, frameUs);
+    if (!flush.namespaces.empty())
+    {
+        return;
+    }
+
+    LogDebug("Global flush of %zu changes in %zu namespace(s) prepared in %d frame(s): %lld us total, %lld us max per frame, %lld ms elapsed.",
+             flush.batch->upserts.size() + flush.batch->deletes.size(),
+             flush.namespaceCount,
+             flush.frames,
+             flush.totalUs,
+             flush.maxFrameUs,
+             static_cast<long long>(duration_cast<milliseconds>(steady_clock::now() - flush.started).count()));
+    SubmitGlobalFlushLocked();
+}
+
+void LuaDB::SubmitGlobalFlushLocked()
+{
+    const std::unique_ptr<GlobalFlush> flush = std::move(m_globalFlush);
+    const size_t cachedCount = m_globalCache.size();
+    // 整个批次在一个任务中提交，存储引擎保证其原子性
+    m_lastGlobalFlushTicket = ExecuteTransaction("Global save", [batch = flush->batch, cachedCount, redoLog = m_redoLog.get(), redoSequence = flush->redoSequence, failed = m_failedGlobalKeys](StorageEngine& engine)
+    {
+        // 未写入的键交还游戏线程，由之后的写入重试
+        const auto handBack = [&batch, &failed](const std::vector<std::size_t>* failedUpserts)
+        {
+            std::lock_guard lock(failed->mutex);
+            if (!failedUpserts)
+            {
+                failed->keys.insert(failed->keys.end(), batch->deletes.begin(), batch->deletes.end());
+                for (const auto& [k, v] : batch->upserts)
                 {
-                    LogError("Global save failed for key %s: %s", k.c_str(), e.what());
+                    failed->keys.push_back(k);
                 }
+                return;
             }
-        });
-        m_lastSaveTime = steady_clock::now();
-        if (successCount == m_globalCache.size())
+            for (const std::size_t i : *failedUpserts)
+            {
+                failed->keys.push_back(batch->upserts[i].first);
+            }
+        };
+        BatchResult result;
+        try
+        {
+            result = engine.ApplyBatch(*batch);
+        }
+        catch (...)
         {
-            LogInfo("Global data saved: %zu entries", m_globalCache.size());
+            handBack(nullptr);
+            throw;
+        }
+        if (result.upserted == batch->upserts.size())
+        {
+            bool retryPending = false;
+            {
+                std::lock_guard lock(failed->mutex);
+                retryPending = !failed->keys.empty();
+            }
+            // 失败的键重新标记前，它们的重做日志记录不能被压缩掉
+            if (redoLog && !retryPending)
+            {
+                redoLog->MarkApplied(redoSequence);
+            }
+            LogInfo("Global data saved: %zu upserted, %zu deleted, %zu entries cached",
+                    result.upserted,
+                    result.deleted,
+                    cachedCount);
         }
         else
         {
-            LogError("Global save failed: %d/%zu entries saved", successCount, m_globalCache.size());
+            handBack(result.failedUpserts.empty() ? nullptr : &result.failedUpserts);
+            LogError("Global save failed: %zu/%zu changed entries saved, %zu deleted",
+                     result.upserted,
+                     batch->upserts.size(),
+                     result.deleted);
         }
+    });
+    m_lastSaveTime = std::chrono::steady_clock::now();
+    m_globalSnapshotStale = true;
+}
+
+void LuaDB::RetryFailedGlobalKeysLocked()
+{
+    const auto now = std::chrono::steady_clock::now();
+    if (now - m_lastGlobalRetry < kGlobalRetryInterval)
+    {
+        return;
     }
-    catch (const std::exception& e)
+    std::vector<std::string> keys;
     {
-        LogError("Global save failed: %s", e.what());
+        std::lock_guard lock(m_failedGlobalKeys->mutex);
+        keys.swap(m_failedGlobalKeys->keys);
     }
-    catch (...)
+    if (keys.empty())
     {
-        LogError("Global save failed: Unknown error");
+        return;
     }
-    // Clear even after failure: this prevents an unsavable value or persistent SQLite
-    // error from causing repeated high-frequency flush attempts. New SetG/DelG calls
-    // will mark the global cache dirty again.
-    m_globalDirty = false;
+    m_lastGlobalRetry = now;
+    std::size_t retried = 0;
+    for (const auto& k : keys)
+    {
+        // 之后的 SetG/DelG 已标记该键，且比失败的值新
+        if (!m_globalCache.MarkChanged(k))
+        {
+            continue;
+        }
+        ++retried;
+        // 重新记入重做日志：准备中的写入提交后会压缩掉原来的记录
+        if (!m_redoLog)
+        {
+            continue;
+        }
+        if (const auto value = m_globalCache.Find(k))
+        {
+            if (value->type != ScriptValue::Type::BLOB_REF)
+            {
+                m_redoLog->AppendSet(k, value->ToValue());
+            }
+        }
+        else
+        {
+            m_redoLog->AppendDelete(k);
+        }
+    }
+    LogWarn("Retrying %zu global change(s) a failed flush did not store.", retried);
 }
 
+void LuaDB::ScheduleGlobalSnapshotLocked()
+{
+    using namespace std::chrono;
+    const std::uint32_t intervalSec = GetLuaDBOptions().globalSnapshotSec;
+    if (intervalSec == 0)
+    {
+        return;
+    }
+    if (m_globalSnapshotBuild)
+    {
+        ContinueGlobalSnapshotLocked();
+        return;
+    }
+    // 只在全局数据停止变化一段时间后重写，持续变化时不重写；两次重写至少间隔 intervalSec
+    const auto now = steady_clock::now();
+    if (!m_globalSnapshotStale || m_globalCache.HasChanges() || now - m_lastSaveTime < kGlobalSnapshotQuietTime
+        || now - m_lastGlobalSnapshotTime < seconds(intervalSec))
+    {
+        return;
+    }
+    m_globalSnapshotStale = false;
+    m_lastGlobalSnapshotTime = now;
+    auto build = std::make_shared<GlobalSnapshotBuild>();
+    build->started = now;
+    m_globalSnapshotBuild = build;
+    // 第一步只记下版本并列出命名空间，排在之前提交的全局写入之后
+    m_globalSnapshotTicket = ExecuteTransaction("Global snapshot", [build, path = kGlobalSnapshotPaths[m_globalSnapshotSlot]](StorageEngine& engine)
+    {
+        try
+        {
+            build->version = engine.GlobalVersion();
+            build->prefixes = engine.ListNamespaces("");
+            build->builder = std::make_unique<GlobalSnapshot::Builder>(path, build->version);
+        }
+        catch (const std::exception& e)
+        {
+            build->failed = true;
+            LogWarn("Global snapshot not written: %s", e.what());
+        }
+    });
+}
 
-void LuaDB::ExecuteTransaction(const std::function<void(SQLite::Database&)>& task) const
+void LuaDB::ContinueGlobalSnapshotLocked()
 {
-    SQLite::Transaction transaction(*m_db);
-    task(*m_db);
-    transaction.commit();
+    using namespace std::chrono;
+    if (!m_writer->Finished(m_globalSnapshotTicket))
+    {
+        return;
+    }
+    const auto build = m_globalSnapshotBuild;
+    if (build->failed || build->written)
+    {
+        // 失败后等下一个间隔再试
+        m_globalSnapshotStale = m_globalSnapshotStale || build->failed;
+        m_globalSnapshotBuild.reset();
+        return;
+    }
+    // 期间提交了全局写入：写完的快照版本也对不上，丢弃临时文件，等数据再次平静后重写
+    if (m_globalSnapshotStale)
+    {
+        LogDebug("Global snapshot abandoned after %zu/%zu namespaces: global data changed.",
+                 build->next,
+                 build->prefixes.size());
+        m_globalSnapshotBuild.reset();
+        return;
+    }
+    if (build->next < build->prefixes.size())
+    {
+        // 每个任务只读取一个命名空间，大值保持 BlobRef 不读取，之间排队的写入和读取照常执行
+        m_globalSnapshotTicket = ExecuteTransaction("Global snapshot", [build](StorageEngine& engine)
+        {
+            const std::string& prefix = build->prefixes[build->next++];
+            try
+            {
+                Cache entries;
+                engine.LoadNamespaces("", {prefix}, entries);
+                build->builder->AddNamespace(prefix, entries);
+            }
+            catch (const std::exception& e)
+            {
+                build->failed = true;
+                LogWarn("Global snapshot not written: %s", e.what());
+            }
+        });
+        return;
+    }
+    m_globalSnapshotTicket = ExecuteTransaction("Global snapshot", [build, path = kGlobalSnapshotPaths[m_globalSnapshotSlot]](StorageEngine& engine)
+    {
+        try
+        {
+            if (engine.GlobalVersion() != build->version)
+            {
+                build->failed = true;
+                LogDebug("Global snapshot abandoned: global data changed while it was written.");
+                return;
+            }
+            build->builder->Finish();
+            build->written = true;
+            LogInfo("Global snapshot written to %s: %zu entries in %zu namespaces, %zu bytes at version %lld in %lld ms.",
+                    path,
+                    build->builder->size(),
+                    build->prefixes.size(),
+                    build->builder->bytes(),
+                    static_cast<long long>(build->version),
+                    static_cast<long long>(duration_cast<milliseconds>(steady_clock::now() - build->started).count()));
+        }
+        catch (const std::exception& e)
+        {
+            build->failed = true;
+            LogWarn("Global snapshot not written: %s", e.what());
+        }
+    });
 }
 
-int LuaDB::Dump(IFunctionHandler* pH)
+LuaDB::BlobStubs LuaDB::CollectBlobStubsLocked(const std::string_view prefix, const bool isGlobal) const
 {
-    std::lock_guard lock(m_mutex);
+    BlobStubs stubs;
+    if (isGlobal)
+    {
+        m_globalCache.ForEach(prefix, [&stubs](const std::string_view k, const ScriptValueView& v)
+        {
+            if (v.type == ScriptValue::Type::BLOB_REF)
+            {
+                stubs.emplace_back(std::string(k), v.blob);
+            }
+        });
+        return stubs;
+    }
+    for (const auto& [k, v] : m_saveCache)
+    {
+        if (v.is_blob_ref() && k.starts_with(prefix))
+        {
+            stubs.emplace_back(k, v.as_blob_ref());
+        }
+    }
+    return stubs;
+}
 
-    // Helper function to dump a specific cache
-    auto dumpCache = [&](auto& cache, const std::string& cacheType)
+void LuaDB::ResolveBlobStubsLocked(const BlobStubs& stubs, const bool isGlobal)
+{
+    std::vector<std::optional<std::string>> values(stubs.size());
+    const auto takeFetched = [&]
     {
-        gEnv->pConsole->PrintLine(("$6--- " + cacheType + " ---").c_str());
-        for (const auto& [key, value] : cache)
+        std::lock_guard fetchedLock(m_fetchedBlobs->mutex);
+        for (std::size_t i = 0; i < stubs.size(); ++i)
+        {
+            if (auto node = m_fetchedBlobs->values.extract(stubs[i].second.id); !values[i] && node)
+            {
+                values[i] = std::move(node.mapped());
+            }
+        }
+    };
+    const auto anyMissing = [&]
+    {
+        return std::any_of(values.begin(), values.end(), [](const auto& value) { return !value.has_value(); });
+    };
+    takeFetched();
+    if (anyMissing())
+    {
+        const auto start = std::chrono::steady_clock::now();
+        // 已由 Prefetch 排队的值只需等待那个任务
+        std::uint64_t prefetchTicket = 0;
+        for (std::size_t i = 0; i < stubs.size(); ++i)
         {
-            switch (value.type())
+            if (const auto it = m_valuePrefetchTickets.find(stubs[i].second.id); !values[i] && it != m_valuePrefetchTickets.end())
             {
-            case ScriptValue::Type::BOOL:
+                prefetchTicket = std::max(prefetchTicket, it->second);
+            }
+        }
+        if (prefetchTicket != 0)
+        {
+            m_writer->Wait(prefetchTicket);
+            takeFetched();
+        }
+        // 其余的值在持久化线程上读取，游戏线程只等待这一个任务
+        std::size_t read = 0;
+        if (anyMissing())
+        {
+            std::vector<std::size_t> positions;
+            BlobStubs unread;
+            for (std::size_t i = 0; i < stubs.size(); ++i)
+            {
+                if (!values[i])
                 {
-                    std::ostringstream oss;
-                    oss << "  $5" << key << "  $8Boolean  $3" << (value.as_bool() ? "true" : "false");
-                    gEnv->pConsole->PrintLine(oss.str().c_str());
+                    positions.push_back(i);
+                    unread.push_back(stubs[i]);
                 }
-                break;
-            case ScriptValue::Type::NUMBER:
+            }
+            auto results = std::make_shared<std::vector<std::optional<std::string>>>(unread.size());
+            m_writer->Wait(ExecuteTransaction("Value read", [results, unread = std::move(unread)](StorageEngine& engine)
+            {
+                for (std::size_t i = 0; i < unread.size(); ++i)
                 {
-                    std::ostringstream oss;
-                    oss << "  $5" << key << "  $8Number  $3" << value.as_number();
-                    gEnv->pConsole->PrintLine(oss.str().c_str());
+                    try
+                    {
+                        (*results)[i] = engine.ReadBlob(unread[i].second);
+                    }
+                    catch (const std::exception& e)
+                    {
+                        LogError("Cannot read the value of %s: %s", unread[i].first.c_str(), e.what());
+                    }
                 }
-                break;
-            case ScriptValue::Type::STRING:
+            }));
+            for (std::size_t j = 0; j < positions.size(); ++j)
+            {
+                if ((*results)[j])
                 {
-                    std::ostringstream oss;
-                    oss << "  $5" << key << "  $8String  $3" << substring(value.as_string());
-                    gEnv->pConsole->PrintLine(oss.str().c_str());
+                    values[positions[j]] = std::move((*results)[j]);
+                    ++read;
                 }
-                break;
-            default:
-                break;
             }
         }
+        LogDebug("Read %zu large values on first access in %lld us.",
+                 read,
+                 static_cast<long long>(std::chrono::duration_cast<std::chrono::microseconds>(
+                     std::chrono::steady_clock::now() - start).count()));
+    }
+    for (const auto& [k, ref] : stubs)
+    {
+        m_valuePrefetchTickets.erase(ref.id);
+    }
+
+    for (std::size_t i = 0; i < stubs.size(); ++i)
+    {
+        if (!values[i])
+        {
+            continue;
+        }
+        const std::string& k = stubs[i].first;
+        if (isGlobal)
+        {
+            m_globalCache.Resolve(k, std::move(*values[i]));
+        }
+        else if (const auto it = m_saveCache.find(k); it != m_saveCache.end() && it->second.is_blob_ref())
+        {
+            // 存根本身也计入了占用，按替换前后的估算差值调整
+            const std::size_t stubBytes = EstimateEntryBytes(k, it->second);
+            it->second = ScriptValue(std::move(*values[i]));
+            AdjustSaveBytesLocked(k, EstimateEntryBytes(k, it->second), stubBytes);
+        }
+    }
+}
+
+std::uint64_t LuaDB::ExecuteTransaction(const char* label, PersistenceWriter::Task task) const
+{
+    return m_writer->Submit(label, std::move(task));
+}
+
+int LuaDB::Preload(IFunctionHandler* pH)
+{
+    const char* key = nullptr;
+    if (!pH->GetParam(1, key) || !key || NamespacePrefixLength(key) == 0)
+    {
+        return pH->EndFunction(false);
+    }
+    const std::string prefix(key, NamespacePrefixLength(key));
+    std::lock_guard lock(m_mutex);
+    // 初始化完成前只记录命名空间，存储就绪后一并读取
+    m_activeNamespaces.insert(prefix);
+    if (m_initState != InitState::Ready)
+    {
+        return pH->EndFunction(true);
+    }
+    if (!m_globalCache.IsLoaded(prefix) && !m_pendingGlobalLoads.contains(prefix))
+    {
+        QueueNamespaceLoadLocked({prefix}, true);
+    }
+    if (m_saveNamespaces && !m_saveNamespaces->contains(prefix) && !m_pendingSaveLoads.contains(prefix))
+    {
+        QueueNamespaceLoadLocked({prefix}, false);
+    }
+    return pH->EndFunction(true);
+}
+
+int LuaDB::Dump(IFunctionHandler* pH)
+{
+    std::unique_lock lock(m_mutex);
+    WaitForStorageLocked(lock, "Dump");
+    // 打印全部数据，包括本次会话未使用的命名空间
+    LoadAllGlobalLocked();
+    LoadAllSaveLocked();
+
+    auto printHeader = [](const std::string& cacheType)
+    {
+        gEnv->pConsole->PrintLine(("$6--- " + cacheType + " ---").c_str());
+    };
+    auto printEntry = [&](const std::string_view key, const ScriptValueView& value)
+    {
+        switch (value.type)
+        {
+        case ScriptValue::Type::BOOL:
+            {
+                std::ostringstream oss;
+                oss << "  $5" << key << "  $8Boolean  $3" << (value.boolean ? "true" : "false");
+                gEnv->pConsole->PrintLine(oss.str().c_str());
+            }
+            break;
+        case ScriptValue::Type::NUMBER:
+            {
+                std::ostringstream oss;
+                oss << "  $5" << key << "  $8Number  $3" << value.number;
+                gEnv->pConsole->PrintLine(oss.str().c_str());
+            }
+            break;
+        case ScriptValue::Type::STRING:
+            {
+                std::ostringstream oss;
+                oss << "  $5" << key << "  $8String  $3" << substring(std::string(value.string));
+                gEnv->pConsole->PrintLine(oss.str().c_str());
+            }
+            break;
+        case ScriptValue::Type::BLOB_REF:
+            {
+                // Dump 不触发读取
+                std::ostringstream oss;
+                oss << "  $5" << key << "  $8String  $3<not loaded, " << value.blob.storedBytes << " bytes stored>";
+                gEnv->pConsole->PrintLine(oss.str().c_str());
+            }
+            break;
+        default:
+            break;
+        }
     };
 
-    dumpCache(m_globalCache, "[Global Data]");
+    printHeader("[Global Data]");
+    m_globalCache.ForEach({}, printEntry);
     std::ostringstream oss;
     oss << "[Save Data For : " << (m_saveCacheFileName.empty() ? "No save file bound to cache" : m_saveCacheFileName) << "]";
-    dumpCache(m_saveCache, oss.str());
+    printHeader(oss.str());
+    for (const auto& [key, value] : m_saveCache)
+    {
+        printEntry(key, ScriptValueView::Of(value));
+    }
+    const CacheBudget::Stats& stats = m_cacheBudget.stats();
+    std::ostringstream statsLine;
+    statsLine << "$6--- Cache: " << ((m_globalCache.bytes() + m_saveBytes) >> 10) << " KB resident, budget "
+        << (stats.budgetBytes >> 10) << " KB, hit rate " << stats.hitRate() * 100.0 << "%, "
+        << stats.evictions << " evictions ---";
+    gEnv->pConsole->PrintLine(statsLine.str().c_str());
     return pH->EndFunction();
 }
+
+int LuaDB::CacheStats(IFunctionHandler* pH)
+{
+    std::lock_guard lock(m_mutex);
+    const CacheBudget::Stats& stats = m_cacheBudget.stats();
+    const auto table = m_pSS->CreateTable();
+    // Lua 数字为 float，字节数在 16 MB 以上会丢失精度
+    table->SetValue("residentBytes", static_cast<float>(m_globalCache.bytes() + m_saveBytes));
+    table->SetValue("globalBytes", static_cast<float>(m_globalCache.bytes()));
+    table->SetValue("saveBytes", static_cast<float>(m_saveBytes));
+    table->SetValue("budgetBytes", static_cast<float>(stats.budgetBytes));
+    table->SetValue("hits", static_cast<float>(stats.hits));
+    table->SetValue("misses", static_cast<float>(stats.misses));
+    table->SetValue("hitRate", static_cast<float>(stats.hitRate()));
+    table->SetValue("evictions", static_cast<float>(stats.evictions));
+    table->SetValue("evictedBytes", static_cast<float>(stats.evictedBytes));
+    return pH->EndFunction(table);
+}
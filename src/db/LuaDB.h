@@ -5,94 +5,21 @@
 #include <cryengine/IScriptSystem.h>
 #include <cryengine/IGameFramework.h>
 #include <unordered_map>
+#include <unordered_set>
 #include <mutex>
+#include <condition_variable>
+#include <thread>
 #include <optional>
-#include <variant>
-#include <SQLiteCpp/SQLiteCpp.h>
-
-class ScriptValue {
-public:
-    enum class Type { BOOL, NUMBER, STRING };
-    // 构造函数
-    ScriptValue() : m_value(false) {}  // 默认构造为 bool
-    explicit ScriptValue(bool b) : m_value(b) {}
-    explicit ScriptValue(float f) : m_value(f) {}
-    explicit ScriptValue(const std::string& s) : m_value(s) {}
-    explicit ScriptValue(const char* s) : m_value(std::string(s)) {}
-    explicit ScriptValue(const ScriptAnyValue& v){
-        switch (v.type)
-        {
-        case ANY_TBOOLEAN:
-            m_value = v.b;
-            break;
-        case ANY_TNUMBER:
-            m_value = v.number;
-            break;
-        case ANY_TSTRING:
-            m_value = v.str;
-            break;
-        default:
-            // Unsupported raw LuaDB values should be rejected before constructing
-            // ScriptValue. Use the DB JSON wrapper for structured Lua values.
-            assert(false);
-        }
-    }
-
-    ~ScriptValue() = default;
-    ScriptValue(const ScriptValue&) = default;
-    ScriptValue(ScriptValue&&) = default;
-    ScriptValue& operator=(const ScriptValue&) = default;
-    ScriptValue& operator=(ScriptValue&&) = default;
-    // 类型查询
-    Type type() const {
-        return static_cast<Type>(m_value.index());
-    }
-    // Lua 类型方法
-    int anyType() const
-    {
-        switch (type())
-        {
-        case Type::BOOL: return ANY_TBOOLEAN;
-        case Type::NUMBER: return ANY_TNUMBER;
-        case Type::STRING: return ANY_TSTRING;
-        default: return ANY_ANY;
-        }
-    }
-    ScriptAnyValue toAnyValue() const
-    {
-        switch (type())
-        {
-        case Type::BOOL:
-            return {as_bool()};
-        case Type::NUMBER:
-            return {as_number()};
-        case Type::STRING:
-            return {as_string().c_str()};
-        }
-        return {};
-    }
-
-    // 取值接口
-    bool as_bool() const {
-        assert(is_bool());
-        return std::get<bool>(m_value);
-    }
-    float as_number() const {
-        assert(is_number());
-        return std::get<float>(m_value);
-    }
-    const std::string& as_string() const {
-        assert(is_string());
-        return std::get<std::string>(m_value);
-    }
-    // 类型校验
-    bool is_bool() const   { return type() == Type::BOOL; }
-    bool is_number() const { return type() == Type::NUMBER; }
-    bool is_string() const { return type() == Type::STRING; }
-private:
-    std::variant<bool, float, std::string> m_value;
-};
+#include <atomic>
 
+#include "CacheBudget.h"
+#include "GlobalCache.h"
+#include "PersistenceWriter.h"
+#include "RedoLog.h"
+#include "SaveCacheLru.h"
+#include "SaveCollector.h"
+#include "ScriptValue.h"
+#include "StorageEngine.h"
 
 class LuaDB final : public CScriptableBase, public IGameFrameworkListener {
 public:
@@ -112,8 +39,18 @@ public:
     int DelG(IFunctionHandler* pH) { return GenericAccess(pH, AccessType::Del, true); }
     int ExiG(IFunctionHandler* pH) { return GenericAccess(pH, AccessType::Exi, true); }
     int AllG(IFunctionHandler* pH) { return GenericAccess(pH, AccessType::All, true); }
+    // Hints that the values under a key prefix will be read soon: large values not loaded
+    // yet are read on the persistence thread. Returns the number of values queued.
+    int Prefetch(IFunctionHandler* pH)  { return GenericAccess(pH, AccessType::Prefetch); }
+    int PrefetchG(IFunctionHandler* pH) { return GenericAccess(pH, AccessType::Prefetch, true); }
+
+    // Called by DB.Create with its "Name:" prefix: the stored entries of that namespace are
+    // read on the persistence thread right away, so its first access rarely has to wait.
+    int Preload(IFunctionHandler* pH);
 
     int Dump(IFunctionHandler* pH);
+    // Returns a table with the resident bytes, budget, hit rate and evictions of the caches.
+    int CacheStats(IFunctionHandler* pH);
 
     const char* getName() const { return m_sGlobalName; }
 
@@ -125,12 +62,22 @@ public:
     void OnLevelEnd(const char* nextLevel)  override {}
     void OnActionEvent(const SActionEvent& event) override {}
     void OnPreRender() override{}
-    void OnSavegameFileLoadedInMemory(const char* pLevelName) override{}
+    void OnSavegameFileLoadedInMemory(const char* pLevelName) override;
     void OnForceLoadingWithFlash()  override                          {}
 
 private:
-    enum class AccessType { Set, Get, Del, Exi, All };
+    enum class AccessType { Set, Get, Del, Exi, All, Prefetch };
+    // Key and stub of a value the storage engine has not read yet.
+    using BlobStubs = std::vector<std::pair<std::string, BlobRef>>;
+
+    // Strings read ahead by Prefetch/PrefetchG, by BlobRef id, until they are first read.
+    struct FetchedBlobs {
+        std::mutex mutex;
+        std::unordered_map<std::int64_t, std::string> values;
+    };
     typedef std::unordered_map<std::string, ScriptValue> Cache;
+    // "Name:" key prefixes, see NamespacePrefixLength.
+    using NamespaceSet = std::unordered_set<std::string>;
 
     struct CacheData {
         Cache cache;
@@ -138,25 +85,199 @@ private:
         bool& changedFlag;
     };
 
+    // Save cache hydrated ahead of OnLoadGame on the persistence thread.
+    // An empty savefile asks the task to pick the most recently updated save.
+    struct SavePrefetch {
+        std::string savefile;
+        // The namespaces read into cache: those in use when the prefetch was queued.
+        NamespaceSet namespaces;
+        Cache cache;
+        // Unmodified copy of cache for m_saveLru, made on the persistence thread.
+        std::shared_ptr<const Cache> pristine;
+        bool ready = false;
+    };
+
+    // Stored entries of namespaces read by a task queued ahead of their first use.
+    struct NamespaceLoad {
+        std::vector<std::string> prefixes;
+        Cache entries;
+        bool done = false;
+        // Global keys erased by DelG while the task was pending: a flush queued after the
+        // task may remove them from storage once the task has read them.
+        std::unordered_set<std::string> deletedKeys;
+    };
+    struct PendingLoad {
+        std::uint64_t ticket = 0;
+        std::shared_ptr<NamespaceLoad> load;
+    };
+
+    struct FailedGlobalKeys {
+        std::mutex mutex;
+        std::vector<std::string> keys;
+    };
+
+    // A global flush being prepared across frames. Its changes were taken out of
+    // m_globalCache when it started; SetG/DelG made since then mark their keys again for
+    // the next flush.
+    struct GlobalFlush {
+        std::shared_ptr<GlobalBatch> batch;
+        // Changed namespaces whose keys are not in batch yet.
+        std::vector<GlobalCache::Changes> namespaces;
+        std::size_t namespaceCount = 0;
+        std::uint64_t redoSequence = 0;
+        std::chrono::steady_clock::time_point started;
+        int frames = 0;
+        long long totalUs = 0;
+        long long maxFrameUs = 0;
+    };
+
+    // A global snapshot being written one namespace per persistence task, so flushes and
+    // loads queued meanwhile run in between. Each task is submitted once the previous one
+    // finished; the game thread only reads it then.
+    struct GlobalSnapshotBuild {
+        std::unique_ptr<GlobalSnapshot::Builder> builder;
+        std::int64_t version = 0;
+        std::vector<std::string> prefixes;
+        std::size_t next = 0;
+        bool failed = false;
+        bool written = false;
+        std::chrono::steady_clock::time_point started;
+    };
+
     int GenericAccess(IFunctionHandler* pH, AccessType action, bool isGlobal = false);
 
-    void ExecuteTransaction(const std::function<void(SQLite::Database&)>& task) const;
-    void SyncCacheWithDatabase();
-    void SyncCacheWithDatabaseLocked();
+    enum class InitState { Pending, Ready, Failed };
+
+    // Opens the storage engine and hydrates the global cache on m_initThread.
+    void InitializeStorage();
+    // Blocks until InitializeStorage finished; false when the database is unavailable and
+    // LuaDB keeps working from memory only.
+    bool WaitForStorageLocked(std::unique_lock<std::mutex>& lock, const char* reason);
+    bool StorageReadyLocked() const { return m_initState == InitState::Ready; }
 
-    std::unique_ptr<SQLite::Database> m_db;
+    // Queues task on the persistence thread; each engine call in it is atomic.
+    std::uint64_t ExecuteTransaction(const char* label, PersistenceWriter::Task task) const;
+    // Reads the namespaces in use of m_saveCacheFileName into m_saveCache. The global scope
+    // is not touched.
+    void LoadSaveCacheLocked();
+    // Marks the namespace of key in use and loads it into the global or save cache if it is not yet.
+    void UseNamespaceLocked(std::string_view key, bool isGlobal);
+    // UseNamespaceLocked for every key starting with prefix: loads everything when prefix
+    // does not name a single namespace.
+    void UseNamespacesLocked(std::string_view prefix, bool isGlobal);
+    // Loads the given namespaces that are not loaded yet: queues a single storage read for
+    // those without a pending load, then waits only for the tasks reading them.
+    void LoadGlobalNamespacesLocked(const std::vector<std::string>& prefixes);
+    void LoadSaveNamespacesLocked(const std::vector<std::string>& prefixes);
+    // Queues a task reading prefixes of the global scope or of m_saveCacheFileName.
+    void QueueNamespaceLoadLocked(std::vector<std::string> prefixes, bool isGlobal);
+    // Waits for the pending loads of prefixes and adds what they read to the cache.
+    void AwaitNamespaceLoadsLocked(const std::vector<std::string>& prefixes, bool isGlobal);
+    void LoadAllGlobalLocked();
+    void LoadAllSaveLocked();
+    void BeginGlobalFlushLocked();
+    // Adds changes to the batch of m_globalFlush for up to budget and submits it once complete.
+    void ContinueGlobalFlushLocked(std::chrono::microseconds budget);
+    void SubmitGlobalFlushLocked();
+    // Marks the keys of failed global flushes for the next flush again, at most once per
+    // kGlobalRetryInterval so a value the engine keeps rejecting is not retried every frame.
+    void RetryFailedGlobalKeysLocked();
+    // Starts rewriting the global snapshot once global data has been quiet for a while, at
+    // most once per -kcd2dbSnapshotSec, and submits its next step once the previous one
+    // finished. A global flush submitted meanwhile abandons it.
+    void ScheduleGlobalSnapshotLocked();
+    void ContinueGlobalSnapshotLocked();
+    // Applies SetG/DelG calls from the redo log that the engine may not have stored to the
+    // global cache and marks them for the next flush. Keys that are already dirty are newer.
+    void ReplayRedoLogLocked(RedoLog& redoLog);
+    void PrefetchSaveLocked(const std::string& savefile, const char* reason);
+    // Collects the BlobRef stubs of the global or save cache whose key starts with prefix.
+    BlobStubs CollectBlobStubsLocked(std::string_view prefix, bool isGlobal) const;
+    // Replaces stubs in the global or save cache by their strings, taken from
+    // m_fetchedBlobs or read by a task on the persistence thread; only waits for the
+    // Prefetch task of a value or for that read. Stubs that cannot be read stay.
+    void ResolveBlobStubsLocked(const BlobStubs& stubs, bool isGlobal);
+    // Swaps in the prefetched save cache when it matches savefile; false on a miss.
+    bool TakeSavePrefetchLocked(const std::string& savefile);
+    // Copies the m_saveLru entry of savefile into m_saveCache; false when there is none or
+    // it was never stored.
+    bool TakeCachedSaveLocked(const std::string& savefile);
+    // Accounts an entry of m_saveCache whose estimated size changed (see EstimateEntryBytes).
+    void AdjustSaveBytesLocked(std::string_view key, std::size_t added, std::size_t removed);
+    // Starts the save accounting over from m_saveCache once another save was loaded.
+    void ResetSaveTrackingLocked();
+    // Evicts the coldest clean namespaces once the caches exceed -kcd2dbCacheMB; called
+    // every frame, checks at most once per second.
+    void EnforceCacheBudgetLocked();
+    void EvictSaveNamespacesLocked(const std::vector<std::string>& prefixes);
+
+    std::unique_ptr<PersistenceWriter> m_writer;
+    // Null when -kcd2dbRedoSync=off or the log cannot be opened.
+    std::unique_ptr<RedoLog> m_redoLog;
+    // Null when -kcd2dbSaveGC=off or the save directory is unknown.
+    std::unique_ptr<SaveCollector> m_saveCollector;
     // The save file name used as the database key for m_saveCache.
     // It may be set by loading a save or by saving a new one.
     std::string m_saveCacheFileName;
     mutable std::mutex m_mutex;
     Cache m_saveCache;
-    Cache m_globalCache;
+    // The namespaces of m_saveCacheFileName loaded into m_saveCache; the others are only in
+    // storage and carried over by the next save. Empty optional when m_saveCache holds all.
+    std::optional<NamespaceSet> m_saveNamespaces;
+    // Namespaces used this session in either scope, loaded up front whenever a save is.
+    NamespaceSet m_activeNamespaces;
+    // Loads queued by QueueNamespaceLoadLocked and not added to the cache yet, by prefix.
+    // The save ones read m_saveCacheFileName and are dropped when another save is loaded.
+    std::unordered_map<std::string, PendingLoad> m_pendingGlobalLoads;
+    std::unordered_map<std::string, PendingLoad> m_pendingSaveLoads;
+    // Estimated bytes of m_saveCache, in total and per namespace.
+    std::unordered_map<std::string, std::size_t> m_saveNamespaceBytes;
+    std::size_t m_saveBytes = 0;
+    // Namespaces of m_saveCache changed since the save was loaded or written; never evicted.
+    NamespaceSet m_dirtySaveNamespaces;
+    // Set by the task writing the last OnSaveGame; null when m_saveCache was loaded since.
+    std::shared_ptr<const std::atomic<bool>> m_lastSaveWritten;
+    CacheBudget m_cacheBudget;
+    std::chrono::steady_clock::time_point m_lastBudgetCheck;
+    // Pending changes are taken by each global flush attempt, even on failure, to avoid
+    // retrying permanently unsavable data every frame. A later SetG/DelG marks the key again.
+    GlobalCache m_globalCache;
+    std::shared_ptr<SavePrefetch> m_savePrefetch;
+    // Stored state of recent saves; m_saveCache holds changes made since.
+    SaveCacheLru m_saveLru;
+    // Shared with the prefetch tasks, which must not lock m_mutex.
+    std::shared_ptr<FetchedBlobs> m_fetchedBlobs = std::make_shared<FetchedBlobs>();
+    // Ticket of the Prefetch task queued for each BlobRef id, until the value is first read.
+    std::unordered_map<std::int64_t, std::uint64_t> m_valuePrefetchTickets;
+    std::uint64_t m_savePrefetchTicket = 0;
 
 
     std::chrono::steady_clock::time_point m_lastSaveTime;
 
-    // Cleared after each global flush attempt, even on failure, to avoid retrying
-    // permanently unsavable data every frame. A later SetG/DelG marks it dirty again.
-    bool m_globalDirty = false;
+    // Null between flushes.
+    std::unique_ptr<GlobalFlush> m_globalFlush;
+    // Keys of global flushes the engine did not store, handed back by the persistence thread.
+    // While any are waiting the cache holds changes storage lacks, so global namespaces are
+    // not evicted and flushes keep their redo log records.
+    std::shared_ptr<FailedGlobalKeys> m_failedGlobalKeys = std::make_shared<FailedGlobalKeys>();
+    std::chrono::steady_clock::time_point m_lastGlobalRetry;
+    // Ticket of the last submitted global flush; global namespaces are evicted only once it
+    // finished.
+    std::uint64_t m_lastGlobalFlushTicket = 0;
+    // True when storage holds global changes the snapshot file does not have.
+    bool m_globalSnapshotStale = false;
+    // Null unless a snapshot is being written; m_globalSnapshotTicket is its current step.
+    std::shared_ptr<GlobalSnapshotBuild> m_globalSnapshotBuild;
+    std::uint64_t m_globalSnapshotTicket = 0;
+    // Index in kGlobalSnapshotPaths the snapshot is written to: never the mapped one.
+    int m_globalSnapshotSlot = 0;
+    std::chrono::steady_clock::time_point m_lastGlobalSnapshotTime;
     bool m_registered = false;
+
+    // m_writer and m_saveCollector are set once m_initState leaves Pending; m_globalCache
+    // holds only SetG values made before that. m_redoLog is set first, so those calls are
+    // logged too.
+    InitState m_initState = InitState::Pending;
+    std::condition_variable m_initChanged;
+    std::thread m_initThread;
 };
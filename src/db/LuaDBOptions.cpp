@@ -0,0 +1,308 @@
+#include "LuaDBOptions.h"
+
+#include <cwchar>
+#include <windows.h>
+#include <shellapi.h>
+#include <shlobj.h>
+
+#include "../log/log.h"
+
+namespace
+{
+// Returns the text after "<name>=" when arg is that switch, otherwise nullptr.
+const wchar_t* MatchValueArg(const wchar_t* arg, const wchar_t* name)
+{
+    const size_t length = std::wcslen(name);
+    if (_wcsnicmp(arg, name, length) != 0 || arg[length] != L'=')
+    {
+        return nullptr;
+    }
+    return arg + length + 1;
+}
+
+bool TryParseUInt32(const wchar_t* value, std::uint32_t& result)
+{
+    wchar_t* end = nullptr;
+    const unsigned long parsed = std::wcstoul(value, &end, 10);
+    if (!end || end == value || *end != L'\0' || parsed > 0xFFFFFFFFul)
+    {
+        return false;
+    }
+    result = static_cast<std::uint32_t>(parsed);
+    return true;
+}
+
+bool TryParseJournalMode(const wchar_t* value, JournalMode& mode)
+{
+    if (_wcsicmp(value, L"wal") == 0)
+    {
+        mode = JournalMode::Wal;
+        return true;
+    }
+    if (_wcsicmp(value, L"rollback") == 0)
+    {
+        mode = JournalMode::Rollback;
+        return true;
+    }
+    return false;
+}
+
+bool TryParseStorageEngine(const wchar_t* value, StorageEngineKind& engine)
+{
+    if (_wcsicmp(value, L"sqlite") == 0)
+    {
+        engine = StorageEngineKind::Sqlite;
+        return true;
+    }
+    if (_wcsicmp(value, L"log") == 0)
+    {
+        engine = StorageEngineKind::Log;
+        return true;
+    }
+    if (_wcsicmp(value, L"memory") == 0)
+    {
+        engine = StorageEngineKind::Memory;
+        return true;
+    }
+    return false;
+}
+
+bool TryParseRedoSync(const wchar_t* value, RedoSync& sync)
+{
+    if (_wcsicmp(value, L"off") == 0)
+    {
+        sync = RedoSync::Off;
+        return true;
+    }
+    if (_wcsicmp(value, L"os") == 0)
+    {
+        sync = RedoSync::Os;
+        return true;
+    }
+    if (_wcsicmp(value, L"interval") == 0)
+    {
+        sync = RedoSync::Interval;
+        return true;
+    }
+    if (_wcsicmp(value, L"always") == 0)
+    {
+        sync = RedoSync::Always;
+        return true;
+    }
+    return false;
+}
+
+bool TryParseSaveGcMode(const wchar_t* value, SaveGcMode& mode)
+{
+    if (_wcsicmp(value, L"off") == 0)
+    {
+        mode = SaveGcMode::Off;
+        return true;
+    }
+    if (_wcsicmp(value, L"dryrun") == 0)
+    {
+        mode = SaveGcMode::DryRun;
+        return true;
+    }
+    if (_wcsicmp(value, L"on") == 0)
+    {
+        mode = SaveGcMode::On;
+        return true;
+    }
+    return false;
+}
+
+std::filesystem::path DefaultSaveDir()
+{
+    PWSTR savedGames = nullptr;
+    std::filesystem::path result;
+    if (SUCCEEDED(SHGetKnownFolderPath(FOLDERID_SavedGames, 0, nullptr, &savedGames)))
+    {
+        result = std::filesystem::path(savedGames) / L"kingdomcome2";
+    }
+    CoTaskMemFree(savedGames);
+    return result;
+}
+
+LuaDBOptions ParseCommandLine()
+{
+    LuaDBOptions options;
+    options.saveDir = DefaultSaveDir();
+    int argc = 0;
+    LPWSTR* argv = CommandLineToArgvW(GetCommandLineW(), &argc);
+    if (!argv)
+    {
+        return options;
+    }
+
+    for (int i = 1; i < argc; ++i)
+    {
+        if (const wchar_t* value = MatchValueArg(argv[i], L"-kcd2dbEngine"))
+        {
+            if (!TryParseStorageEngine(value, options.engine))
+            {
+                LogWarn("Invalid -kcd2dbEngine value; using sqlite.");
+                options.engine = StorageEngineKind::Sqlite;
+            }
+        }
+        else if (const wchar_t* value = MatchValueArg(argv[i], L"-kcd2dbJournal"))
+        {
+            if (!TryParseJournalMode(value, options.journalMode))
+            {
+                LogWarn("Invalid -kcd2dbJournal value; using wal.");
+                options.journalMode = JournalMode::Wal;
+            }
+        }
+        else if (const wchar_t* value = MatchValueArg(argv[i], L"-kcd2dbCheckpointIdleMs"))
+        {
+            if (!TryParseUInt32(value, options.checkpointIdleMs))
+            {
+                LogWarn("Invalid -kcd2dbCheckpointIdleMs value; using %u.", LuaDBOptions{}.checkpointIdleMs);
+                options.checkpointIdleMs = LuaDBOptions{}.checkpointIdleMs;
+            }
+        }
+        else if (const wchar_t* value = MatchValueArg(argv[i], L"-kcd2dbWalLimitMB"))
+        {
+            if (!TryParseUInt32(value, options.walLimitMB) || options.walLimitMB == 0)
+            {
+                LogWarn("Invalid -kcd2dbWalLimitMB value; using %u.", LuaDBOptions{}.walLimitMB);
+                options.walLimitMB = LuaDBOptions{}.walLimitMB;
+            }
+        }
+        else if (const wchar_t* value = MatchValueArg(argv[i], L"-kcd2dbLoadThreads"))
+        {
+            if (!TryParseUInt32(value, options.loadThreads))
+            {
+                LogWarn("Invalid -kcd2dbLoadThreads value; using %u.", LuaDBOptions{}.loadThreads);
+                options.loadThreads = LuaDBOptions{}.loadThreads;
+            }
+        }
+        else if (const wchar_t* value = MatchValueArg(argv[i], L"-kcd2dbRedoSync"))
+        {
+            if (!TryParseRedoSync(value, options.redoSync))
+            {
+                LogWarn("Invalid -kcd2dbRedoSync value; using interval.");
+                options.redoSync = RedoSync::Interval;
+            }
+        }
+        else if (const wchar_t* value = MatchValueArg(argv[i], L"-kcd2dbRedoSyncMs"))
+        {
+            if (!TryParseUInt32(value, options.redoSyncMs) || options.redoSyncMs == 0)
+            {
+                LogWarn("Invalid -kcd2dbRedoSyncMs value; using %u.", LuaDBOptions{}.redoSyncMs);
+                options.redoSyncMs = LuaDBOptions{}.redoSyncMs;
+            }
+        }
+        else if (const wchar_t* value = MatchValueArg(argv[i], L"-kcd2dbCompressMin"))
+        {
+            if (!TryParseUInt32(value, options.compressMinBytes))
+            {
+                LogWarn("Invalid -kcd2dbCompressMin value; using %u.", LuaDBOptions{}.compressMinBytes);
+                options.compressMinBytes = LuaDBOptions{}.compressMinBytes;
+            }
+        }
+        else if (const wchar_t* value = MatchValueArg(argv[i], L"-kcd2dbLazyMin"))
+        {
+            if (!TryParseUInt32(value, options.lazyMinBytes))
+            {
+                LogWarn("Invalid -kcd2dbLazyMin value; using %u.", LuaDBOptions{}.lazyMinBytes);
+                options.lazyMinBytes = LuaDBOptions{}.lazyMinBytes;
+            }
+        }
+        else if (const wchar_t* value = MatchValueArg(argv[i], L"-kcd2dbFlushBudgetUs"))
+        {
+            if (!TryParseUInt32(value, options.flushBudgetUs))
+            {
+                LogWarn("Invalid -kcd2dbFlushBudgetUs value; using %u.", LuaDBOptions{}.flushBudgetUs);
+                options.flushBudgetUs = LuaDBOptions{}.flushBudgetUs;
+            }
+        }
+        else if (const wchar_t* value = MatchValueArg(argv[i], L"-kcd2dbSnapshotSec"))
+        {
+            if (!TryParseUInt32(value, options.globalSnapshotSec))
+            {
+                LogWarn("Invalid -kcd2dbSnapshotSec value; using %u.", LuaDBOptions{}.globalSnapshotSec);
+                options.globalSnapshotSec = LuaDBOptions{}.globalSnapshotSec;
+            }
+        }
+        else if (const wchar_t* value = MatchValueArg(argv[i], L"-kcd2dbSaveLru"))
+        {
+            if (!TryParseUInt32(value, options.saveLruSize))
+            {
+                LogWarn("Invalid -kcd2dbSaveLru value; using %u.", LuaDBOptions{}.saveLruSize);
+                options.saveLruSize = LuaDBOptions{}.saveLruSize;
+            }
+        }
+        else if (const wchar_t* value = MatchValueArg(argv[i], L"-kcd2dbCacheMB"))
+        {
+            if (!TryParseUInt32(value, options.cacheBudgetMB))
+            {
+                LogWarn("Invalid -kcd2dbCacheMB value; using %u.", LuaDBOptions{}.cacheBudgetMB);
+                options.cacheBudgetMB = LuaDBOptions{}.cacheBudgetMB;
+            }
+        }
+        else if (const wchar_t* value = MatchValueArg(argv[i], L"-kcd2dbBackupMin"))
+        {
+            if (!TryParseUInt32(value, options.backupMinutes))
+            {
+                LogWarn("Invalid -kcd2dbBackupMin value; using %u.", LuaDBOptions{}.backupMinutes);
+                options.backupMinutes = LuaDBOptions{}.backupMinutes;
+            }
+        }
+        else if (const wchar_t* value = MatchValueArg(argv[i], L"-kcd2dbBackupKeep"))
+        {
+            if (!TryParseUInt32(value, options.backupGenerations))
+            {
+                LogWarn("Invalid -kcd2dbBackupKeep value; using %u.", LuaDBOptions{}.backupGenerations);
+                options.backupGenerations = LuaDBOptions{}.backupGenerations;
+            }
+        }
+        else if (const wchar_t* value = MatchValueArg(argv[i], L"-kcd2dbChangeStreamMB"))
+        {
+            if (!TryParseUInt32(value, options.changeStreamMB))
+            {
+                LogWarn("Invalid -kcd2dbChangeStreamMB value; using %u.", LuaDBOptions{}.changeStreamMB);
+                options.changeStreamMB = LuaDBOptions{}.changeStreamMB;
+            }
+        }
+        else if (const wchar_t* value = MatchValueArg(argv[i], L"-kcd2dbChangeStreamKeep"))
+        {
+            if (!TryParseUInt32(value, options.changeStreamFiles) || options.changeStreamFiles == 0)
+            {
+                LogWarn("Invalid -kcd2dbChangeStreamKeep value; using %u.", LuaDBOptions{}.changeStreamFiles);
+                options.changeStreamFiles = LuaDBOptions{}.changeStreamFiles;
+            }
+        }
+        else if (const wchar_t* value = MatchValueArg(argv[i], L"-kcd2dbChangeStreamHours"))
+        {
+            if (!TryParseUInt32(value, options.changeStreamHours))
+            {
+                LogWarn("Invalid -kcd2dbChangeStreamHours value; using %u.", LuaDBOptions{}.changeStreamHours);
+                options.changeStreamHours = LuaDBOptions{}.changeStreamHours;
+            }
+        }
+        else if (const wchar_t* value = MatchValueArg(argv[i], L"-kcd2dbSaveGC"))
+        {
+            if (!TryParseSaveGcMode(value, options.saveGcMode))
+            {
+                // 拼写错误不应导致删除数据
+                LogWarn("Invalid -kcd2dbSaveGC value; using dryrun.");
+                options.saveGcMode = SaveGcMode::DryRun;
+            }
+        }
+        else if (const wchar_t* value = MatchValueArg(argv[i], L"-kcd2dbSaveDir"))
+        {
+            options.saveDir = value;
+        }
+    }
+
+    LocalFree(argv);
+    return options;
+}
+}
+
+const LuaDBOptions& GetLuaDBOptions()
+{
+    static const LuaDBOptions options = ParseCommandLine();
+    return options;
+}
@@ -0,0 +1,104 @@
+#pragma once
+
+#include <cstdint>
+#include <filesystem>
+
+enum class JournalMode
+{
+    Wal,
+    Rollback,
+};
+
+enum class StorageEngineKind
+{
+    Sqlite,
+    Log,
+    Memory,
+};
+
+enum class RedoSync
+{
+    // No redo log: SetG/DelG are durable after the next global flush.
+    Off,
+    // Records are handed to the OS on every call; the OS decides when they reach the disk.
+    Os,
+    // Records reach the OS on every call and are fsynced together every redoSyncMs.
+    Interval,
+    // Every call waits until its record is fsynced.
+    Always,
+};
+
+enum class SaveGcMode
+{
+    Off,
+    DryRun,
+    On,
+};
+
+// LuaDB persistence settings. Defaults can be overridden with -kcd2db* command-line switches.
+struct LuaDBOptions
+{
+    // -kcd2dbEngine=sqlite|log|memory: where LuaDB data is stored. memory persists nothing.
+    StorageEngineKind engine = StorageEngineKind::Sqlite;
+    // -kcd2dbJournal=wal|rollback
+    JournalMode journalMode = JournalMode::Wal;
+    // -kcd2dbCheckpointIdleMs=<ms>: checkpoint the WAL once the writer has been idle this long.
+    std::uint32_t checkpointIdleMs = 2000;
+    // -kcd2dbWalLimitMB=<MB>: checkpoint and truncate the WAL once it grows beyond this size.
+    std::uint32_t walLimitMB = 16;
+    // -kcd2dbCompressMin=<bytes>: store strings at least this long LZ4-compressed in SQLite.
+    // 0 disables compression of new values.
+    std::uint32_t compressMinBytes = 256;
+    // -kcd2dbLazyMin=<bytes>: string values stored with at least this many bytes are loaded
+    // from SQLite on their first read instead of with their save or the global scope.
+    // 0 loads every value eagerly.
+    std::uint32_t lazyMinBytes = 4096;
+    // -kcd2dbLoadThreads=<n>: worker threads decoding the rows of large saves and global
+    // scopes loaded from SQLite while the persistence thread reads the next ones, at most
+    // half of the logical processors. 0, the default, decodes on the persistence thread:
+    // the pool has only been measured on a single core, where it was slower.
+    std::uint32_t loadThreads = 0;
+    // -kcd2dbRedoSync=off|os|interval|always: how SetG/DelG are made durable before the next
+    // global flush (see RedoLog).
+    RedoSync redoSync = RedoSync::Interval;
+    // -kcd2dbRedoSyncMs=<ms>: group commit window of RedoSync::Interval.
+    std::uint32_t redoSyncMs = 50;
+    // -kcd2dbFlushBudgetUs=<us>: game-thread time a global flush may take per frame; larger
+    // flushes continue on the next frames. 0 prepares every flush in a single frame.
+    std::uint32_t flushBudgetUs = 500;
+    // -kcd2dbSnapshotSec=<s>: keep a memory-mapped snapshot of the global scope next to the
+    // database and hydrate the global cache from it at startup. Rewritten one namespace per
+    // persistence task once global data has been quiet for a few seconds, at most once per
+    // this long. 0 disables snapshots.
+    std::uint32_t globalSnapshotSec = 60;
+    // -kcd2dbSaveLru=<n>: keep the caches of the n saves loaded or saved most recently in
+    // memory, so loading one of them again does not read storage. 0 disables.
+    std::uint32_t saveLruSize = 4;
+    // -kcd2dbCacheMB=<MB>: memory the global and save caches may take. Namespaces that have
+    // not been used for a while and have no unsaved changes are dropped from memory beyond
+    // it, coldest first, and read again on their next use. 0 keeps everything in memory.
+    std::uint32_t cacheBudgetMB = 256;
+    // -kcd2dbBackupMin=<minutes>: copy the database to kcd2db.db.bak1 in small steps while
+    // the writer is idle, at most this often and only when it changed. 0 disables backups.
+    std::uint32_t backupMinutes = 30;
+    // -kcd2dbBackupKeep=<n>: backup generations kept, kcd2db.db.bak1 being the newest.
+    std::uint32_t backupGenerations = 3;
+    // -kcd2dbChangeStreamMB=<MB>: write every committed change to kcd2db.changes.<sequence>.log
+    // files that external tools can follow (see ChangeStream.h), starting a new file after
+    // this size. 0 disables the change stream.
+    std::uint32_t changeStreamMB = 0;
+    // -kcd2dbChangeStreamKeep=<n>: change stream files kept, including the current one.
+    std::uint32_t changeStreamFiles = 8;
+    // -kcd2dbChangeStreamHours=<h>: delete change stream files last written longer ago than
+    // this. 0 keeps them regardless of age.
+    std::uint32_t changeStreamHours = 72;
+    // -kcd2dbSaveGC=off|dryrun|on: delete stored data of saves whose file no longer exists.
+    // Only logs what would be deleted unless "on" is given explicitly.
+    SaveGcMode saveGcMode = SaveGcMode::DryRun;
+    // -kcd2dbSaveDir=<path>: where the game keeps its save files. Defaults to
+    // "Saved Games\kingdomcome2"; empty when it cannot be determined.
+    std::filesystem::path saveDir;
+};
+
+// Parsed once from the process command line.
+const LuaDBOptions& GetLuaDBOptions();
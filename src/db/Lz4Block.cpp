@@ -0,0 +1,190 @@
+#include "Lz4Block.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+namespace
+{
+constexpr std::size_t kMinMatch = 4;
+// 格式要求：最后 5 个字节必须是字面量，最后一个匹配至少在结尾前 12 字节开始
+constexpr std::size_t kLastLiterals = 5;
+constexpr std::size_t kMatchFindLimit = 12;
+constexpr std::size_t kMaxOffset = 65535;
+constexpr int kHashLog = 12;
+// 连续未命中时逐渐加大步长，不可压缩的数据很快跳过
+constexpr int kSkipStrength = 6;
+
+std::uint32_t Read32(const char* p)
+{
+    std::uint32_t value;
+    std::memcpy(&value, p, sizeof(value));
+    return value;
+}
+
+std::uint32_t Hash(const std::uint32_t sequence)
+{
+    return (sequence * 2654435761u) >> (32 - kHashLog);
+}
+
+void PutLength(std::string& out, std::size_t length)
+{
+    for (; length >= 255; length -= 255)
+    {
+        out.push_back(static_cast<char>(255));
+    }
+    out.push_back(static_cast<char>(length));
+}
+
+void PutSequence(std::string& out, const char* literals, const std::size_t literalLength, const std::size_t offset, const std::size_t matchLength)
+{
+    const std::size_t matchCode = matchLength - kMinMatch;
+    out.push_back(static_cast<char>((std::min<std::size_t>(literalLength, 15) << 4) | std::min<std::size_t>(matchCode, 15)));
+    if (literalLength >= 15)
+    {
+        PutLength(out, literalLength - 15);
+    }
+    out.append(literals, literalLength);
+    out.push_back(static_cast<char>(offset & 0xFF));
+    out.push_back(static_cast<char>(offset >> 8));
+    if (matchCode >= 15)
+    {
+        PutLength(out, matchCode - 15);
+    }
+}
+
+void PutLastLiterals(std::string& out, const char* literals, const std::size_t literalLength)
+{
+    out.push_back(static_cast<char>(std::min<std::size_t>(literalLength, 15) << 4));
+    if (literalLength >= 15)
+    {
+        PutLength(out, literalLength - 15);
+    }
+    out.append(literals, literalLength);
+}
+
+bool GetLength(const unsigned char*& ip, const unsigned char* end, std::size_t& length)
+{
+    unsigned char byte;
+    do
+    {
+        if (ip == end)
+        {
+            return false;
+        }
+        byte = *ip++;
+        length += byte;
+    }
+    while (byte == 255);
+    return true;
+}
+}
+
+void Lz4Block::Compress(const std::string_view input, std::string& out)
+{
+    const char* const base = input.data();
+    const std::size_t size = input.size();
+    out.reserve(out.size() + CompressBound(size));
+    std::size_t anchor = 0;
+    if (size > kMatchFindLimit)
+    {
+        // 位置加 1 保存，0 表示空槽
+        std::vector<std::uint32_t> table(std::size_t{1} << kHashLog, 0);
+        const std::size_t matchLimit = size - kLastLiterals;
+        const std::size_t lastMatchStart = size - kMatchFindLimit;
+        std::size_t pos = 0;
+        std::size_t misses = 1u << kSkipStrength;
+        while (pos <= lastMatchStart)
+        {
+            const std::uint32_t sequence = Read32(base + pos);
+            std::uint32_t& slot = table[Hash(sequence)];
+            const std::size_t candidate = slot;
+            slot = static_cast<std::uint32_t>(pos + 1);
+            if (candidate == 0 || pos - (candidate - 1) > kMaxOffset || Read32(base + candidate - 1) != sequence)
+            {
+                pos += misses++ >> kSkipStrength;
+                continue;
+            }
+
+            std::size_t match = candidate - 1;
+            // 向前扩展匹配，吸收前面的字面量
+            while (pos > anchor && match > 0 && base[pos - 1] == base[match - 1])
+            {
+                --pos;
+                --match;
+            }
+            std::size_t length = kMinMatch;
+            while (pos + length < matchLimit && base[match + length] == base[pos + length])
+            {
+                ++length;
+            }
+            PutSequence(out, base + anchor, pos - anchor, pos - match, length);
+            pos += length;
+            anchor = pos;
+            misses = 1u << kSkipStrength;
+        }
+    }
+    PutLastLiterals(out, base + anchor, size - anchor);
+}
+
+bool Lz4Block::Decompress(const std::string_view block, char* const out, const std::size_t outSize)
+{
+    const auto* ip = reinterpret_cast<const unsigned char*>(block.data());
+    const unsigned char* const end = ip + block.size();
+    std::size_t written = 0;
+    while (ip < end)
+    {
+        const unsigned char token = *ip++;
+        std::size_t literalLength = token >> 4;
+        if (literalLength == 15 && !GetLength(ip, end, literalLength))
+        {
+            return false;
+        }
+        if (literalLength > static_cast<std::size_t>(end - ip) || literalLength > outSize - written)
+        {
+            return false;
+        }
+        std::memcpy(out + written, ip, literalLength);
+        ip += literalLength;
+        written += literalLength;
+        if (ip == end)
+        {
+            // 块以字面量结束
+            break;
+        }
+
+        if (end - ip < 2)
+        {
+            return false;
+        }
+        const std::size_t offset = ip[0] | (static_cast<std::size_t>(ip[1]) << 8);
+        ip += 2;
+        std::size_t matchLength = token & 0x0F;
+        if (matchLength == 15 && !GetLength(ip, end, matchLength))
+        {
+            return false;
+        }
+        matchLength += kMinMatch;
+        if (offset == 0 || offset > written || matchLength > outSize - written)
+        {
+            return false;
+        }
+        char* dst = out + written;
+        const char* src = dst - offset;
+        if (offset >= matchLength)
+        {
+            std::memcpy(dst, src, matchLength);
+        }
+        else
+        {
+            // 重叠复制：逐字节展开重复的模式
+            for (std::size_t i = 0; i < matchLength; ++i)
+            {
+                dst[i] = src[i];
+            }
+        }
+        written += matchLength;
+    }
+    return written == outSize;
+}
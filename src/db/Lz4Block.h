@@ -0,0 +1,31 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+#include <string_view>
+
+// The LZ4 block format (no frame header, no checksum): literal runs and back references
+// into a 64 KB window. Compression uses a single hash probe per position, trading ratio for
+// speed; any conforming LZ4 decoder reads its output and Decompress reads any LZ4 block.
+namespace Lz4Block
+{
+// Largest compressed size of size input bytes.
+constexpr std::size_t CompressBound(const std::size_t size)
+{
+    return size + size / 255 + 16;
+}
+
+// Largest decompressed size of a size-byte block: a match token expands to at most 255
+// times its length, so a claimed size above this marks the block as corrupt.
+constexpr std::size_t MaxDecompressedSize(const std::size_t size)
+{
+    return size * 255;
+}
+
+// Appends the compressed form of input to out.
+void Compress(std::string_view input, std::string& out);
+
+// Decompresses block into exactly outSize bytes at out. Returns false when block is
+// malformed or does not decode to outSize bytes.
+bool Decompress(std::string_view block, char* out, std::size_t outSize);
+}
@@ -0,0 +1,84 @@
+#include "MemoryEngine.h"
+
+#include <algorithm>
+
+void MemoryEngine::LoadScope(const std::string& savefile, ValueMap& out)
+{
+    if (const auto it = m_scopes.find(savefile); it != m_scopes.end())
+    {
+        for (const auto& [k, v] : it->second.entries)
+        {
+            out.emplace(k, v);
+        }
+    }
+}
+
+std::string MemoryEngine::LatestSave()
+{
+    const Scope* latest = nullptr;
+    const std::string* latestName = nullptr;
+    for (const auto& [name, scope] : m_scopes)
+    {
+        if (!name.empty() && !scope.entries.empty() && (!latest || scope.version > latest->version))
+        {
+            latest = &scope;
+            latestName = &name;
+        }
+    }
+    return latestName ? *latestName : std::string();
+}
+
+BatchResult MemoryEngine::ApplyBatch(const GlobalBatch& batch)
+{
+    BatchResult result;
+    Scope& global = m_scopes[std::string()];
+    for (const auto& k : batch.deletes)
+    {
+        result.deleted += global.entries.erase(k);
+    }
+    for (const auto& [k, v] : batch.upserts)
+    {
+        global.entries.insert_or_assign(k, v);
+        result.upserted++;
+    }
+    return result;
+}
+
+void MemoryEngine::SnapshotSave(const std::string& savefile, const ValueMap& entries)
+{
+    PutScope(savefile, entries, NextVersion());
+}
+
+void MemoryEngine::PutScope(const std::string& savefile, ValueMap entries, const std::int64_t version)
+{
+    Scope& scope = m_scopes[savefile];
+    scope.entries = std::move(entries);
+    scope.version = version;
+    m_lastVersion = std::max(m_lastVersion, version);
+}
+
+std::vector<StoredSave> MemoryEngine::ListSaves()
+{
+    std::vector<StoredSave> saves;
+    for (const auto& [name, scope] : m_scopes)
+    {
+        if (!name.empty())
+        {
+            saves.push_back({name, scope.entries.size(), scope.version});
+        }
+    }
+    return saves;
+}
+
+std::uint64_t MemoryEngine::DeleteScope(const StoredSave& save, std::uint32_t /*maxEntries*/)
+{
+    // 内存中删除整个作用域的代价与条目数无关，一次完成
+    const auto it = m_scopes.find(save.savefile);
+    if (save.savefile.empty() || it == m_scopes.end() || it->second.version != save.version)
+    {
+        return 0;
+    }
+    const std::uint64_t deleted = it->second.entries.size();
+    m_scopes.erase(it);
+    return deleted;
+}
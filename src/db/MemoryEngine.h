@@ -0,0 +1,39 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+
+#include "StorageEngine.h"
+
+// Keeps every scope in memory and persists nothing. Used with -kcd2dbEngine=memory for
+// sessions that must not touch the disk, as the baseline in storage benchmarks, and as the
+// in-memory state of LogEngine.
+class MemoryEngine : public StorageEngine
+{
+public:
+    const char* name() const override { return "memory"; }
+
+    void LoadScope(const std::string& savefile, ValueMap& out) override;
+    std::string LatestSave() override;
+    BatchResult ApplyBatch(const GlobalBatch& batch) override;
+    void SnapshotSave(const std::string& savefile, const ValueMap& entries) override;
+    std::vector<StoredSave> ListSaves() override;
+    std::uint64_t DeleteScope(const StoredSave& save, std::uint32_t maxEntries) override;
+
+protected:
+    struct Scope
+    {
+        ValueMap entries;
+        // Increases with every snapshot; StoredSave::version.
+        std::int64_t version = 0;
+    };
+
+    // Replaces savefile with entries under the given version, as SnapshotSave does.
+    void PutScope(const std::string& savefile, ValueMap entries, std::int64_t version);
+    std::int64_t NextVersion() { return ++m_lastVersion; }
+
+    // The global scope is stored under the empty name.
+    std::unordered_map<std::string, Scope> m_scopes;
+    std::int64_t m_lastVersion = 0;
+};
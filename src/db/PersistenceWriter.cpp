@@ -0,0 +1,180 @@
+#include "PersistenceWriter.h"
+
+#include "../log/log.h"
+
+namespace
+{
+// Pause between consecutive idle steps while the queue stays empty.
+constexpr auto kIdleStepInterval = std::chrono::milliseconds(50);
+}
+
+PersistenceWriter::PersistenceWriter(std::unique_ptr<StorageEngine> engine, const std::chrono::milliseconds idleDelay) :
+    m_engine(std::move(engine)),
+    m_idleDelay(idleDelay)
+{
+    m_thread = std::thread(&PersistenceWriter::ThreadMain, this);
+}
+
+PersistenceWriter::~PersistenceWriter()
+{
+    {
+        std::lock_guard lock(m_queueMutex);
+        m_stopping = true;
+    }
+    m_queueChanged.notify_one();
+    if (m_thread.joinable())
+    {
+        m_thread.join();
+    }
+}
+
+std::uint64_t PersistenceWriter::Submit(const char* label, Task task)
+{
+    std::uint64_t ticket = 0;
+    {
+        std::lock_guard lock(m_queueMutex);
+        ticket = ++m_lastTicket;
+        m_queue.push_back(Job{ticket, label, std::move(task)});
+    }
+    m_queueChanged.notify_one();
+    return ticket;
+}
+
+void PersistenceWriter::Wait(const std::uint64_t ticket)
+{
+    std::unique_lock lock(m_queueMutex);
+    m_jobFinished.wait(lock, [this, ticket] { return m_completedTicket >= ticket; });
+}
+
+bool PersistenceWriter::Finished(const std::uint64_t ticket)
+{
+    std::lock_guard lock(m_queueMutex);
+    return m_completedTicket >= ticket;
+}
+
+void PersistenceWriter::WaitIdle()
+{
+    std::uint64_t ticket = 0;
+    {
+        std::lock_guard lock(m_queueMutex);
+        ticket = m_lastTicket;
+    }
+    Wait(ticket);
+}
+
+void PersistenceWriter::Run(const Task& task)
+{
+    WaitIdle();
+    std::lock_guard engineLock(m_engineMutex);
+    task(*m_engine);
+}
+
+void PersistenceWriter::RequestMaintenance()
+{
+    {
+        std::lock_guard lock(m_queueMutex);
+        m_maintenanceRequested = true;
+    }
+    m_queueChanged.notify_one();
+}
+
+void PersistenceWriter::ThreadMain()
+{
+    LogDebug("Persistence writer thread started (%s engine).", m_engine->name());
+    while (true)
+    {
+        Job job;
+        bool maintenance = false;
+        bool idle = false;
+        bool idleWork = m_idleContinuing;
+        if (!idleWork)
+        {
+            std::lock_guard engineLock(m_engineMutex);
+            idleWork = m_engine->HasIdleWork();
+        }
+        {
+            std::unique_lock lock(m_queueMutex);
+            const auto ready = [this] { return m_stopping || m_maintenanceRequested || !m_queue.empty(); };
+            if (idleWork)
+            {
+                idle = !m_queueChanged.wait_for(lock, m_idleContinuing ? kIdleStepInterval : m_idleDelay, ready);
+            }
+            else
+            {
+                m_queueChanged.wait(lock, ready);
+            }
+            if (m_maintenanceRequested && m_queue.empty())
+            {
+                m_maintenanceRequested = false;
+                maintenance = true;
+            }
+            if (!maintenance && !idle)
+            {
+                if (m_queue.empty())
+                {
+                    break;
+                }
+                job = std::move(m_queue.front());
+                m_queue.pop_front();
+            }
+        }
+
+        if (maintenance || idle)
+        {
+            try
+            {
+                std::lock_guard engineLock(m_engineMutex);
+                if (maintenance)
+                {
+                    m_engine->OnMaintenanceWindow();
+                }
+                if (idle)
+                {
+                    m_idleContinuing = m_engine->Idle();
+                }
+            }
+            catch (const std::exception& e)
+            {
+                LogError("Storage maintenance failed: %s", e.what());
+                m_idleContinuing = false;
+            }
+            continue;
+        }
+
+        const auto start = std::chrono::steady_clock::now();
+        try
+        {
+            std::lock_guard engineLock(m_engineMutex);
+            job.task(*m_engine);
+            const auto elapsed = std::chrono::duration_cast<std::chrono::microseconds>(
+                std::chrono::steady_clock::now() - start).count();
+            LogDebug("%s committed on persistence thread in %lld us.", job.label, static_cast<long long>(elapsed));
+        }
+        catch (const std::exception& e)
+        {
+            LogError("%s failed: %s", job.label, e.what());
+        }
+        catch (...)
+        {
+            LogError("%s failed: Unknown error", job.label);
+        }
+
+        try
+        {
+            std::lock_guard engineLock(m_engineMutex);
+            m_engine->AfterTask();
+        }
+        catch (const std::exception& e)
+        {
+            LogError("Storage maintenance after %s failed: %s", job.label, e.what());
+        }
+        m_idleContinuing = false;
+
+        {
+            std::lock_guard lock(m_queueMutex);
+            m_completedTicket = job.ticket;
+        }
+        m_jobFinished.notify_all();
+    }
+    LogDebug("Persistence writer thread stopped.");
+}
@@ -0,0 +1,67 @@
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+#include "StorageEngine.h"
+
+// Owns the storage engine and runs every write on a dedicated thread, so the game thread
+// only hands over immutable snapshots and never waits on fsync. Tasks run in submission
+// order; Run() waits for all earlier tasks before touching the engine, which keeps reads
+// ordered after the writes that precede them. Once the queue has been idle for idleDelay
+// the thread gives the engine time for background maintenance.
+class PersistenceWriter final
+{
+public:
+    using Task = std::function<void(StorageEngine&)>;
+
+    PersistenceWriter(std::unique_ptr<StorageEngine> engine, std::chrono::milliseconds idleDelay);
+    ~PersistenceWriter();
+    PersistenceWriter(const PersistenceWriter&) = delete;
+    PersistenceWriter& operator=(const PersistenceWriter&) = delete;
+
+    // Queues a task. label is used in logs and must outlive the task (string literals only).
+    std::uint64_t Submit(const char* label, Task task);
+    // Blocks until the task with the given ticket, and every task before it, finished.
+    void Wait(std::uint64_t ticket);
+    // Non-blocking: whether the task with the given ticket, and every task before it, finished.
+    bool Finished(std::uint64_t ticket);
+    void WaitIdle();
+    // Runs task on the calling thread after all queued tasks finished.
+    void Run(const Task& task);
+    // Tells the engine, as soon as no task is queued, that writes will be rare for a while
+    // (for example on a loading screen).
+    void RequestMaintenance();
+
+private:
+    struct Job
+    {
+        std::uint64_t ticket = 0;
+        const char* label = nullptr;
+        Task task;
+    };
+
+    void ThreadMain();
+
+    std::unique_ptr<StorageEngine> m_engine;
+    // Held while a queued task, Run() or maintenance uses m_engine.
+    std::mutex m_engineMutex;
+    std::mutex m_queueMutex;
+    std::condition_variable m_queueChanged;
+    std::condition_variable m_jobFinished;
+    std::deque<Job> m_queue;
+    std::uint64_t m_lastTicket = 0;
+    std::uint64_t m_completedTicket = 0;
+    bool m_stopping = false;
+    bool m_maintenanceRequested = false;
+    std::chrono::milliseconds m_idleDelay;
+    // Writer thread only: the engine asked for its next idle step to follow shortly.
+    bool m_idleContinuing = false;
+    std::thread m_thread;
+};
@@ -0,0 +1,375 @@
+#include "RecordLog.h"
+
+#include <stdexcept>
+#include <system_error>
+#include <utility>
+#include <vector>
+
+#ifdef _WIN32
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+
+#include "ContentHash.h"
+#include "../log/log.h"
+
+namespace
+{
+// Records larger than this are treated as corruption instead of being allocated.
+constexpr std::uint32_t kMaxRecordBytes = 256u * 1024 * 1024;
+
+std::FILE* OpenFile(const std::filesystem::path& path, const char* mode)
+{
+#ifdef _WIN32
+    const std::wstring wideMode(mode, mode + std::strlen(mode));
+    return _wfopen(path.c_str(), wideMode.c_str());
+#else
+    return std::fopen(path.c_str(), mode);
+#endif
+}
+
+void FlushFile(std::FILE* file)
+{
+    if (std::fflush(file) != 0)
+    {
+        throw std::runtime_error("flush failed");
+    }
+}
+
+void SyncDescriptor(std::FILE* file)
+{
+#ifdef _WIN32
+    const int rc = _commit(_fileno(file));
+#else
+    const int rc = fsync(fileno(file));
+#endif
+    if (rc != 0)
+    {
+        throw std::runtime_error("fsync failed");
+    }
+}
+
+void SyncFile(std::FILE* file)
+{
+    FlushFile(file);
+    SyncDescriptor(file);
+}
+
+std::uint32_t Checksum(const std::string_view payload)
+{
+    return static_cast<std::uint32_t>(ContentHash::Hash64(payload));
+}
+
+void WriteRecord(std::FILE* file, const std::string_view payload)
+{
+    const std::uint32_t header[2] = {static_cast<std::uint32_t>(payload.size()), Checksum(payload)};
+    if (std::fwrite(header, sizeof(header), 1, file) != 1
+        || (!payload.empty() && std::fwrite(payload.data(), payload.size(), 1, file) != 1))
+    {
+        throw std::runtime_error("write failed");
+    }
+}
+
+std::string PathToUtf8(const std::filesystem::path& path)
+{
+    const auto text = path.u8string();
+    return {text.begin(), text.end()};
+}
+}
+
+void RecordWriter::PutValue(const ScriptValue& value)
+{
+    PutU8(static_cast<std::uint8_t>(value.storeType()));
+    switch (value.type())
+    {
+    case ScriptValue::Type::BOOL:
+        PutU8(value.as_bool() ? 1 : 0);
+        break;
+    case ScriptValue::Type::NUMBER:
+        PutF32(value.as_number());
+        break;
+    case ScriptValue::Type::STRING:
+        PutString(value.as_string());
+        break;
+    case ScriptValue::Type::BLOB_REF:
+        // 日志只记录 SetG 和存档写入的值，其中不会有 SqliteEngine 的 BlobRef
+        throw std::logic_error("unresolved BlobRef cannot be logged");
+    }
+}
+
+bool RecordReader::GetRaw(void* out, const std::size_t size)
+{
+    if (!m_ok || m_data.size() - m_offset < size)
+    {
+        m_ok = false;
+        return false;
+    }
+    std::memcpy(out, m_data.data() + m_offset, size);
+    m_offset += size;
+    return true;
+}
+
+bool RecordReader::GetString(std::string& value)
+{
+    std::uint32_t length = 0;
+    if (!GetU32(length) || m_data.size() - m_offset < length)
+    {
+        m_ok = false;
+        return false;
+    }
+    value.assign(m_data.data() + m_offset, length);
+    m_offset += length;
+    return true;
+}
+
+bool RecordReader::GetValue(ScriptValue& value)
+{
+    std::uint8_t type = 0;
+    if (!GetU8(type))
+    {
+        return false;
+    }
+    switch (type)
+    {
+    case StoreValueType::kBool:
+        {
+            std::uint8_t b = 0;
+            if (!GetU8(b))
+            {
+                return false;
+            }
+            value = ScriptValue(b != 0);
+            return true;
+        }
+    case StoreValueType::kNumber:
+        {
+            float f = 0;
+            if (!GetF32(f))
+            {
+                return false;
+            }
+            value = ScriptValue(f);
+            return true;
+        }
+    case StoreValueType::kString:
+        {
+            std::string s;
+            if (!GetString(s))
+            {
+                return false;
+            }
+            value = ScriptValue(std::move(s));
+            return true;
+        }
+    default:
+        m_ok = false;
+        return false;
+    }
+}
+
+RecordLog::ReadResult RecordLog::Read(const std::filesystem::path& path,
+                                      const std::string_view magic,
+                                      const RecordHandler& handler,
+                                      const std::uint64_t offset)
+{
+    ReadResult result;
+    std::FILE* in = OpenFile(path, "rb");
+    if (!in)
+    {
+        return result;
+    }
+    std::string header(magic.size(), '\0');
+    // 只写了一部分的文件头视为空文件
+    if (std::fread(header.data(), 1, header.size(), in) == header.size())
+    {
+        if (header != magic)
+        {
+            std::fclose(in);
+            throw std::runtime_error("not a LuaDB log file: " + PathToUtf8(path));
+        }
+        result.validBytes = magic.size();
+        if (offset > result.validBytes)
+        {
+            if (std::fseek(in, static_cast<long>(offset), SEEK_SET) != 0)
+            {
+                std::fclose(in);
+                throw std::runtime_error("cannot seek in " + PathToUtf8(path));
+            }
+            result.validBytes = offset;
+        }
+        std::string payload;
+        std::uint32_t recordHeader[2] = {};
+        while (std::fread(recordHeader, sizeof(recordHeader), 1, in) == 1 && recordHeader[0] <= kMaxRecordBytes)
+        {
+            payload.resize(recordHeader[0]);
+            if ((!payload.empty() && std::fread(payload.data(), payload.size(), 1, in) != 1)
+                || Checksum(payload) != recordHeader[1])
+            {
+                break;
+            }
+            try
+            {
+                handler(payload);
+            }
+            catch (...)
+            {
+                std::fclose(in);
+                throw;
+            }
+            result.validBytes += sizeof(recordHeader) + payload.size();
+            ++result.records;
+        }
+    }
+    std::fseek(in, 0, SEEK_END);
+    result.fileBytes = static_cast<std::uint64_t>(std::ftell(in));
+    std::fclose(in);
+    return result;
+}
+
+RecordLog::RecordLog(std::filesystem::path path, const std::string_view magic, const RecordHandler& replay) :
+    m_path(std::move(path)),
+    m_magic(magic)
+{
+    const ReadResult read = Read(m_path, m_magic, replay);
+    std::uint64_t validBytes = read.validBytes;
+    const std::uint64_t fileBytes = read.fileBytes;
+    m_records = read.records;
+
+    if (fileBytes > validBytes && validBytes > 0)
+    {
+        // 崩溃时最后一条记录可能只写了一半，截掉它之后的所有内容
+        LogWarn("LuaDB log %s: discarding %llu bytes after the last intact record.",
+                PathToUtf8(m_path).c_str(),
+                static_cast<unsigned long long>(fileBytes - validBytes));
+        std::filesystem::resize_file(m_path, validBytes);
+    }
+    OpenForAppend();
+    if (validBytes == 0)
+    {
+        std::error_code ec;
+        std::filesystem::resize_file(m_path, 0, ec);
+        if (std::fwrite(m_magic.data(), m_magic.size(), 1, m_file) != 1)
+        {
+            throw std::runtime_error("cannot write " + PathToUtf8(m_path));
+        }
+        SyncFile(m_file);
+        validBytes = m_magic.size();
+    }
+    m_size = validBytes;
+}
+
+RecordLog::~RecordLog()
+{
+    if (m_file)
+    {
+        std::fclose(m_file);
+    }
+}
+
+void RecordLog::OpenForAppend()
+{
+    m_file = OpenFile(m_path, "ab");
+    if (!m_file)
+    {
+        throw std::runtime_error("cannot open " + PathToUtf8(m_path));
+    }
+}
+
+void RecordLog::Append(const std::string_view payload)
+{
+    WriteRecord(m_file, payload);
+    m_size += 2 * sizeof(std::uint32_t) + payload.size();
+    ++m_records;
+}
+
+void RecordLog::Flush()
+{
+    FlushFile(m_file);
+}
+
+void RecordLog::Sync()
+{
+    SyncFile(m_file);
+}
+
+void RecordLog::SyncFlushed()
+{
+    SyncDescriptor(m_file);
+}
+
+void RecordLog::Rewrite(const std::function<void(const RecordSink&)>& writeRecords)
+{
+    auto replacement = BeginRewrite(writeRecords);
+    FinishRewrite(replacement, [](const RecordSink&) {});
+}
+
+RecordLog::Replacement::~Replacement()
+{
+    if (m_file)
+    {
+        std::fclose(m_file);
+        std::error_code ec;
+        std::filesystem::remove(m_path, ec);
+    }
+}
+
+RecordLog::Replacement::Replacement(Replacement&& other) noexcept :
+    m_path(std::move(other.m_path)),
+    m_file(std::exchange(other.m_file, nullptr)),
+    m_size(other.m_size),
+    m_records(other.m_records)
+{
+}
+
+RecordLog::Replacement RecordLog::BeginRewrite(const std::function<void(const RecordSink&)>& writeRecords) const
+{
+    Replacement replacement;
+    replacement.m_path = m_path;
+    replacement.m_path += ".tmp";
+    replacement.m_file = OpenFile(replacement.m_path, "wb");
+    if (!replacement.m_file)
+    {
+        throw std::runtime_error("cannot create " + PathToUtf8(replacement.m_path));
+    }
+    // 出错时由 Replacement 的析构关闭并删除临时文件
+    if (std::fwrite(m_magic.data(), m_magic.size(), 1, replacement.m_file) != 1)
+    {
+        throw std::runtime_error("write failed");
+    }
+    replacement.m_size = m_magic.size();
+    writeRecords([&](const std::string_view payload)
+    {
+        WriteRecord(replacement.m_file, payload);
+        replacement.m_size += 2 * sizeof(std::uint32_t) + payload.size();
+        ++replacement.m_records;
+    });
+    SyncFile(replacement.m_file);
+    return replacement;
+}
+
+void RecordLog::FinishRewrite(Replacement& replacement, const std::function<void(const RecordSink&)>& writeTail)
+{
+    writeTail([&](const std::string_view payload)
+    {
+        WriteRecord(replacement.m_file, payload);
+        replacement.m_size += 2 * sizeof(std::uint32_t) + payload.size();
+        ++replacement.m_records;
+    });
+    FlushFile(replacement.m_file);
+    std::fclose(std::exchange(replacement.m_file, nullptr));
+
+    // 新文件已完整写入后再替换；末尾追加的记录与原文件中的一样，尚待下次 Sync 落盘
+    std::fclose(m_file);
+    m_file = nullptr;
+    std::error_code ec;
+    std::filesystem::rename(replacement.m_path, m_path, ec);
+    OpenForAppend();
+    if (ec)
+    {
+        std::filesystem::remove(replacement.m_path, ec);
+        throw std::runtime_error("cannot replace " + PathToUtf8(m_path));
+    }
+    m_size = replacement.m_size;
+    m_records = replacement.m_records;
+}
@@ -0,0 +1,151 @@
+#pragma once
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <functional>
+#include <string>
+#include <string_view>
+
+#include "ScriptValue.h"
+
+// Builds the payload of one log record. Integers are little-endian, strings are prefixed
+// with their u32 length.
+class RecordWriter final
+{
+public:
+    void PutU8(const std::uint8_t value) { m_buffer.push_back(static_cast<char>(value)); }
+    void PutU32(const std::uint32_t value) { PutRaw(&value, sizeof(value)); }
+    void PutI64(const std::int64_t value) { PutRaw(&value, sizeof(value)); }
+    void PutF32(const float value) { PutRaw(&value, sizeof(value)); }
+    void PutString(const std::string_view value)
+    {
+        PutU32(static_cast<std::uint32_t>(value.size()));
+        m_buffer.append(value);
+    }
+    // u8 StoreValueType, then u8 for bool, f32 for number or a string.
+    void PutValue(const ScriptValue& value);
+
+    const std::string& data() const { return m_buffer; }
+    void Clear() { m_buffer.clear(); }
+
+private:
+    void PutRaw(const void* data, const std::size_t size) { m_buffer.append(static_cast<const char*>(data), size); }
+
+    std::string m_buffer;
+};
+
+// Reads a payload written by RecordWriter. Every getter returns false once the payload is
+// exhausted or malformed, and keeps returning false afterwards.
+class RecordReader final
+{
+public:
+    explicit RecordReader(const std::string_view data) : m_data(data) {}
+
+    bool GetU8(std::uint8_t& value) { return GetRaw(&value, sizeof(value)); }
+    bool GetU32(std::uint32_t& value) { return GetRaw(&value, sizeof(value)); }
+    bool GetI64(std::int64_t& value) { return GetRaw(&value, sizeof(value)); }
+    bool GetF32(float& value) { return GetRaw(&value, sizeof(value)); }
+    bool GetString(std::string& value);
+    bool GetValue(ScriptValue& value);
+
+    bool done() const { return m_ok && m_offset == m_data.size(); }
+
+private:
+    bool GetRaw(void* out, std::size_t size);
+
+    std::string_view m_data;
+    std::size_t m_offset = 0;
+    bool m_ok = true;
+};
+
+// An append-only file of checksummed records behind a magic header:
+//   u32 payload length, u32 checksum (low half of XXH64 of the payload), payload.
+// Opening replays every intact record and cuts off a torn or corrupt tail, which is what
+// a crash in the middle of Append leaves behind. Not thread-safe unless noted.
+class RecordLog final
+{
+public:
+    using RecordHandler = std::function<void(std::string_view payload)>;
+    using RecordSink = std::function<void(std::string_view payload)>;
+
+    struct ReadResult
+    {
+        // Magic plus every intact record; 0 when the file is missing or has no complete header.
+        std::uint64_t validBytes = 0;
+        std::uint64_t fileBytes = 0;
+        std::uint64_t records = 0;
+    };
+
+    // Calls handler for every intact record of path without modifying the file. Throws when
+    // the file does not start with magic. A non-zero offset must be the validBytes of an
+    // earlier Read of the same file; reading resumes there, so a file that is still being
+    // appended to can be followed without reading it again from the start.
+    static ReadResult Read(const std::filesystem::path& path,
+                           std::string_view magic,
+                           const RecordHandler& handler,
+                           std::uint64_t offset = 0);
+
+    // Creates path when it does not exist. magic must be 8 bytes. Throws when the file
+    // cannot be opened or does not start with magic.
+    RecordLog(std::filesystem::path path, std::string_view magic, const RecordHandler& replay);
+    ~RecordLog();
+    RecordLog(const RecordLog&) = delete;
+    RecordLog& operator=(const RecordLog&) = delete;
+
+    // Buffers one record; it is durable after the next Sync().
+    void Append(std::string_view payload);
+    // Hands buffered records to the OS: they survive a crash of the process, not of the system.
+    void Flush();
+    // Flushes buffered records and fsyncs the file.
+    void Sync();
+    // Fsyncs what Flush() already handed to the OS. Unlike the other methods it may run
+    // concurrently with Append/Flush, but not with Rewrite or destruction.
+    void SyncFlushed();
+    // Atomically replaces the file with the records emitted by writeRecords, then keeps
+    // appending to the new file.
+    void Rewrite(const std::function<void(const RecordSink&)>& writeRecords);
+
+    // The replacement file of a rewrite split in two steps. Discarded unless finished.
+    class Replacement final
+    {
+    public:
+        Replacement() = default;
+        ~Replacement();
+        Replacement(Replacement&& other) noexcept;
+        Replacement& operator=(Replacement&&) = delete;
+        Replacement(const Replacement&) = delete;
+        Replacement& operator=(const Replacement&) = delete;
+
+    private:
+        friend class RecordLog;
+
+        std::filesystem::path m_path;
+        std::FILE* m_file = nullptr;
+        std::uint64_t m_size = 0;
+        std::uint64_t m_records = 0;
+    };
+
+    // Rewrite in two steps, so that the slow part can run while another thread keeps
+    // appending under its own lock. BeginRewrite writes and fsyncs the records emitted by
+    // writeRecords to a file next to the log; it only reads the log's path and may run
+    // concurrently with Append/Flush. FinishRewrite adds the records emitted by writeTail,
+    // hands them to the OS without an fsync, and replaces the file like Rewrite does.
+    Replacement BeginRewrite(const std::function<void(const RecordSink&)>& writeRecords) const;
+    void FinishRewrite(Replacement& replacement, const std::function<void(const RecordSink&)>& writeTail);
+
+    // Bytes in the file, including records not synced yet.
+    std::uint64_t size() const { return m_size; }
+    std::uint64_t recordCount() const { return m_records; }
+    const std::filesystem::path& path() const { return m_path; }
+
+private:
+    void OpenForAppend();
+
+    std::filesystem::path m_path;
+    std::string m_magic;
+    std::FILE* m_file = nullptr;
+    std::uint64_t m_size = 0;
+    std::uint64_t m_records = 0;
+};
@@ -0,0 +1,314 @@
+#include "RedoLog.h"
+
+#include <algorithm>
+#include <optional>
+#include <stdexcept>
+
+#include "../log/log.h"
+
+namespace
+{
+constexpr std::string_view kRedoMagic = "KCDBRDO1";
+}
+
+RedoLog::RedoLog(Options options) :
+    m_options(std::move(options))
+{
+    std::uint64_t pending = 0;
+    m_log = std::make_unique<RecordLog>(m_options.path, kRedoMagic, [this, &pending](const std::string_view payload)
+    {
+        std::uint64_t sequence = 0;
+        std::string key;
+        ScriptValue value;
+        bool deleted = false;
+        if (!Decode(payload, sequence, key, value, deleted))
+        {
+            throw std::runtime_error("malformed LuaDB redo record");
+        }
+        m_lastSequence = std::max(m_lastSequence, sequence);
+        ++pending;
+    });
+    m_flushedSequence = m_syncedSequence = m_compactedSequence = m_lastSequence;
+    LogDebug("LuaDB redo log opened: %llu records to replay, sync=%s.",
+             static_cast<unsigned long long>(pending),
+             m_options.sync == RedoSync::Always ? "always" : m_options.sync == RedoSync::Interval ? "interval" : "os");
+    m_thread = std::thread(&RedoLog::ThreadMain, this);
+}
+
+RedoLog::~RedoLog()
+{
+    {
+        std::lock_guard lock(m_mutex);
+        m_stopping = true;
+    }
+    m_changed.notify_one();
+    m_synced.notify_all();
+    if (m_thread.joinable())
+    {
+        m_thread.join();
+    }
+    try
+    {
+        if (!m_failed)
+        {
+            m_log->Sync();
+        }
+    }
+    catch (const std::exception& e)
+    {
+        LogError("LuaDB redo log sync failed: %s", e.what());
+    }
+}
+
+bool RedoLog::Decode(const std::string_view payload,
+                     std::uint64_t& sequence,
+                     std::string& key,
+                     ScriptValue& value,
+                     bool& deleted)
+{
+    RecordReader reader(payload);
+    std::uint8_t op = 0;
+    std::int64_t rawSequence = 0;
+    if (!reader.GetU8(op) || !reader.GetI64(rawSequence) || !reader.GetString(key))
+    {
+        return false;
+    }
+    sequence = static_cast<std::uint64_t>(rawSequence);
+    deleted = static_cast<Op>(op) == Op::Delete;
+    if (static_cast<Op>(op) == Op::Set && !reader.GetValue(value))
+    {
+        return false;
+    }
+    return (deleted || static_cast<Op>(op) == Op::Set) && reader.done();
+}
+
+std::uint64_t RedoLog::AppendSet(const std::string& key, const ScriptValue& value)
+{
+    return Append(Op::Set, key, &value);
+}
+
+std::uint64_t RedoLog::AppendDelete(const std::string& key)
+{
+    return Append(Op::Delete, key, nullptr);
+}
+
+std::uint64_t RedoLog::Append(const Op op, const std::string& key, const ScriptValue* value)
+{
+    RecordWriter record;
+    std::unique_lock lock(m_mutex);
+    if (m_failed)
+    {
+        return 0;
+    }
+    const std::uint64_t sequence = m_lastSequence + 1;
+    record.PutU8(static_cast<std::uint8_t>(op));
+    record.PutI64(static_cast<std::int64_t>(sequence));
+    record.PutString(key);
+    if (value)
+    {
+        record.PutValue(*value);
+    }
+    try
+    {
+        // 每条记录立即交给操作系统，进程崩溃不会丢失；是否落盘由 RedoSync 决定
+        m_log->Append(record.data());
+        m_log->Flush();
+    }
+    catch (const std::exception& e)
+    {
+        LogError("LuaDB redo log write failed, SetG/DelG are durable only after the next flush: %s", e.what());
+        m_failed = true;
+        m_synced.notify_all();
+        return 0;
+    }
+    m_lastSequence = m_flushedSequence = sequence;
+
+    if (m_options.sync == RedoSync::Always)
+    {
+        // 同一时间等待的多次调用共用一次 fsync
+        m_changed.notify_one();
+        m_synced.wait(lock, [this, sequence] { return m_syncedSequence >= sequence || m_failed || m_stopping; });
+    }
+    return sequence;
+}
+
+std::uint64_t RedoLog::lastSequence() const
+{
+    std::lock_guard lock(m_mutex);
+    return m_lastSequence;
+}
+
+void RedoLog::MarkApplied(const std::uint64_t sequence)
+{
+    {
+        std::lock_guard lock(m_mutex);
+        m_appliedSequence = std::max(m_appliedSequence, sequence);
+    }
+    m_changed.notify_one();
+}
+
+void RedoLog::Replay(const ReplayHandler& handler)
+{
+    std::lock_guard lock(m_mutex);
+    std::uint64_t replayed = 0;
+    RecordLog::Read(m_log->path(), kRedoMagic, [&](const std::string_view payload)
+    {
+        std::uint64_t sequence = 0;
+        std::string key;
+        ScriptValue value;
+        bool deleted = false;
+        if (Decode(payload, sequence, key, value, deleted) && sequence > m_appliedSequence)
+        {
+            handler(key, deleted ? nullptr : &value);
+            ++replayed;
+        }
+    });
+    if (replayed > 0)
+    {
+        LogInfo("Replayed %llu SetG/DelG calls from the redo log.", static_cast<unsigned long long>(replayed));
+    }
+}
+
+void RedoLog::ThreadMain()
+{
+    std::unique_lock lock(m_mutex);
+    const auto compactionDue = [this]
+    {
+        return m_appliedSequence > m_compactedSequence && m_log->size() >= m_options.compactBytes;
+    };
+    const auto syncDue = [this] { return m_options.sync != RedoSync::Os && m_flushedSequence > m_syncedSequence; };
+    while (!m_stopping && !m_failed)
+    {
+        const auto ready = [&] { return m_stopping || m_failed || compactionDue() || (m_options.sync == RedoSync::Always && syncDue()); };
+        if (m_options.sync == RedoSync::Interval)
+        {
+            m_changed.wait_for(lock, m_options.syncInterval, ready);
+        }
+        else
+        {
+            m_changed.wait(lock, ready);
+        }
+        if (m_stopping || m_failed)
+        {
+            break;
+        }
+
+        if (syncDue())
+        {
+            // fsync 期间不持有锁，游戏线程可以继续追加记录
+            const std::uint64_t target = m_flushedSequence;
+            lock.unlock();
+            bool ok = true;
+            try
+            {
+                m_log->SyncFlushed();
+            }
+            catch (const std::exception& e)
+            {
+                LogError("LuaDB redo log fsync failed: %s", e.what());
+                ok = false;
+            }
+            lock.lock();
+            if (ok)
+            {
+                m_syncedSequence = std::max(m_syncedSequence, target);
+            }
+            else
+            {
+                m_failed = true;
+            }
+            m_synced.notify_all();
+        }
+
+        if (!m_failed && compactionDue())
+        {
+            Compact(lock);
+        }
+    }
+}
+
+void RedoLog::Compact(std::unique_lock<std::mutex>& lock)
+{
+    const auto start = std::chrono::steady_clock::now();
+    const std::uint64_t before = m_log->size();
+    const std::uint64_t applied = m_appliedSequence;
+    const std::uint64_t last = m_lastSequence;
+    // 每条记录追加后立即 Flush，持有锁时文件内容即为 before 字节
+    std::uint64_t copiedBytes = before;
+    std::uint64_t copiedSequence = last;
+    std::optional<RecordLog::Replacement> replacement;
+
+    // 读取旧文件、写入并 fsync 新文件期间不持有锁，游戏线程可以继续追加记录
+    lock.unlock();
+    try
+    {
+        replacement.emplace(m_log->BeginRewrite([&](const RecordLog::RecordSink& sink)
+        {
+            if (applied >= last)
+            {
+                return;
+            }
+            // 只保留尚未写入存储引擎的记录
+            copiedSequence = applied;
+            copiedBytes = RecordLog::Read(m_log->path(), kRedoMagic, [&](const std::string_view payload)
+            {
+                std::uint64_t sequence = 0;
+                std::string key;
+                ScriptValue value;
+                bool deleted = false;
+                if (Decode(payload, sequence, key, value, deleted))
+                {
+                    copiedSequence = std::max(copiedSequence, sequence);
+                    if (sequence > applied)
+                    {
+                        sink(payload);
+                    }
+                }
+            }).validBytes;
+        }));
+    }
+    catch (const std::exception& e)
+    {
+        lock.lock();
+        // 旧文件未被改动，但写入新文件的错误（如磁盘已满）会在每次唤醒时重复，停用重做日志
+        LogError("LuaDB redo log compaction failed, disabling the redo log: %s", e.what());
+        m_failed = true;
+        m_synced.notify_all();
+        return;
+    }
+    lock.lock();
+    if (m_failed)
+    {
+        return;
+    }
+
+    try
+    {
+        // 持有锁时只补上期间追加的记录（都已交给操作系统）并替换文件，不做 fsync
+        m_log->FinishRewrite(*replacement, [&](const RecordLog::RecordSink& sink)
+        {
+            const auto tail = RecordLog::Read(m_log->path(), kRedoMagic, sink, copiedBytes);
+            if (tail.validBytes != m_log->size())
+            {
+                throw std::runtime_error("redo log changed unexpectedly during compaction");
+            }
+        });
+    }
+    catch (const std::exception& e)
+    {
+        // 替换文件失败后无法确定日志状态，停用重做日志，数据仍由全局写入保存
+        LogError("LuaDB redo log compaction failed, disabling the redo log: %s", e.what());
+        m_failed = true;
+        m_synced.notify_all();
+        return;
+    }
+    // 新文件中 copiedSequence 及之前的记录已落盘；之后追加的记录由下一次 fsync 负责
+    m_compactedSequence = applied;
+    m_syncedSequence = std::max(m_syncedSequence, copiedSequence);
+    m_synced.notify_all();
+    LogDebug("LuaDB redo log compacted from %llu to %llu bytes in %lld us.",
+             static_cast<unsigned long long>(before),
+             static_cast<unsigned long long>(m_log->size()),
+             static_cast<long long>(std::chrono::duration_cast<std::chrono::microseconds>(
+                 std::chrono::steady_clock::now() - start).count()));
+}
@@ -0,0 +1,85 @@
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <filesystem>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+
+#include "LuaDBOptions.h"
+#include "RecordLog.h"
+#include "ScriptValue.h"
+
+// Write-ahead log of SetG/DelG calls that have not reached the storage engine yet. Every
+// call appends one record carrying a sequence number; once a global flush covering a
+// sequence has been applied by the engine, MarkApplied lets compaction drop the records up
+// to it. After a crash, Replay brings the global cache back to the state of the last call
+// that reached the log, on top of whatever the engine had stored.
+//
+// Records are written to the OS on the calling thread. A background thread fsyncs them in
+// groups according to RedoSync and compacts the file once it grows past compactBytes;
+// appends only wait for it while the records written meanwhile are copied over.
+class RedoLog final
+{
+public:
+    struct Options
+    {
+        std::filesystem::path path;
+        // Must not be RedoSync::Off.
+        RedoSync sync = RedoSync::Interval;
+        std::chrono::milliseconds syncInterval{50};
+        std::uint64_t compactBytes = 1024 * 1024;
+    };
+
+    // Null value: the key was deleted.
+    using ReplayHandler = std::function<void(const std::string& key, const ScriptValue* value)>;
+
+    explicit RedoLog(Options options);
+    ~RedoLog();
+    RedoLog(const RedoLog&) = delete;
+    RedoLog& operator=(const RedoLog&) = delete;
+
+    // Records a SetG or DelG and returns its sequence number. With RedoSync::Always it
+    // returns once the record is on disk. Failures are logged and disable the log.
+    std::uint64_t AppendSet(const std::string& key, const ScriptValue& value);
+    std::uint64_t AppendDelete(const std::string& key);
+    // Sequence number of the last record appended.
+    std::uint64_t lastSequence() const;
+    // Every record up to sequence is stored by the engine.
+    void MarkApplied(std::uint64_t sequence);
+    // Calls handler for every record not known to be applied, oldest first.
+    void Replay(const ReplayHandler& handler);
+
+private:
+    enum class Op : std::uint8_t
+    {
+        Set = 1,
+        Delete = 2,
+    };
+
+    std::uint64_t Append(Op op, const std::string& key, const ScriptValue* value);
+    void ThreadMain();
+    // Called and returns with lock held, but releases it while the new file is written.
+    void Compact(std::unique_lock<std::mutex>& lock);
+    static bool Decode(std::string_view payload, std::uint64_t& sequence, std::string& key, ScriptValue& value, bool& deleted);
+
+    Options m_options;
+    mutable std::mutex m_mutex;
+    std::condition_variable m_changed;
+    std::condition_variable m_synced;
+    std::unique_ptr<RecordLog> m_log;
+    std::uint64_t m_lastSequence = 0;
+    // Highest sequence handed to the OS and fsynced, respectively.
+    std::uint64_t m_flushedSequence = 0;
+    std::uint64_t m_syncedSequence = 0;
+    std::uint64_t m_appliedSequence = 0;
+    // m_appliedSequence at the last compaction.
+    std::uint64_t m_compactedSequence = 0;
+    bool m_failed = false;
+    bool m_stopping = false;
+    std::thread m_thread;
+};
@@ -0,0 +1,59 @@
+#include "SaveCacheLru.h"
+
+std::size_t SaveCacheLru::EstimateBytes(const ValueMap& values)
+{
+    std::size_t bytes = 0;
+    for (const auto& [key, value] : values)
+    {
+        bytes += EstimateEntryBytes(key, value);
+    }
+    return bytes;
+}
+
+void SaveCacheLru::Put(const std::string& savefile, Entry entry)
+{
+    if (!enabled() || !entry.values)
+    {
+        return;
+    }
+    Erase(savefile);
+    const std::size_t bytes = EstimateBytes(*entry.values);
+    if (bytes > m_maxBytes)
+    {
+        // 单个存档超过上限时不缓存，避免挤掉其他存档后自己也留不住
+        return;
+    }
+    m_order.push_front(Node{savefile, std::move(entry), bytes});
+    m_entries.emplace(savefile, m_order.begin());
+    m_bytes += bytes;
+    while (m_order.size() > m_maxSaves || m_bytes > m_maxBytes)
+    {
+        Remove(std::prev(m_order.end()));
+    }
+}
+
+const SaveCacheLru::Entry* SaveCacheLru::Find(const std::string& savefile)
+{
+    const auto it = m_entries.find(savefile);
+    if (it == m_entries.end())
+    {
+        return nullptr;
+    }
+    m_order.splice(m_order.begin(), m_order, it->second);
+    return &it->second->entry;
+}
+
+void SaveCacheLru::Erase(const std::string& savefile)
+{
+    if (const auto it = m_entries.find(savefile); it != m_entries.end())
+    {
+        Remove(it->second);
+    }
+}
+
+void SaveCacheLru::Remove(const NodeList::iterator node)
+{
+    m_bytes -= node->bytes;
+    m_entries.erase(node->savefile);
+    m_order.erase(node);
+}
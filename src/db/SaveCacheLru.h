@@ -0,0 +1,66 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
+#include <list>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
+
+#include "StorageEngine.h"
+
+// The save caches loaded or saved most recently, so reloading one of them (typically the
+// last save after a death) does not read it from storage again. Bounded by a number of
+// saves and an estimate of their memory. Not thread-safe.
+class SaveCacheLru final
+{
+public:
+    struct Entry
+    {
+        std::shared_ptr<const ValueMap> values;
+        // Set for entries put by a save: the PersistenceWriter ticket that writes values and
+        // the flag that task sets once they are stored. The entry is only valid after that.
+        std::uint64_t writeTicket = 0;
+        std::shared_ptr<const std::atomic<bool>> written;
+        // The "Name:" prefixes values holds in full; null when it holds the whole save. The
+        // other namespaces are left in storage.
+        std::shared_ptr<const std::unordered_set<std::string>> namespaces;
+    };
+
+    SaveCacheLru(std::size_t maxSaves, std::size_t maxBytes) : m_maxSaves(maxSaves), m_maxBytes(maxBytes) {}
+
+    // Makes entry the most recent one for savefile, evicting the least recent ones over the bounds.
+    void Put(const std::string& savefile, Entry entry);
+    // Returns the entry of savefile and marks it most recent; null when there is none.
+    const Entry* Find(const std::string& savefile);
+    void Erase(const std::string& savefile);
+
+    bool enabled() const { return m_maxSaves > 0; }
+    std::size_t size() const { return m_entries.size(); }
+    std::size_t bytes() const { return m_bytes; }
+
+    // Approximate heap usage of values.
+    static std::size_t EstimateBytes(const ValueMap& values);
+
+private:
+    struct Node
+    {
+        std::string savefile;
+        Entry entry;
+        std::size_t bytes = 0;
+    };
+    using NodeList = std::list<Node>;
+
+    void Remove(NodeList::iterator node);
+
+    std::size_t m_maxSaves;
+    std::size_t m_maxBytes;
+    // Most recent first.
+    NodeList m_order;
+    std::unordered_map<std::string, NodeList::iterator> m_entries;
+    std::size_t m_bytes = 0;
+};
@@ -0,0 +1,279 @@
+#include "SaveCollector.h"
+
+#include <algorithm>
+#include <memory>
+#include <string_view>
+#include <system_error>
+
+#include "../log/log.h"
+
+namespace
+{
+std::string PathToUtf8(const std::filesystem::path& path)
+{
+    const auto text = path.generic_u8string();
+    return {text.begin(), text.end()};
+}
+
+// Splits a path into lower-case components, dropping empty and "." parts and CryPak aliases.
+std::vector<std::string> NormalizedComponents(const std::string_view path)
+{
+    std::vector<std::string> components;
+    std::string current;
+    const auto flush = [&]
+    {
+        if (!current.empty() && current != "." && current.front() != '%' && current.front() != '@')
+        {
+            components.push_back(std::move(current));
+        }
+        current.clear();
+    };
+    for (const char c : path)
+    {
+        if (c == '/' || c == '\\')
+        {
+            flush();
+        }
+        else
+        {
+            current.push_back(c >= 'A' && c <= 'Z' ? static_cast<char>(c - 'A' + 'a') : c);
+        }
+    }
+    flush();
+    return components;
+}
+
+std::string JoinComponents(const std::vector<std::string>& components, const std::size_t first)
+{
+    std::string joined;
+    for (std::size_t i = first; i < components.size(); ++i)
+    {
+        if (i != first)
+        {
+            joined.push_back('/');
+        }
+        joined += components[i];
+    }
+    return joined;
+}
+
+bool SortedContains(const std::vector<std::string>& values, const std::string& value)
+{
+    return std::binary_search(values.begin(), values.end(), value);
+}
+}
+
+SaveDirectoryIndex::SaveDirectoryIndex(const std::filesystem::path& saveDir)
+{
+    std::error_code ec;
+    auto it = std::filesystem::recursive_directory_iterator(
+        saveDir, std::filesystem::directory_options::skip_permission_denied, ec);
+    for (; !ec && it != std::filesystem::recursive_directory_iterator(); it.increment(ec))
+    {
+        if (!it->is_regular_file(ec))
+        {
+            continue;
+        }
+        const auto relative = it->path().lexically_relative(saveDir).generic_u8string();
+        const auto components = NormalizedComponents(std::string(relative.begin(), relative.end()));
+        if (components.empty())
+        {
+            continue;
+        }
+        ++m_fileCount;
+        m_files.push_back(JoinComponents(components, 0));
+        for (std::size_t i = 0; i < components.size(); ++i)
+        {
+            m_suffixes.push_back(JoinComponents(components, i));
+        }
+    }
+    if (ec)
+    {
+        LogDebug("Save directory scan of %s stopped: %s", PathToUtf8(saveDir).c_str(), ec.message().c_str());
+    }
+    std::sort(m_files.begin(), m_files.end());
+    std::sort(m_suffixes.begin(), m_suffixes.end());
+    m_suffixes.erase(std::unique(m_suffixes.begin(), m_suffixes.end()), m_suffixes.end());
+}
+
+bool SaveDirectoryIndex::Contains(const std::string& savefile) const
+{
+    const auto components = NormalizedComponents(savefile);
+    if (components.empty())
+    {
+        return false;
+    }
+    // 存档名是某个文件相对路径的后缀（存档名比目录更短）
+    if (SortedContains(m_suffixes, JoinComponents(components, 0)))
+    {
+        return true;
+    }
+    // 某个文件相对路径是存档名的后缀（存档名为绝对路径或带有目录前缀）
+    for (std::size_t i = 1; i < components.size(); ++i)
+    {
+        if (SortedContains(m_files, JoinComponents(components, i)))
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+SaveCollector::SaveCollector(PersistenceWriter& writer, Options options) :
+    m_writer(writer),
+    m_options(std::move(options))
+{
+    m_options.batchRows = std::max<std::uint32_t>(m_options.batchRows, 1);
+}
+
+SaveCollector::~SaveCollector()
+{
+    m_stopping = true;
+    if (m_thread.joinable())
+    {
+        m_thread.join();
+    }
+}
+
+void SaveCollector::Start(std::vector<std::string> protectedSaves, const std::chrono::steady_clock::duration minInterval)
+{
+    const auto now = std::chrono::steady_clock::now();
+    if (m_running || (m_lastStart != std::chrono::steady_clock::time_point{} && now - m_lastStart < minInterval))
+    {
+        return;
+    }
+    m_lastStart = now;
+    if (m_thread.joinable())
+    {
+        m_thread.join();
+    }
+    m_running = true;
+    m_thread = std::thread([this, saves = std::move(protectedSaves)]
+    {
+        try
+        {
+            RunPass(saves);
+        }
+        catch (const std::exception& e)
+        {
+            LogError("Save GC failed: %s", e.what());
+        }
+        m_running = false;
+    });
+}
+
+SaveCollectorReport SaveCollector::RunPass(const std::vector<std::string>& protectedSaves)
+{
+    SaveCollectorReport report;
+    report.dryRun = m_options.dryRun;
+
+    const auto saves = ListStoredSaves();
+    report.storedSaves = saves.size();
+    if (saves.empty())
+    {
+        return report;
+    }
+
+    const std::string saveDir = PathToUtf8(m_options.saveDir);
+    const SaveDirectoryIndex index(m_options.saveDir);
+    if (!index.usable())
+    {
+        LogWarn("Save GC skipped: no save files found in %s.", saveDir.c_str());
+        report.skipped = true;
+        return report;
+    }
+
+    std::vector<const StoredSave*> orphans;
+    std::uint64_t orphanRows = 0;
+    std::size_t found = 0;
+    for (const auto& save : saves)
+    {
+        if (index.Contains(save.savefile))
+        {
+            ++found;
+            continue;
+        }
+        if (std::find(protectedSaves.begin(), protectedSaves.end(), save.savefile) != protectedSaves.end())
+        {
+            continue;
+        }
+        orphans.push_back(&save);
+        orphanRows += save.entries;
+        report.orphans.push_back({save.savefile, save.entries});
+    }
+    if (orphans.empty())
+    {
+        LogDebug("Save GC: all %zu stored saves exist in %s.", saves.size(), saveDir.c_str());
+        return report;
+    }
+    // 一个存档都对不上时更可能是目录配置错误，而不是玩家删除了全部存档；
+    // 受保护的存档（如刚写入、尚未落盘的当前存档）不算作找到
+    if (found == 0)
+    {
+        LogWarn("Save GC skipped: none of the %zu stored saves were found among %zu files in %s.",
+                saves.size(),
+                index.fileCount(),
+                saveDir.c_str());
+        report.skipped = true;
+        return report;
+    }
+
+    LogInfo("Save GC%s: %zu of %zu stored saves have no file in %s (%llu rows).",
+            report.dryRun ? " (dry run)" : "",
+            orphans.size(),
+            saves.size(),
+            saveDir.c_str(),
+            static_cast<unsigned long long>(orphanRows));
+    for (const auto* orphan : orphans)
+    {
+        LogInfo("  %s: %llu rows", orphan->savefile.c_str(), static_cast<unsigned long long>(orphan->entries));
+    }
+    if (report.dryRun)
+    {
+        return report;
+    }
+
+    std::size_t collected = 0;
+    for (const auto* orphan : orphans)
+    {
+        if (m_stopping)
+        {
+            break;
+        }
+        report.deletedRows += DeleteSave(*orphan);
+        ++collected;
+    }
+    LogInfo("Save GC: deleted %llu rows of %zu orphaned saves.",
+            static_cast<unsigned long long>(report.deletedRows),
+            collected);
+    return report;
+}
+
+std::vector<StoredSave> SaveCollector::ListStoredSaves()
+{
+    auto saves = std::make_shared<std::vector<StoredSave>>();
+    m_writer.Wait(m_writer.Submit("Save GC listing", [saves](StorageEngine& engine)
+    {
+        *saves = engine.ListSaves();
+    }));
+    return std::move(*saves);
+}
+
+std::uint64_t SaveCollector::DeleteSave(const StoredSave& save)
+{
+    // 每批单独提交；若存档在此期间被重新写入（版本变化），批次不会删除任何行
+    std::uint64_t deleted = 0;
+    auto batchDeleted = std::make_shared<std::uint64_t>(0);
+    do
+    {
+        *batchDeleted = 0;
+        m_writer.Wait(m_writer.Submit("Save GC batch", [save, batchDeleted, batchRows = m_options.batchRows](StorageEngine& engine)
+        {
+            *batchDeleted = engine.DeleteScope(save, batchRows);
+        }));
+        deleted += *batchDeleted;
+    }
+    while (*batchDeleted > 0 && !m_stopping);
+    LogDebug("Save GC: deleted %llu rows of %s.", static_cast<unsigned long long>(deleted), save.savefile.c_str());
+    return deleted;
+}
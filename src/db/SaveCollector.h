@@ -0,0 +1,86 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <filesystem>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "PersistenceWriter.h"
+
+// Lists the save files present under saveDir and answers whether a stored save name still
+// refers to one of them. Names are compared case-insensitively by trailing path components,
+// so "saves/playline0/a.whs", an absolute path and a name relative to saveDir all match
+// the same file. Leading CryPak aliases such as "%USER%" are ignored.
+class SaveDirectoryIndex final
+{
+public:
+    explicit SaveDirectoryIndex(const std::filesystem::path& saveDir);
+
+    // False when saveDir is missing or contains no files; nothing can be decided then.
+    bool usable() const { return m_fileCount > 0; }
+    std::size_t fileCount() const { return m_fileCount; }
+    bool Contains(const std::string& savefile) const;
+
+private:
+    std::size_t m_fileCount = 0;
+    // Every file path relative to saveDir, normalized.
+    std::vector<std::string> m_files;
+    // Every trailing component suffix of those paths, normalized and sorted.
+    std::vector<std::string> m_suffixes;
+};
+
+struct SaveCollectorReport
+{
+    struct Orphan
+    {
+        std::string savefile;
+        std::uint64_t rows = 0;
+    };
+
+    bool dryRun = true;
+    // Set when the pass did not look at or delete anything; the reason is logged.
+    bool skipped = false;
+    std::size_t storedSaves = 0;
+    std::vector<Orphan> orphans;
+    std::uint64_t deletedRows = 0;
+};
+
+// Deletes the rows of saves whose files no longer exist on disk. Each pass lists the stored
+// saves, scans the save directory on its own thread, and deletes orphaned rows through the
+// persistence writer at most batchRows entries per task, so game writes queued in between
+// are never held up by a large delete.
+class SaveCollector final
+{
+public:
+    struct Options
+    {
+        std::filesystem::path saveDir;
+        bool dryRun = true;
+        std::uint32_t batchRows = 256;
+    };
+
+    SaveCollector(PersistenceWriter& writer, Options options);
+    ~SaveCollector();
+    SaveCollector(const SaveCollector&) = delete;
+    SaveCollector& operator=(const SaveCollector&) = delete;
+
+    // Starts a pass in the background unless one is running or the last one started less than
+    // minInterval ago. protectedSaves are never collected (for example the loaded save).
+    void Start(std::vector<std::string> protectedSaves, std::chrono::steady_clock::duration minInterval = {});
+    // Runs a pass on the calling thread. Must not be called from a writer task.
+    SaveCollectorReport RunPass(const std::vector<std::string>& protectedSaves);
+
+private:
+    std::vector<StoredSave> ListStoredSaves();
+    std::uint64_t DeleteSave(const StoredSave& save);
+
+    PersistenceWriter& m_writer;
+    Options m_options;
+    std::atomic<bool> m_running{false};
+    std::atomic<bool> m_stopping{false};
+    std::chrono::steady_clock::time_point m_lastStart{};
+    std::thread m_thread;
+};
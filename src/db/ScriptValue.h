@@ -0,0 +1,126 @@
+#pragma once
+#include <cassert>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <variant>
+
+// Type ids stored with every value. These are the ScriptAnyType ids the rows have always
+// been written with; kept here so storage code does not depend on the script system headers.
+namespace StoreValueType
+{
+constexpr int kBool = 2;
+constexpr int kNumber = 4;
+constexpr int kString = 5;
+}
+
+// A string kept out of line by the storage engine whose bytes have not been read yet;
+// StorageEngine::ReadBlob returns them. Only LoadScope creates these, and only the engine
+// that created one understands it.
+struct BlobRef {
+    std::int64_t id = 0;
+    // Store.type of the row, including kCompressedValueFlag.
+    int storedType = 0;
+    // Size of the stored (possibly compressed) bytes.
+    std::uint64_t storedBytes = 0;
+
+    bool operator==(const BlobRef&) const = default;
+};
+
+// LuaDB 支持的原始值：bool、number（Lua 侧为 float）和 string。
+// BLOB_REF 是尚未读取的 string，首次读取时由 LuaDB 换成 string。
+// 与脚本系统的转换在 LuaDB.cpp 中，存储引擎只依赖本头文件。
+class ScriptValue {
+public:
+    enum class Type { BOOL, NUMBER, STRING, BLOB_REF };
+    // 构造函数
+    ScriptValue() : m_value(false) {}  // 默认构造为 bool
+    explicit ScriptValue(bool b) : m_value(b) {}
+    explicit ScriptValue(float f) : m_value(f) {}
+    explicit ScriptValue(const std::string& s) : m_value(s) {}
+    explicit ScriptValue(std::string&& s) : m_value(std::move(s)) {}
+    explicit ScriptValue(const char* s) : m_value(std::string(s)) {}
+    explicit ScriptValue(const BlobRef& ref) : m_value(ref) {}
+
+    ~ScriptValue() = default;
+    ScriptValue(const ScriptValue&) = default;
+    ScriptValue(ScriptValue&&) = default;
+    ScriptValue& operator=(const ScriptValue&) = default;
+    ScriptValue& operator=(ScriptValue&&) = default;
+    // 类型查询
+    Type type() const {
+        return static_cast<Type>(m_value.index());
+    }
+    // 存储类型 id（StoreValueType）
+    int storeType() const
+    {
+        switch (type())
+        {
+        case Type::BOOL: return StoreValueType::kBool;
+        case Type::NUMBER: return StoreValueType::kNumber;
+        case Type::STRING:
+        case Type::BLOB_REF: return StoreValueType::kString;
+        default: return 0;
+        }
+    }
+
+    // 取值接口
+    bool as_bool() const {
+        assert(is_bool());
+        return std::get<bool>(m_value);
+    }
+    float as_number() const {
+        assert(is_number());
+        return std::get<float>(m_value);
+    }
+    const std::string& as_string() const {
+        assert(is_string());
+        return std::get<std::string>(m_value);
+    }
+    const BlobRef& as_blob_ref() const {
+        assert(is_blob_ref());
+        return std::get<BlobRef>(m_value);
+    }
+    // 类型校验
+    bool is_bool() const   { return type() == Type::BOOL; }
+    bool is_number() const { return type() == Type::NUMBER; }
+    bool is_string() const { return type() == Type::STRING; }
+    bool is_blob_ref() const { return type() == Type::BLOB_REF; }
+
+    bool operator==(const ScriptValue& other) const = default;
+private:
+    std::variant<bool, float, std::string, BlobRef> m_value;
+};
+
+// 不持有数据的值视图，指向 ScriptValue 或内存映射快照中的值。
+// string 总是以 NUL 结尾，可以直接交给脚本系统。
+struct ScriptValueView {
+    ScriptValue::Type type = ScriptValue::Type::BOOL;
+    bool boolean = false;
+    float number = 0.0f;
+    std::string_view string;
+    BlobRef blob;
+
+    static ScriptValueView Of(const ScriptValue& value) {
+        ScriptValueView view;
+        view.type = value.type();
+        switch (value.type())
+        {
+        case ScriptValue::Type::BOOL: view.boolean = value.as_bool(); break;
+        case ScriptValue::Type::NUMBER: view.number = value.as_number(); break;
+        case ScriptValue::Type::STRING: view.string = value.as_string(); break;
+        case ScriptValue::Type::BLOB_REF: view.blob = value.as_blob_ref(); break;
+        }
+        return view;
+    }
+
+    ScriptValue ToValue() const {
+        switch (type)
+        {
+        case ScriptValue::Type::NUMBER: return ScriptValue(number);
+        case ScriptValue::Type::STRING: return ScriptValue(std::string(string));
+        case ScriptValue::Type::BLOB_REF: return ScriptValue(blob);
+        default: return ScriptValue(boolean);
+        }
+    }
+};
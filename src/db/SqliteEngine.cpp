@@ -0,0 +1,964 @@
+#include "SqliteEngine.h"
+
+#include <algorithm>
+#include <cstring>
+#include <limits>
+#include <memory>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <unordered_set>
+#include <vector>
+
+#include <sqlite3.h>
+
+#include "Lz4Block.h"
+#include "StoreSchema.h"
+#include "../log/log.h"
+
+namespace
+{
+// 值以原生类型存储：bool 为 INTEGER，number 为 REAL，string 为 TEXT，读写都不经过字符串转换
+void bindValue(SQLite::Statement& stmt, const int index, const ScriptValue& value)
+{
+    switch (value.type())
+    {
+    case ScriptValue::Type::BOOL:
+        stmt.bind(index, value.as_bool() ? 1 : 0);
+        break;
+    case ScriptValue::Type::NUMBER:
+        stmt.bind(index, static_cast<double>(value.as_number()));
+        break;
+    case ScriptValue::Type::STRING:
+        stmt.bindNoCopy(index, value.as_string());
+        break;
+    case ScriptValue::Type::BLOB_REF:
+        // 调用方直接写入 BlobRef 的 hash，不经过这里
+        throw std::logic_error("BlobRef has no inline value");
+    }
+}
+
+// Value column of a Store or Blobs row, read as its type is stored. bytes points into the
+// statement or a RowBatch.
+struct StoredColumn
+{
+    std::int64_t integer = 0;
+    double real = 0.0;
+    std::string_view bytes;
+};
+
+StoredColumn readColumn(const int type, const SQLite::Column& column)
+{
+    StoredColumn stored;
+    switch (type)
+    {
+    case StoreValueType::kBool:
+        stored.integer = column.getInt64();
+        break;
+    case StoreValueType::kNumber:
+        stored.real = column.getDouble();
+        break;
+    default:
+        {
+            // 先取指针再取长度，SQLite 要求的调用顺序
+            const auto* data = static_cast<const char*>(column.getBlob());
+            stored.bytes = std::string_view(data, static_cast<std::size_t>(column.getBytes()));
+        }
+        break;
+    }
+    return stored;
+}
+
+ScriptValue decodeValue(const int type, const StoredColumn& stored, CodecStats& stats)
+{
+    if ((type & kCompressedValueFlag) != 0)
+    {
+        const auto start = std::chrono::steady_clock::now();
+        std::uint32_t rawSize = 0;
+        if ((type & ~kCompressedValueFlag) != StoreValueType::kString || stored.bytes.size() < sizeof(rawSize))
+        {
+            LogWarn("Malformed compressed value of type %d in Store", type);
+            return {};
+        }
+        std::memcpy(&rawSize, stored.bytes.data(), sizeof(rawSize));
+        const std::string_view block = stored.bytes.substr(sizeof(rawSize));
+        // 损坏的长度可能要求数 GB 的内存，超过 LZ4 最大压缩比的长度不分配
+        if (rawSize > Lz4Block::MaxDecompressedSize(block.size()))
+        {
+            LogWarn("Corrupt compressed value in Store: %u bytes claimed from a %zu-byte block", rawSize, block.size());
+            return {};
+        }
+        std::string value(rawSize, '\0');
+        if (!Lz4Block::Decompress(block, value.data(), value.size()))
+        {
+            LogWarn("Corrupt compressed value in Store");
+            return {};
+        }
+        ++stats.decompressedValues;
+        stats.decompressTime += std::chrono::steady_clock::now() - start;
+        return ScriptValue(std::move(value));
+    }
+    switch (type)
+    {
+    case StoreValueType::kBool:
+        return ScriptValue(stored.integer != 0);
+    case StoreValueType::kNumber:
+        return ScriptValue(static_cast<float>(stored.real));
+    case StoreValueType::kString:
+        return ScriptValue(std::string(stored.bytes));
+    default:
+        LogWarn("Unknown value type %d in Store", type);
+        return {};
+    }
+}
+
+void LogCodecStats(const char* operation, const CodecStats& stats)
+{
+    if (stats.compressedValues > 0)
+    {
+        LogDebug("%s compressed %llu values from %llu to %llu bytes (ratio %.2f) in %lld us.",
+                 operation,
+                 static_cast<unsigned long long>(stats.compressedValues),
+                 static_cast<unsigned long long>(stats.rawBytes),
+                 static_cast<unsigned long long>(stats.storedBytes),
+                 stats.ratio(),
+                 static_cast<long long>(std::chrono::duration_cast<std::chrono::microseconds>(stats.compressTime).count()));
+    }
+    if (stats.decompressedValues > 0)
+    {
+        LogDebug("%s decompressed %llu values in %lld us.",
+                 operation,
+                 static_cast<unsigned long long>(stats.decompressedValues),
+                 static_cast<long long>(std::chrono::duration_cast<std::chrono::microseconds>(stats.decompressTime).count()));
+    }
+}
+}
+
+CodecStats& CodecStats::operator+=(const CodecStats& other)
+{
+    compressedValues += other.compressedValues;
+    rawBytes += other.rawBytes;
+    storedBytes += other.storedBytes;
+    decompressedValues += other.decompressedValues;
+    compressTime += other.compressTime;
+    decompressTime += other.decompressTime;
+    return *this;
+}
+
+SqliteEngine::SqliteEngine(std::unique_ptr<SQLite::Database> db,
+                           const CheckpointPolicy& checkpointPolicy,
+                           const CompressionPolicy& compressionPolicy,
+                           const LazyValuePolicy& lazyValuePolicy,
+                           const BackupPolicy& backupPolicy,
+                           const HydrationPolicy& hydrationPolicy) :
+    m_db(std::move(db)),
+    m_checkpointPolicy(checkpointPolicy),
+    m_compressionPolicy(compressionPolicy),
+    m_lazyValuePolicy(lazyValuePolicy),
+    m_hydrationPolicy(hydrationPolicy),
+    m_backup(backupPolicy)
+{
+    // 旧版本在第一次加载时才报 "no such function"，这里提前给出原因
+    if (sqlite3_libversion_number() < kMinSqliteVersionNumber)
+    {
+        throw std::runtime_error(std::string("SQLite ") + sqlite3_libversion() + " is too old, 3.43 or newer is required");
+    }
+    if (m_hydrationPolicy.threads > 0)
+    {
+        m_hydrationPolicy.batchRows = std::max<std::size_t>(m_hydrationPolicy.batchRows, 1);
+        m_hydrationPool = std::make_unique<HydrationPool>(m_hydrationPolicy.threads);
+    }
+    if (m_checkpointPolicy.enabled)
+    {
+        if (SQLite::Statement query(*m_db, "PRAGMA page_size"); query.executeStep())
+        {
+            m_pageSize = static_cast<std::uint64_t>(query.getColumn(0).getInt64());
+        }
+        // Replaces SQLite's own auto-checkpoint hook; checkpoints are scheduled by Idle().
+        sqlite3_wal_hook(m_db->getHandle(), &SqliteEngine::OnWalCommit, this);
+    }
+
+    SQLite::Transaction transaction(*m_db);
+    InitializeSchema(*m_db);
+    transaction.commit();
+    m_statements = std::make_unique<StatementCache>(*m_db);
+    PrepareStoreStatements(*m_statements);
+}
+
+SqliteEngine::~SqliteEngine()
+{
+    m_statements.reset();
+}
+
+bool SqliteEngine::CompressValue(const std::string& value, std::string& stored, CodecStats& stats) const
+{
+    if (m_compressionPolicy.minBytes == 0
+        || value.size() < m_compressionPolicy.minBytes
+        || value.size() > std::numeric_limits<std::uint32_t>::max())
+    {
+        return false;
+    }
+    const auto start = std::chrono::steady_clock::now();
+    const auto rawSize = static_cast<std::uint32_t>(value.size());
+    stored.assign(reinterpret_cast<const char*>(&rawSize), sizeof(rawSize));
+    Lz4Block::Compress(value, stored);
+    stats.compressTime += std::chrono::steady_clock::now() - start;
+    // 节省不到 1/8 时保留原文，读取时省去解压
+    if (stored.size() > value.size() - value.size() / 8)
+    {
+        return false;
+    }
+    ++stats.compressedValues;
+    stats.rawBytes += value.size();
+    stats.storedBytes += stored.size();
+    return true;
+}
+
+ScriptValue SqliteEngine::ReadStoredValue(const int type, const SQLite::Column& column, CodecStats& stats)
+{
+    return decodeValue(type, readColumn(type, column), stats);
+}
+
+SqliteEngine::LoadStats& SqliteEngine::LoadStats::operator+=(const LoadStats& other)
+{
+    codec += other.codec;
+    deferredValues += other.deferredValues;
+    deferredBytes += other.deferredBytes;
+    return *this;
+}
+
+struct SqliteEngine::RowBatch
+{
+    struct Row
+    {
+        std::size_t keyOffset = 0;
+        std::size_t keySize = 0;
+        int type = 0;
+        // A large value loaded as a BlobRef: blobId and storedBytes are set instead of the value.
+        bool deferred = false;
+        std::int64_t blobId = 0;
+        std::uint64_t storedBytes = 0;
+        std::int64_t integer = 0;
+        double real = 0.0;
+        std::size_t valueOffset = 0;
+        std::size_t valueSize = 0;
+    };
+
+    std::vector<Row> rows;
+    // Keys and string values of rows, back to back.
+    std::string bytes;
+
+    // Copies up to maxRows rows of stmt; false once stmt has no rows left.
+    bool Read(SQLite::Statement& stmt, std::size_t maxRows);
+    void Decode(ValueMap& out, LoadStats& stats) const;
+};
+
+bool SqliteEngine::RowBatch::Read(SQLite::Statement& stmt, const std::size_t maxRows)
+{
+    rows.reserve(maxRows);
+    while (rows.size() < maxRows)
+    {
+        if (!stmt.executeStep())
+        {
+            return false;
+        }
+        Row& row = rows.emplace_back();
+        const SQLite::Column keyCol = stmt.getColumn(0);
+        const auto* key = static_cast<const char*>(keyCol.getBlob());
+        row.keyOffset = bytes.size();
+        row.keySize = static_cast<std::size_t>(keyCol.getBytes());
+        bytes.append(key, row.keySize);
+        row.type = stmt.getColumn(1).getInt();
+        const SQLite::Column valueCol = stmt.getColumn(3);
+        if (valueCol.isNull() && !stmt.getColumn(2).isNull())
+        {
+            row.deferred = true;
+            row.blobId = stmt.getColumn(2).getInt64();
+            row.storedBytes = static_cast<std::uint64_t>(stmt.getColumn(4).getInt64());
+            continue;
+        }
+        const StoredColumn value = readColumn(row.type, valueCol);
+        row.integer = value.integer;
+        row.real = value.real;
+        row.valueOffset = bytes.size();
+        row.valueSize = value.bytes.size();
+        bytes.append(value.bytes);
+    }
+    return true;
+}
+
+void SqliteEngine::RowBatch::Decode(ValueMap& out, LoadStats& stats) const
+{
+    for (const Row& row : rows)
+    {
+        std::string key(bytes, row.keyOffset, row.keySize);
+        if (row.deferred)
+        {
+            ++stats.deferredValues;
+            stats.deferredBytes += row.storedBytes;
+            out.emplace(std::move(key), ScriptValue(BlobRef{row.blobId, row.type, row.storedBytes}));
+            continue;
+        }
+        const StoredColumn value{row.integer, row.real, std::string_view(bytes).substr(row.valueOffset, row.valueSize)};
+        out.emplace(std::move(key), decodeValue(row.type, value, stats.codec));
+    }
+}
+
+void SqliteEngine::LoadScope(const std::string& savefile, ValueMap& out)
+{
+    const auto stmt = m_statements->Acquire(StoreSql::kSelectScope);
+    stmt->bind(1, savefile);
+    stmt->bind(2, static_cast<std::int64_t>(m_lazyValuePolicy.minBytes));
+    LoadStats stats;
+    ReadScopeRows(*stmt, out, stats);
+    FinishLoad(stats);
+}
+
+void SqliteEngine::LoadNamespaces(const std::string& savefile, const std::vector<std::string>& prefixes, ValueMap& out)
+{
+    // 每个命名空间都是主键 (save_id, ns_id, key) 上的一段范围扫描
+    ScopeIds ids(*m_statements);
+    LoadStats stats;
+    for (const auto& prefix : prefixes)
+    {
+        const std::int64_t nsId = ids.FindNamespace(prefix);
+        if (nsId < 0)
+        {
+            continue;
+        }
+        const auto stmt = m_statements->Acquire(StoreSql::kSelectScopeNamespace);
+        stmt->bind(1, savefile);
+        stmt->bind(2, static_cast<std::int64_t>(m_lazyValuePolicy.minBytes));
+        stmt->bind(3, nsId);
+        ReadScopeRows(*stmt, out, stats);
+    }
+    FinishLoad(stats);
+}
+
+std::vector<std::string> SqliteEngine::ListNamespaces(const std::string& savefile)
+{
+    std::vector<std::string> prefixes;
+    const auto stmt = m_statements->Acquire(StoreSql::kSelectScopePrefixes);
+    stmt->bind(1, savefile);
+    while (stmt->executeStep())
+    {
+        prefixes.push_back(stmt->getColumn(0).getString());
+    }
+    return prefixes;
+}
+
+void SqliteEngine::ReadScopeRows(SQLite::Statement& stmt, ValueMap& out, LoadStats& stats)
+{
+    // 压缩的值在读取时解压，游戏线程拿到的总是原文；
+    // 大值只记录 hash 和大小，首次读取时才由 ReadBlob 取出
+    if (m_hydrationPool)
+    {
+        // 行数不超过一批时直接在持久化线程上解码，省去线程切换
+        auto batch = std::make_shared<RowBatch>();
+        if (!batch->Read(stmt, m_hydrationPolicy.batchRows))
+        {
+            out.reserve(out.size() + batch->rows.size());
+            batch->Decode(out, stats);
+            return;
+        }
+        // 持久化线程只步进语句并复制行；解码、分配和建立哈希表由工作线程各自写入一个分片
+        std::vector<ValueMap> shards(m_hydrationPool->size());
+        std::vector<LoadStats> shardStats(m_hydrationPool->size());
+        std::size_t rows = 0;
+        const auto start = std::chrono::steady_clock::now();
+        try
+        {
+            bool more = true;
+            while (true)
+            {
+                rows += batch->rows.size();
+                m_hydrationPool->Submit([batch, &shards, &shardStats](const std::size_t worker)
+                {
+                    batch->Decode(shards[worker], shardStats[worker]);
+                });
+                if (!more)
+                {
+                    break;
+                }
+                batch = std::make_shared<RowBatch>();
+                more = batch->Read(stmt, m_hydrationPolicy.batchRows);
+            }
+        }
+        catch (...)
+        {
+            // 工作线程仍在写入 shards，等待它们结束后才能离开
+            try
+            {
+                m_hydrationPool->Wait();
+            }
+            catch (...)
+            {
+            }
+            throw;
+        }
+        const auto read = std::chrono::steady_clock::now();
+        m_hydrationPool->Wait();
+        const auto decoded = std::chrono::steady_clock::now();
+        // 结果为空时直接接管最大的分片；其余分片的合并只移动节点，不重新分配键和值
+        if (out.empty())
+        {
+            out = std::move(*std::max_element(shards.begin(), shards.end(), [](const ValueMap& a, const ValueMap& b)
+            {
+                return a.size() < b.size();
+            }));
+        }
+        // rehash 只在还有分片要合并时进行
+        if (out.size() < rows)
+        {
+            out.reserve(rows);
+        }
+        for (std::size_t i = 0; i < shards.size(); ++i)
+        {
+            out.merge(shards[i]);
+            stats += shardStats[i];
+        }
+        const auto elapsedUs = [](const auto from, const auto to)
+        {
+            return static_cast<long long>(std::chrono::duration_cast<std::chrono::microseconds>(to - from).count());
+        };
+        LogDebug("Hydrated %zu rows on %zu threads: read %lld us, decode wait %lld us, merge %lld us.",
+                 rows,
+                 shards.size(),
+                 elapsedUs(start, read),
+                 elapsedUs(read, decoded),
+                 elapsedUs(decoded, std::chrono::steady_clock::now()));
+        return;
+    }
+    while (stmt.executeStep())
+    {
+        SQLite::Column keyCol = stmt.getColumn(0);
+        const int type = stmt.getColumn(1).getInt();
+        SQLite::Column valueCol = stmt.getColumn(3);
+        if (valueCol.isNull() && !stmt.getColumn(2).isNull())
+        {
+            const BlobRef ref{stmt.getColumn(2).getInt64(), type, static_cast<std::uint64_t>(stmt.getColumn(4).getInt64())};
+            ++stats.deferredValues;
+            stats.deferredBytes += ref.storedBytes;
+            out.emplace(keyCol.getString(), ScriptValue(ref));
+            continue;
+        }
+        out.emplace(
+            keyCol.getString(),
+            ReadStoredValue(type, valueCol, stats.codec)
+        );
+    }
+}
+
+void SqliteEngine::FinishLoad(const LoadStats& stats)
+{
+    m_codecStats += stats.codec;
+    LogCodecStats("Load", stats.codec);
+    if (stats.deferredValues > 0)
+    {
+        LogDebug("Load deferred %llu large values (%llu stored bytes) until first read.",
+                 static_cast<unsigned long long>(stats.deferredValues),
+                 static_cast<unsigned long long>(stats.deferredBytes));
+    }
+}
+
+std::string SqliteEngine::ReadBlob(const BlobRef& ref)
+{
+    const auto query = m_statements->Acquire(StoreSql::kSelectBlob);
+    query->bind(1, ref.id);
+    if (!query->executeStep())
+    {
+        throw std::runtime_error("blob " + std::to_string(ref.id) + " is no longer stored");
+    }
+    CodecStats stats;
+    ScriptValue value = ReadStoredValue(ref.storedType, query->getColumn(0), stats);
+    m_codecStats += stats;
+    if (!value.is_string())
+    {
+        throw std::runtime_error("blob " + std::to_string(ref.id) + " is not a string");
+    }
+    return value.as_string();
+}
+
+std::string SqliteEngine::LatestSave()
+{
+    const auto query = m_statements->Acquire(StoreSql::kSelectLatestSave);
+    return query->executeStep() ? query->getColumn(0).getString() : std::string();
+}
+
+std::int64_t SqliteEngine::GlobalVersion()
+{
+    const auto query = m_statements->Acquire(StoreSql::kSelectGlobalVersion);
+    return query->executeStep() ? query->getColumn(0).getInt64() : 0;
+}
+
+BatchResult SqliteEngine::ApplyBatch(const GlobalBatch& batch)
+{
+    return WriteBatch(std::string(), batch, "Global save");
+}
+
+BatchResult SqliteEngine::ApplySaveBatch(const std::string& savefile, const GlobalBatch& batch)
+{
+    return WriteBatch(savefile, batch, "Save batch");
+}
+
+BatchResult SqliteEngine::WriteBatch(const std::string& savefile, const GlobalBatch& batch, const char* operation)
+{
+    SQLite::Transaction transaction(*m_db);
+    ScopeIds ids(*m_statements);
+    const std::int64_t saveId = savefile.empty() ? kGlobalSaveId : ids.TouchSave(savefile);
+    // 全局大值按延迟加载阈值放入 Blobs；存档与 WriteSave 一致，达到 kBlobValueThreshold 即放入
+    const std::size_t blobMinBytes = saveId == kGlobalSaveId ? m_lazyValuePolicy.minBytes : kBlobValueThreshold;
+    BatchResult result;
+    // 被覆盖或删除的大值引用的 blob，写入后回收不再被引用的部分
+    std::vector<std::int64_t> previousBlobs;
+    // 只删除自上次写入以来被 DelG 移除的键
+    if (!batch.deletes.empty())
+    {
+        const auto deleteStmt = m_statements->Acquire(StoreSql::kDeleteEntry);
+        for (const auto& k : batch.deletes)
+        {
+            const std::size_t prefixLength = NamespacePrefixLength(k);
+            const std::int64_t nsId = ids.FindNamespace(std::string_view(k).substr(0, prefixLength));
+            if (nsId < 0)
+            {
+                continue;
+            }
+            deleteStmt->bind(1, saveId);
+            deleteStmt->bind(2, nsId);
+            deleteStmt->bindNoCopy(3, k.c_str() + prefixLength);
+            while (deleteStmt->executeStep())
+            {
+                ++result.deleted;
+                if (!deleteStmt->getColumn(0).isNull())
+                {
+                    previousBlobs.push_back(deleteStmt->getColumn(0).getInt64());
+                }
+            }
+            deleteStmt->reset();
+        }
+    }
+
+    // 只插入或更新自上次写入以来被 SetG 修改的键
+    BlobWriter blobs(*m_statements);
+    CodecStats stats;
+    if (!batch.upserts.empty())
+    {
+        const auto stmt = m_statements->Acquire(StoreSql::kUpsertEntry);
+        const auto hashQuery = m_statements->Acquire(StoreSql::kSelectEntryHash);
+        std::string compressed;
+        for (std::size_t i = 0; i < batch.upserts.size(); ++i)
+        {
+            const auto& [k, v] = batch.upserts[i];
+            try
+            {
+                const std::size_t prefixLength = NamespacePrefixLength(k);
+                const std::int64_t nsId = ids.InternNamespace(std::string_view(k).substr(0, prefixLength));
+                hashQuery->bind(1, saveId);
+                hashQuery->bind(2, nsId);
+                hashQuery->bindNoCopy(3, k.c_str() + prefixLength);
+                if (hashQuery->executeStep())
+                {
+                    previousBlobs.push_back(hashQuery->getColumn(0).getInt64());
+                }
+                hashQuery->reset();
+
+                stmt->bind(1, saveId);
+                stmt->bind(2, nsId);
+                stmt->bindNoCopy(3, k.c_str() + prefixLength);
+                // 达到阈值的值放入 Blobs，加载时只读取引用
+                const bool isCompressed = v.is_string() && CompressValue(v.as_string(), compressed, stats);
+                const std::size_t storedBytes = isCompressed ? compressed.size() : v.is_string() ? v.as_string().size() : 0;
+                const bool outOfLine = blobMinBytes > 0 && storedBytes >= blobMinBytes;
+                if (v.is_blob_ref())
+                {
+                    stmt->bind(4, v.as_blob_ref().storedType);
+                    stmt->bind(5);
+                    stmt->bind(6, v.as_blob_ref().id);
+                }
+                else if (outOfLine)
+                {
+                    stmt->bind(4, isCompressed ? v.storeType() | kCompressedValueFlag : v.storeType());
+                    stmt->bind(5);
+                    stmt->bind(6, isCompressed ? blobs.Intern(compressed, true) : blobs.Intern(v.as_string()));
+                }
+                else if (isCompressed)
+                {
+                    stmt->bind(4, v.storeType() | kCompressedValueFlag);
+                    stmt->bindNoCopy(5, compressed.data(), static_cast<int>(compressed.size()));
+                    stmt->bind(6);
+                }
+                else
+                {
+                    stmt->bind(4, v.storeType());
+                    bindValue(*stmt, 5, v);
+                    stmt->bind(6);
+                }
+                stmt->exec();
+                stmt->reset();
+                result.upserted++;
+            }
+            catch (const std::exception& e)
+            {
+                LogError("%s failed for key %s: %s", operation, k.c_str(), e.what());
+                hashQuery->reset();
+                stmt->reset();
+                result.failedUpserts.push_back(i);
+            }
+        }
+    }
+    blobs.ReleaseUnreferenced(previousBlobs);
+    if (saveId == kGlobalSaveId)
+    {
+        // 与数据在同一事务中递增，全局快照据此判断是否过期
+        m_statements->Acquire(StoreSql::kBumpGlobalVersion)->exec();
+    }
+    transaction.commit();
+    m_codecStats += stats;
+    LogCodecStats(operation, stats);
+    return result;
+}
+
+void SqliteEngine::SnapshotSave(const std::string& savefile, const ValueMap& entries)
+{
+    WriteSave(savefile, entries, nullptr);
+}
+
+void SqliteEngine::SnapshotSaveFrom(const std::string& savefile, const ValueMap& entries, const SaveCarryOver& carry)
+{
+    WriteSave(savefile, entries, &carry);
+}
+
+std::size_t SqliteEngine::CarryOverNamespaces(ScopeIds& ids,
+                                              const std::string& savefile,
+                                              const std::int64_t saveId,
+                                              const ValueMap& entries,
+                                              const SaveCarryOver& carry)
+{
+    std::unordered_set<std::int64_t> replaced;
+    const auto replace = [&](const std::string_view prefix)
+    {
+        if (const std::int64_t nsId = ids.FindNamespace(prefix); nsId >= 0)
+        {
+            replaced.insert(nsId);
+        }
+    };
+    for (const auto& prefix : carry.loadedPrefixes)
+    {
+        replace(prefix);
+    }
+    for (const auto& [k, v] : entries)
+    {
+        replace(std::string_view(k).substr(0, NamespacePrefixLength(k)));
+    }
+
+    const bool sameSave = carry.base == savefile;
+    std::int64_t baseId = saveId;
+    if (!sameSave)
+    {
+        const auto query = m_statements->Acquire(StoreSql::kSelectSaveId);
+        query->bind(1, carry.base);
+        baseId = query->executeStep() ? query->getColumn(0).getInt64() : -1;
+        const auto deleteStmt = m_statements->Acquire(StoreSql::kDeleteSave);
+        deleteStmt->bind(1, saveId);
+        deleteStmt->exec();
+    }
+    std::vector<std::int64_t> namespaces;
+    if (baseId >= 0)
+    {
+        const auto query = m_statements->Acquire(StoreSql::kSelectSaveNamespaces);
+        query->bind(1, baseId);
+        while (query->executeStep())
+        {
+            namespaces.push_back(query->getColumn(0).getInt64());
+        }
+    }
+
+    // 未加载的命名空间按行复制（或原地保留），值不经过解码和重新编码
+    std::size_t carried = 0;
+    for (const std::int64_t nsId : namespaces)
+    {
+        if (sameSave && replaced.contains(nsId))
+        {
+            const auto deleteStmt = m_statements->Acquire(StoreSql::kDeleteSaveNamespace);
+            deleteStmt->bind(1, saveId);
+            deleteStmt->bind(2, nsId);
+            deleteStmt->exec();
+        }
+        else if (!replaced.contains(nsId))
+        {
+            if (!sameSave)
+            {
+                const auto copy = m_statements->Acquire(StoreSql::kCopySaveNamespace);
+                copy->bind(1, saveId);
+                copy->bind(2, baseId);
+                copy->bind(3, nsId);
+                copy->exec();
+            }
+            ++carried;
+        }
+    }
+    return carried;
+}
+
+void SqliteEngine::WriteSave(const std::string& savefile, const ValueMap& entries, const SaveCarryOver* carry)
+{
+    SQLite::Transaction transaction(*m_db);
+    ScopeIds ids(*m_statements);
+    const std::int64_t saveId = ids.TouchSave(savefile);
+
+    // 记录被覆盖的旧快照引用的 blob，写入新快照后回收不再被任何存档引用的部分
+    std::vector<std::int64_t> previousBlobs;
+    {
+        const auto query = m_statements->Acquire(StoreSql::kSelectSaveBlobs);
+        query->bind(1, saveId);
+        while (query->executeStep())
+        {
+            previousBlobs.push_back(query->getColumn(0).getInt64());
+        }
+    }
+
+    std::size_t carriedNamespaces = 0;
+    if (carry)
+    {
+        carriedNamespaces = CarryOverNamespaces(ids, savefile, saveId, entries, *carry);
+    }
+    else
+    {
+        const auto deleteStmt = m_statements->Acquire(StoreSql::kDeleteSave);
+        deleteStmt->bind(1, saveId);
+        deleteStmt->exec();
+    }
+
+    // 大值按内容哈希只存一份，存档行只保存 key -> hash 的引用
+    BlobWriter blobs(*m_statements);
+    CodecStats stats;
+    if (!entries.empty())
+    {
+        const auto stmt = m_statements->Acquire(StoreSql::kInsertSaveRow);
+        std::string compressed;
+        for (const auto& [k, v] : entries)
+        {
+            const std::size_t prefixLength = NamespacePrefixLength(k);
+            stmt->bind(1, saveId);
+            stmt->bind(2, ids.InternNamespace(std::string_view(k).substr(0, prefixLength)));
+            stmt->bindNoCopy(3, k.c_str() + prefixLength);
+            if (v.is_blob_ref())
+            {
+                // 从未读取的大值：直接引用原有的 blob
+                stmt->bind(4, v.as_blob_ref().storedType);
+                stmt->bind(5);
+                stmt->bind(6, v.as_blob_ref().id);
+                stmt->exec();
+                stmt->reset();
+                continue;
+            }
+            // 压缩后的值同样按内容去重，相同原文的压缩结果相同
+            const bool isCompressed = v.is_string() && CompressValue(v.as_string(), compressed, stats);
+            stmt->bind(4, isCompressed ? v.storeType() | kCompressedValueFlag : v.storeType());
+            if (isCompressed && v.as_string().size() >= kBlobValueThreshold)
+            {
+                stmt->bind(5);
+                stmt->bind(6, blobs.Intern(compressed, true));
+            }
+            else if (isCompressed)
+            {
+                stmt->bindNoCopy(5, compressed.data(), static_cast<int>(compressed.size()));
+                stmt->bind(6);
+            }
+            else if (v.is_string() && v.as_string().size() >= kBlobValueThreshold)
+            {
+                stmt->bind(5);
+                stmt->bind(6, blobs.Intern(v.as_string()));
+            }
+            else
+            {
+                bindValue(*stmt, 5, v);
+                stmt->bind(6);
+            }
+            stmt->exec();
+            stmt->reset();
+        }
+    }
+    const int releasedBlobs = blobs.ReleaseUnreferenced(previousBlobs);
+    transaction.commit();
+    m_codecStats += stats;
+    LogInfo("Data saved: %zu entries, %zu namespaces carried over, %d new blobs, %d shared blobs, %d released blobs",
+            entries.size(),
+            carriedNamespaces,
+            blobs.newBlobCount(),
+            blobs.sharedBlobCount(),
+            releasedBlobs);
+    LogCodecStats("Save", stats);
+}
+
+std::vector<StoredSave> SqliteEngine::ListSaves()
+{
+    std::vector<StoredSave> saves;
+    const auto query = m_statements->Acquire(StoreSql::kSelectStoredSaves);
+    while (query->executeStep())
+    {
+        saves.push_back({
+            query->getColumn(0).getString(),
+            static_cast<std::uint64_t>(query->getColumn(2).getInt64()),
+            query->getColumn(1).getInt64(),
+        });
+    }
+    return saves;
+}
+
+std::uint64_t SqliteEngine::DeleteScope(const StoredSave& save, const std::uint32_t maxEntries)
+{
+    // 若存档在列出之后被重新写入（updated_at 变化），不删除任何行
+    SQLite::Transaction transaction(*m_db);
+    std::int64_t saveId = 0;
+    {
+        const auto find = m_statements->Acquire(StoreSql::kFindSaveVersion);
+        find->bind(1, save.savefile);
+        find->bind(2, save.version);
+        if (!find->executeStep())
+        {
+            return 0;
+        }
+        saveId = find->getColumn(0).getInt64();
+    }
+
+    struct Row
+    {
+        std::int64_t nsId;
+        std::string key;
+        std::optional<std::int64_t> hash;
+    };
+    std::vector<Row> rows;
+    {
+        const auto query = m_statements->Acquire(StoreSql::kSelectSaveRows);
+        query->bind(1, saveId);
+        query->bind(2, static_cast<std::int64_t>(maxEntries));
+        while (query->executeStep())
+        {
+            const SQLite::Column hash = query->getColumn(2);
+            rows.push_back({
+                query->getColumn(0).getInt64(),
+                query->getColumn(1).getString(),
+                hash.isNull() ? std::nullopt : std::optional(hash.getInt64()),
+            });
+        }
+    }
+
+    std::vector<std::int64_t> hashes;
+    {
+        const auto deleteStmt = m_statements->Acquire(StoreSql::kDeleteSaveRow);
+        for (const auto& row : rows)
+        {
+            deleteStmt->bind(1, saveId);
+            deleteStmt->bind(2, row.nsId);
+            deleteStmt->bind(3, row.key);
+            deleteStmt->exec();
+            deleteStmt->reset();
+            if (row.hash)
+            {
+                hashes.push_back(*row.hash);
+            }
+        }
+    }
+    BlobWriter blobs(*m_statements);
+    const int releasedBlobs = blobs.ReleaseUnreferenced(hashes);
+    if (rows.size() < maxEntries)
+    {
+        const auto entry = m_statements->Acquire(StoreSql::kDeleteSaveEntry);
+        entry->bind(1, saveId);
+        entry->exec();
+    }
+    transaction.commit();
+    if (releasedBlobs > 0)
+    {
+        LogDebug("Deleted %zu entries of %s, released %d blobs.", rows.size(), save.savefile.c_str(), releasedBlobs);
+    }
+    return rows.size();
+}
+
+bool SqliteEngine::HasIdleWork() const
+{
+    return (m_checkpointPolicy.enabled && m_walPages.load(std::memory_order_relaxed) > 0)
+        || m_vacuumPending
+        || m_backup.Due(m_db->getHandle());
+}
+
+bool SqliteEngine::Idle()
+{
+    if (!m_vacuumContinuing && m_checkpointPolicy.enabled && m_walPages.load(std::memory_order_relaxed) > 0)
+    {
+        // 空闲整理分步进行时只在其结束后 checkpoint，中途由 WAL 大小上限兜底
+        Checkpoint("idle", SQLITE_CHECKPOINT_PASSIVE);
+    }
+    if (m_vacuumPending)
+    {
+        m_vacuumPending = false;
+        m_vacuumContinuing = m_vacuum.Step(*m_db);
+        m_vacuumPending = m_vacuumContinuing;
+    }
+    else
+    {
+        // 每步只复制少量页，之间的写入任务不受影响
+        m_backupContinuing = m_backup.Step(m_db->getHandle());
+    }
+    CheckpointIfOverLimit();
+    return m_vacuumContinuing || m_backupContinuing;
+}
+
+void SqliteEngine::AfterTask()
+{
+    CheckpointIfOverLimit();
+    // 写入之后重新检查是否需要整理
+    m_vacuumPending = true;
+    m_vacuumContinuing = false;
+}
+
+void SqliteEngine::OnMaintenanceWindow()
+{
+    if (m_checkpointPolicy.enabled)
+    {
+        Checkpoint("requested", SQLITE_CHECKPOINT_PASSIVE);
+    }
+}
+
+int SqliteEngine::OnWalCommit(void* context, sqlite3* /*db*/, const char* /*dbName*/, const int pages)
+{
+    static_cast<SqliteEngine*>(context)->m_walPages.store(pages, std::memory_order_relaxed);
+    return SQLITE_OK;
+}
+
+void SqliteEngine::CheckpointIfOverLimit()
+{
+    if (m_checkpointPolicy.enabled
+        && static_cast<std::uint64_t>(m_walPages.load(std::memory_order_relaxed)) * m_pageSize
+        >= m_checkpointPolicy.walLimitBytes)
+    {
+        // TRUNCATE also resets the WAL file, which bounds its size on disk.
+        Checkpoint("size limit", SQLITE_CHECKPOINT_TRUNCATE);
+    }
+}
+
+void SqliteEngine::Checkpoint(const char* reason, const int mode)
+{
+    const auto start = std::chrono::steady_clock::now();
+    int logFrames = 0;
+    int checkpointedFrames = 0;
+    if (const int rc = sqlite3_wal_checkpoint_v2(m_db->getHandle(), nullptr, mode, &logFrames, &checkpointedFrames);
+        rc != SQLITE_OK)
+    {
+        LogWarn("WAL checkpoint (%s) failed: %s", reason, sqlite3_errmsg(m_db->getHandle()));
+        return;
+    }
+    if (checkpointedFrames >= logFrames)
+    {
+        m_walPages.store(0, std::memory_order_relaxed);
+    }
+    const auto elapsed = std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now() - start).count();
+    LogDebug("WAL checkpoint (%s): %d/%d frames in %lld us.",
+             reason,
+             checkpointedFrames,
+             logFrames,
+             static_cast<long long>(elapsed));
+}
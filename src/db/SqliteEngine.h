@@ -0,0 +1,168 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <SQLiteCpp/SQLiteCpp.h>
+
+#include "BackupDriver.h"
+#include "HydrationPool.h"
+#include "StatementCache.h"
+#include "StorageEngine.h"
+#include "VacuumDriver.h"
+
+struct sqlite3;
+class ScopeIds;
+
+// When the database runs in WAL mode with automatic checkpoints disabled, the engine
+// schedules checkpoints itself: once the writer has been idle, when a maintenance window
+// is signaled (for example a loading screen), or when the WAL grows past walLimitBytes.
+struct CheckpointPolicy
+{
+    bool enabled = false;
+    std::uint64_t walLimitBytes = 0;
+};
+
+// String values of at least minBytes are stored LZ4-compressed when that makes them at
+// least an eighth smaller. 0 disables compression; compressed rows are read either way.
+struct CompressionPolicy
+{
+    std::size_t minBytes = 0;
+};
+
+// String values whose stored form is at least minBytes are loaded as BlobRef stubs and read
+// by ReadBlob on first use. Such global values are also kept in Blobs (save values of at
+// least kBlobValueThreshold always are). 0 loads everything eagerly.
+struct LazyValuePolicy
+{
+    std::size_t minBytes = 0;
+};
+
+// Scopes of more than batchRows rows are decoded on threads worker threads, a batch at a
+// time, while the persistence thread reads the next rows from SQLite. 0 decodes every row
+// on the persistence thread.
+struct HydrationPolicy
+{
+    std::size_t threads = 0;
+    std::size_t batchRows = 4096;
+};
+
+// Value compression counters: those of each save, flush and load are logged with it, and
+// the totals since the engine was opened are kept in SqliteEngine::codecStats().
+struct CodecStats
+{
+    std::uint64_t compressedValues = 0;
+    // Size of the compressed values before and after compression.
+    std::uint64_t rawBytes = 0;
+    std::uint64_t storedBytes = 0;
+    std::uint64_t decompressedValues = 0;
+    std::chrono::nanoseconds compressTime{0};
+    std::chrono::nanoseconds decompressTime{0};
+
+    double ratio() const { return storedBytes > 0 ? static_cast<double>(rawBytes) / static_cast<double>(storedBytes) : 1.0; }
+    CodecStats& operator+=(const CodecStats& other);
+};
+
+// The SQLite storage engine: Store/Saves/Namespaces/Blobs tables (see StoreSchema.h) with
+// prepared statements, WAL checkpoint scheduling, incremental vacuum and rolling backups.
+class SqliteEngine final : public StorageEngine
+{
+public:
+    // Migrates the schema of db to the current version.
+    SqliteEngine(std::unique_ptr<SQLite::Database> db,
+                 const CheckpointPolicy& checkpointPolicy,
+                 const CompressionPolicy& compressionPolicy = {},
+                 const LazyValuePolicy& lazyValuePolicy = {},
+                 const BackupPolicy& backupPolicy = {},
+                 const HydrationPolicy& hydrationPolicy = {});
+    ~SqliteEngine() override;
+
+    const char* name() const override { return "sqlite"; }
+
+    void LoadScope(const std::string& savefile, ValueMap& out) override;
+    void LoadNamespaces(const std::string& savefile, const std::vector<std::string>& prefixes, ValueMap& out) override;
+    std::vector<std::string> ListNamespaces(const std::string& savefile) override;
+    std::string ReadBlob(const BlobRef& ref) override;
+    std::string LatestSave() override;
+    BatchResult ApplyBatch(const GlobalBatch& batch) override;
+    void SnapshotSave(const std::string& savefile, const ValueMap& entries) override;
+    void SnapshotSaveFrom(const std::string& savefile, const ValueMap& entries, const SaveCarryOver& carry) override;
+    std::vector<StoredSave> ListSaves() override;
+    std::uint64_t DeleteScope(const StoredSave& save, std::uint32_t maxEntries) override;
+    std::int64_t GlobalVersion() override;
+
+    bool HasIdleWork() const override;
+    bool Idle() override;
+    void AfterTask() override;
+    void OnMaintenanceWindow() override;
+
+    // Applies upserts and deletes to savefile as ApplyBatch does to the global scope, keeping
+    // its other entries and creating it when needed. The game replaces saves as a whole;
+    // this is for offline imports.
+    BatchResult ApplySaveBatch(const std::string& savefile, const GlobalBatch& batch);
+
+    const CodecStats& codecStats() const { return m_codecStats; }
+    // Decodes the value column of a Store or Blobs row stored with type (including
+    // kCompressedValueFlag). Malformed values are logged and read as false.
+    static ScriptValue ReadStoredValue(int type, const SQLite::Column& column, CodecStats& stats);
+
+private:
+    struct LoadStats
+    {
+        CodecStats codec;
+        std::uint64_t deferredValues = 0;
+        std::uint64_t deferredBytes = 0;
+
+        LoadStats& operator+=(const LoadStats& other);
+    };
+
+    // Rows of a scope query copied out of SQLite, to be decoded on another thread.
+    struct RowBatch;
+
+    // Adds the rows of a kSelectScope query to out, decoding them on m_hydrationPool when
+    // there are more than a batch of them.
+    void ReadScopeRows(SQLite::Statement& stmt, ValueMap& out, LoadStats& stats);
+    void FinishLoad(const LoadStats& stats);
+    // Applies batch to savefile, the global scope when it is empty. operation names it in logs.
+    BatchResult WriteBatch(const std::string& savefile, const GlobalBatch& batch, const char* operation);
+    // Replaces the stored entries of savefile by entries; carry is null for SnapshotSave.
+    void WriteSave(const std::string& savefile, const ValueMap& entries, const SaveCarryOver* carry);
+    // Deletes the rows of saveId that entries replaces and copies the namespaces carry keeps
+    // from carry.base when it is another save. Returns the number of namespaces kept.
+    std::size_t CarryOverNamespaces(ScopeIds& ids,
+                                    const std::string& savefile,
+                                    std::int64_t saveId,
+                                    const ValueMap& entries,
+                                    const SaveCarryOver& carry);
+    // Fills stored with the compressed form of value and returns true when compression is
+    // enabled for its size and pays off.
+    bool CompressValue(const std::string& value, std::string& stored, CodecStats& stats) const;
+    void Checkpoint(const char* reason, int mode);
+    void CheckpointIfOverLimit();
+    static int OnWalCommit(void* context, sqlite3* db, const char* dbName, int pages);
+
+    std::unique_ptr<SQLite::Database> m_db;
+    // Destroyed before m_db: statements must be finalized while the connection is open.
+    std::unique_ptr<StatementCache> m_statements;
+    CheckpointPolicy m_checkpointPolicy;
+    CompressionPolicy m_compressionPolicy;
+    LazyValuePolicy m_lazyValuePolicy;
+    HydrationPolicy m_hydrationPolicy;
+    // Null when hydrationPolicy.threads is 0.
+    std::unique_ptr<HydrationPool> m_hydrationPool;
+    CodecStats m_codecStats;
+    std::uint64_t m_pageSize = 4096;
+    // WAL frames written since the last complete checkpoint, reported by the WAL hook.
+    std::atomic<int> m_walPages{0};
+    VacuumDriver m_vacuum;
+    bool m_vacuumPending = true;
+    bool m_vacuumContinuing = false;
+    // Destroyed before m_db: an unfinished backup reads from the connection.
+    BackupDriver m_backup;
+    bool m_backupContinuing = false;
+};
@@ -0,0 +1,21 @@
+#include "StatementCache.h"
+
+void StatementCache::Prepare(const char* sql)
+{
+    Find(sql);
+}
+
+ScopedStatement StatementCache::Acquire(const char* sql)
+{
+    return ScopedStatement(Find(sql));
+}
+
+SQLite::Statement& StatementCache::Find(const char* sql)
+{
+    auto& stmt = m_statements[sql];
+    if (!stmt)
+    {
+        stmt = std::make_unique<SQLite::Statement>(m_db, sql);
+    }
+    return *stmt;
+}
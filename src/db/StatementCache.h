@@ -0,0 +1,61 @@
+#pragma once
+
+#include <memory>
+#include <string>
+#include <unordered_map>
+
+#include <SQLiteCpp/SQLiteCpp.h>
+
+// Resets a cached statement and clears its bindings when it goes out of scope, so an
+// exception in the middle of a step never leaves a statement holding a read lock.
+class ScopedStatement final
+{
+public:
+    explicit ScopedStatement(SQLite::Statement& stmt) : m_stmt(stmt) {}
+    ~ScopedStatement()
+    {
+        try
+        {
+            m_stmt.reset();
+        }
+        catch (...)
+        {
+        }
+        try
+        {
+            m_stmt.clearBindings();
+        }
+        catch (...)
+        {
+        }
+    }
+    ScopedStatement(const ScopedStatement&) = delete;
+    ScopedStatement& operator=(const ScopedStatement&) = delete;
+
+    SQLite::Statement* operator->() const { return &m_stmt; }
+    SQLite::Statement& operator*() const { return m_stmt; }
+
+private:
+    SQLite::Statement& m_stmt;
+};
+
+// Prepared statements for one connection, prepared once and reused for the lifetime of
+// the connection. Only use it from the thread that currently owns the connection
+// (a PersistenceWriter task or Run()), and do not acquire the same SQL twice at once.
+class StatementCache final
+{
+public:
+    explicit StatementCache(SQLite::Database& db) : m_db(db) {}
+    StatementCache(const StatementCache&) = delete;
+    StatementCache& operator=(const StatementCache&) = delete;
+
+    // Prepares sql ahead of its first use.
+    void Prepare(const char* sql);
+    ScopedStatement Acquire(const char* sql);
+
+private:
+    SQLite::Statement& Find(const char* sql);
+
+    SQLite::Database& m_db;
+    std::unordered_map<std::string, std::unique_ptr<SQLite::Statement>> m_statements;
+};
@@ -0,0 +1,55 @@
+#include "StorageEngine.h"
+
+#include <string_view>
+
+namespace
+{
+std::string_view PrefixOf(const std::string_view key)
+{
+    return key.substr(0, NamespacePrefixLength(key));
+}
+}
+
+void StorageEngine::LoadNamespaces(const std::string& savefile, const std::vector<std::string>& prefixes, ValueMap& out)
+{
+    // 默认实现读取整个作用域后过滤；能按命名空间读取的引擎应当覆盖
+    ValueMap scope;
+    LoadScope(savefile, scope);
+    const std::unordered_set<std::string_view> wanted(prefixes.begin(), prefixes.end());
+    for (auto& [k, v] : scope)
+    {
+        if (wanted.contains(PrefixOf(k)))
+        {
+            out.emplace(k, std::move(v));
+        }
+    }
+}
+
+std::vector<std::string> StorageEngine::ListNamespaces(const std::string& savefile)
+{
+    ValueMap scope;
+    LoadScope(savefile, scope);
+    std::unordered_set<std::string_view> prefixes;
+    for (const auto& [k, v] : scope)
+    {
+        prefixes.emplace(PrefixOf(k));
+    }
+    return {prefixes.begin(), prefixes.end()};
+}
+
+void StorageEngine::SnapshotSaveFrom(const std::string& savefile, const ValueMap& entries, const SaveCarryOver& carry)
+{
+    ValueMap merged;
+    LoadScope(carry.base, merged);
+    std::unordered_set<std::string_view> replaced(carry.loadedPrefixes.begin(), carry.loadedPrefixes.end());
+    for (const auto& [k, v] : entries)
+    {
+        replaced.emplace(PrefixOf(k));
+    }
+    std::erase_if(merged, [&replaced](const auto& entry) { return replaced.contains(PrefixOf(entry.first)); });
+    for (const auto& [k, v] : entries)
+    {
+        merged.insert_or_assign(k, v);
+    }
+    SnapshotSave(savefile, merged);
+}
@@ -0,0 +1,118 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+#include "ScriptValue.h"
+
+using ValueMap = std::unordered_map<std::string, ScriptValue>;
+
+// Length of the "Namespace:" prefix DB.Create puts in front of keys, including the colon;
+// 0 when the key has none.
+inline std::size_t NamespacePrefixLength(const std::string_view key)
+{
+    const auto pos = key.find(':');
+    return pos == std::string_view::npos ? 0 : pos + 1;
+}
+
+// Approximate heap usage of a cached entry: hash node, key and string value.
+inline std::size_t EstimateEntryBytes(const std::string_view key, const ScriptValue& value)
+{
+    constexpr std::size_t kEntryOverhead = 64;
+    return kEntryOverhead + key.size() + (value.is_string() ? value.as_string().size() : 0);
+}
+
+// SetG/DelG changes collected since the last global flush.
+struct GlobalBatch
+{
+    std::vector<std::pair<std::string, ScriptValue>> upserts;
+    std::vector<std::string> deletes;
+};
+
+struct BatchResult
+{
+    std::size_t upserted = 0;
+    std::size_t deleted = 0;
+    // Ascending indices into GlobalBatch::upserts of the entries that were not written; the
+    // rest of the batch is committed without them.
+    std::vector<std::size_t> failedUpserts;
+};
+
+// Namespaces of a save that were never loaded into memory. SnapshotSaveFrom copies their
+// stored entries from base instead of taking them from the entries it is given.
+struct SaveCarryOver
+{
+    std::string base;
+    // "Name:" prefixes (see NamespacePrefixLength) that entries holds in full.
+    std::unordered_set<std::string> loadedPrefixes;
+};
+
+struct StoredSave
+{
+    std::string savefile;
+    std::uint64_t entries = 0;
+    // Changes whenever the save is written again; DeleteScope uses it to detect that.
+    std::int64_t version = 0;
+};
+
+// Where LuaDB keeps its data. The global scope is the empty savefile name.
+//
+// Every method is called on the persistence writer thread (or under its lock through
+// PersistenceWriter::Run) and is atomic on its own: either all of its changes become
+// durable or none do.
+class StorageEngine
+{
+public:
+    virtual ~StorageEngine() = default;
+
+    virtual const char* name() const = 0;
+
+    // Adds every entry stored for savefile to out. Large strings may be added as BlobRef
+    // stubs; their bytes are read by ReadBlob when needed.
+    virtual void LoadScope(const std::string& savefile, ValueMap& out) = 0;
+    // Adds the entries of savefile whose "Name:" prefix is one of prefixes, as LoadScope does.
+    virtual void LoadNamespaces(const std::string& savefile, const std::vector<std::string>& prefixes, ValueMap& out);
+    // The "Name:" prefixes of the namespaces savefile has entries in.
+    virtual std::vector<std::string> ListNamespaces(const std::string& savefile);
+    // The string a BlobRef from LoadScope stands for. Throws when it is no longer stored,
+    // which only happens once no scope references it anymore.
+    virtual std::string ReadBlob(const BlobRef& /*ref*/)
+    {
+        throw std::logic_error("storage engine keeps no values out of line");
+    }
+    // The save scope written most recently, or an empty string when there is none.
+    virtual std::string LatestSave() = 0;
+    // Applies SetG/DelG changes to the global scope.
+    virtual BatchResult ApplyBatch(const GlobalBatch& batch) = 0;
+    // Replaces everything stored for savefile with entries.
+    virtual void SnapshotSave(const std::string& savefile, const ValueMap& entries) = 0;
+    // Like SnapshotSave, but keeps the entries stored for carry.base (which may be savefile
+    // itself) in every namespace that is neither in carry.loadedPrefixes nor used by a key
+    // of entries.
+    virtual void SnapshotSaveFrom(const std::string& savefile, const ValueMap& entries, const SaveCarryOver& carry);
+    // Every save scope, without the global scope.
+    virtual std::vector<StoredSave> ListSaves() = 0;
+    // Deletes up to maxEntries entries of save, or nothing if it was written after it was
+    // listed, and drops the scope once it is empty. Returns the number of entries deleted.
+    virtual std::uint64_t DeleteScope(const StoredSave& save, std::uint32_t maxEntries) = 0;
+    // Counter bumped by every ApplyBatch, so a copy of the global scope tagged with it can
+    // tell whether it is still current. 0 when the engine does not keep one.
+    virtual std::int64_t GlobalVersion() { return 0; }
+
+    // Background maintenance, driven by the writer thread.
+    // True while Idle() should be called once the writer has been idle for a while.
+    virtual bool HasIdleWork() const { return false; }
+    // Does one short step of maintenance; true when the next step should follow shortly.
+    virtual bool Idle() { return false; }
+    // Called after every task.
+    virtual void AfterTask() {}
+    // Called when writes are expected to be rare for a while, e.g. during a loading screen.
+    virtual void OnMaintenanceWindow() {}
+};
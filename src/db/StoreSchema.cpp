@@ -0,0 +1,387 @@
+#include "StoreSchema.h"
+
+#include <stdexcept>
+#include <string>
+
+#include "ContentHash.h"
+#include "../log/log.h"
+
+namespace
+{
+// 1: Store(key, savefile, type, value, created_at, updated_at) + Meta
+// 2: Store.hash references content-addressed Blobs for large save values
+// 3: Store.value has no type affinity; bools and numbers are stored as INTEGER/REAL
+// 4: WITHOUT ROWID Store keyed by (save_id, ns_id, key) with Saves/Namespaces dictionaries
+// 5: Store.type may carry kCompressedValueFlag; existing rows stay valid as they are
+constexpr int kSchemaVersion = 5;
+
+// 同一哈希下最多顺延的 id 数；真实数据中 XXH64 冲突几乎不会出现
+constexpr int kMaxBlobProbes = 64;
+
+constexpr char kCreateDictionaries[] = R"(
+    CREATE TABLE Saves (
+        id INTEGER PRIMARY KEY,
+        name TEXT NOT NULL UNIQUE,
+        updated_at INTEGER NOT NULL DEFAULT 0
+    );
+    CREATE TABLE Namespaces (
+        id INTEGER PRIMARY KEY,
+        prefix TEXT NOT NULL UNIQUE
+    );
+    INSERT INTO Saves (id, name) VALUES (0, '');
+    INSERT INTO Namespaces (id, prefix) VALUES (0, '');
+)";
+
+// 当前版本的 Store 表；%s 为表名，迁移时先建临时名再改名
+constexpr char kCreateStore[] = R"(
+    CREATE TABLE %s (
+        save_id INTEGER NOT NULL,
+        ns_id INTEGER NOT NULL,
+        key TEXT NOT NULL,
+        type INTEGER NOT NULL,
+        value,
+        hash INTEGER,
+        PRIMARY KEY (save_id, ns_id, key)
+    ) WITHOUT ROWID
+)";
+
+constexpr char kCreateBlobs[] = R"(
+    CREATE TABLE IF NOT EXISTS Blobs (
+        hash INTEGER PRIMARY KEY,
+        value TEXT NOT NULL
+    )
+)";
+
+std::string StoreTableSql(const char* name)
+{
+    std::string sql = kCreateStore;
+    sql.replace(sql.find("%s"), 2, name);
+    return sql;
+}
+
+int ReadSchemaVersion(SQLite::Database& db)
+{
+    SQLite::Statement query(db, "SELECT value FROM Meta WHERE key = 'schema_version'");
+    if (!query.executeStep())
+    {
+        return 1;
+    }
+    try
+    {
+        return std::stoi(query.getColumn(0).getString());
+    }
+    catch (...)
+    {
+        return 1;
+    }
+}
+
+void WriteSchemaVersion(SQLite::Database& db, const int version)
+{
+    SQLite::Statement update(db, "INSERT OR REPLACE INTO Meta (key, value) VALUES ('schema_version', ?)");
+    update.bind(1, std::to_string(version));
+    update.exec();
+}
+
+void MigrateToContentAddressedValues(SQLite::Database& db)
+{
+    db.exec("ALTER TABLE Store ADD COLUMN hash INTEGER");
+    db.exec(kCreateBlobs);
+    db.exec("CREATE INDEX IF NOT EXISTS idx_store_hash ON Store(hash) WHERE hash IS NOT NULL");
+
+    // 将已有存档行中的大值移入 Blobs，相同内容只保留一份
+    std::vector<std::int64_t> rowIds;
+    {
+        SQLite::Statement query(db, "SELECT rowid FROM Store WHERE savefile <> '' AND length(CAST(value AS BLOB)) >= ?");
+        query.bind(1, static_cast<std::int64_t>(kBlobValueThreshold));
+        while (query.executeStep())
+        {
+            rowIds.push_back(query.getColumn(0).getInt64());
+        }
+    }
+
+    StatementCache statements(db);
+    BlobWriter blobs(statements);
+    SQLite::Statement select(db, "SELECT value FROM Store WHERE rowid = ?");
+    SQLite::Statement update(db, "UPDATE Store SET value = NULL, hash = ? WHERE rowid = ?");
+    for (const auto rowId : rowIds)
+    {
+        select.bind(1, rowId);
+        if (select.executeStep())
+        {
+            const std::string value = select.getColumn(0).getString();
+            update.bind(1, blobs.Intern(value));
+            update.bind(2, rowId);
+            update.exec();
+            update.reset();
+        }
+        select.reset();
+    }
+    LogInfo("Schema migration: moved %zu save values into %d shared blobs.", rowIds.size(), blobs.newBlobCount());
+}
+
+void MigrateToNativeValueTypes(SQLite::Database& db)
+{
+    // value 列声明为 TEXT 时 SQLite 会把绑定的数字转回文本，因此需要重建表去掉类型亲和性
+    db.exec(R"(
+        CREATE TABLE Store_v3 (
+            key TEXT NOT NULL,
+            savefile TEXT,
+            type INTEGER,
+            value,
+            created_at INTEGER DEFAULT CURRENT_TIMESTAMP,
+            updated_at INTEGER DEFAULT CURRENT_TIMESTAMP,
+            hash INTEGER,
+            UNIQUE (key, savefile)
+        )
+    )");
+    SQLite::Statement copy(db, R"(
+        INSERT INTO Store_v3 (rowid, key, savefile, type, value, created_at, updated_at, hash)
+        SELECT rowid, key, savefile, type,
+               CASE
+                   WHEN value IS NULL THEN NULL
+                   WHEN type = ? THEN CAST(value AS INTEGER) <> 0
+                   WHEN type = ? THEN CAST(value AS REAL)
+                   ELSE value
+               END,
+               created_at, updated_at, hash
+        FROM Store ORDER BY rowid
+    )");
+    copy.bind(1, StoreValueType::kBool);
+    copy.bind(2, StoreValueType::kNumber);
+    const int converted = copy.exec();
+
+    db.exec("DROP TABLE Store");
+    db.exec("ALTER TABLE Store_v3 RENAME TO Store");
+    db.exec("CREATE INDEX IF NOT EXISTS idx_store_savefile ON Store(savefile)");
+    db.exec("CREATE INDEX IF NOT EXISTS idx_store_hash ON Store(hash) WHERE hash IS NOT NULL");
+    LogInfo("Schema migration: converted %d values to native column types.", converted);
+}
+
+void MigrateToCompactSchema(SQLite::Database& db)
+{
+    // 存档路径与 "Namespace:" 前缀各只存一份，行内只保留整数 id 和前缀之后的键名
+    db.exec(kCreateDictionaries);
+    db.exec(R"(
+        INSERT INTO Saves (name, updated_at)
+        SELECT savefile, COALESCE(CAST(strftime('%s', MAX(updated_at)) AS INTEGER), 0)
+        FROM Store WHERE savefile <> '' GROUP BY savefile ORDER BY MIN(rowid)
+    )");
+    db.exec(R"(
+        INSERT INTO Namespaces (prefix)
+        SELECT DISTINCT substr(key, 1, instr(key, ':')) FROM Store WHERE instr(key, ':') > 0
+    )");
+
+    db.exec(StoreTableSql("Store_v4"));
+    const int copied = db.exec(R"(
+        INSERT INTO Store_v4 (save_id, ns_id, key, type, value, hash)
+        SELECT s.id, n.id, substr(o.key, length(n.prefix) + 1), COALESCE(o.type, 0), o.value, o.hash
+        FROM Store o
+        JOIN Saves s ON s.name = COALESCE(o.savefile, '')
+        JOIN Namespaces n ON n.prefix = substr(o.key, 1, instr(o.key, ':'))
+    )");
+
+    db.exec("DROP TABLE Store");
+    db.exec("ALTER TABLE Store_v4 RENAME TO Store");
+    db.exec("CREATE INDEX IF NOT EXISTS idx_store_hash ON Store(hash) WHERE hash IS NOT NULL");
+    LogInfo("Schema migration: moved %d rows into the compact schema.", copied);
+}
+
+bool TableExists(SQLite::Database& db, const char* name)
+{
+    SQLite::Statement query(db, "SELECT 1 FROM sqlite_master WHERE type = 'table' AND name = ?");
+    query.bind(1, name);
+    return query.executeStep();
+}
+
+void CreateCurrentSchema(SQLite::Database& db)
+{
+    db.exec(kCreateDictionaries);
+    db.exec(StoreTableSql("Store"));
+    db.exec(kCreateBlobs);
+    db.exec("CREATE INDEX IF NOT EXISTS idx_store_hash ON Store(hash) WHERE hash IS NOT NULL");
+}
+}
+
+void InitializeSchema(SQLite::Database& db)
+{
+    db.exec(R"(
+        CREATE TABLE IF NOT EXISTS Meta (
+            key TEXT PRIMARY KEY,
+            value TEXT
+        )
+    )");
+
+    if (!TableExists(db, "Store"))
+    {
+        CreateCurrentSchema(db);
+        WriteSchemaVersion(db, kSchemaVersion);
+        return;
+    }
+
+    const int version = ReadSchemaVersion(db);
+    if (version >= kSchemaVersion)
+    {
+        return;
+    }
+    LogInfo("Migrating LuaDB schema from version %d to %d.", version, kSchemaVersion);
+    if (version < 2)
+    {
+        MigrateToContentAddressedValues(db);
+    }
+    if (version < 3)
+    {
+        MigrateToNativeValueTypes(db);
+    }
+    if (version < 4)
+    {
+        MigrateToCompactSchema(db);
+    }
+    WriteSchemaVersion(db, kSchemaVersion);
+}
+
+void PrepareStoreStatements(StatementCache& statements)
+{
+    for (const char* sql : {
+             StoreSql::kSelectScope,
+             StoreSql::kSelectScopeNamespace,
+             StoreSql::kSelectScopePrefixes,
+             StoreSql::kSelectBlob,
+             StoreSql::kSelectLatestSave,
+             StoreSql::kTouchSave,
+             StoreSql::kSelectNamespace,
+             StoreSql::kInsertNamespace,
+             StoreSql::kSelectSaveBlobs,
+             StoreSql::kDeleteSave,
+             StoreSql::kSelectSaveId,
+             StoreSql::kSelectSaveNamespaces,
+             StoreSql::kDeleteSaveNamespace,
+             StoreSql::kCopySaveNamespace,
+             StoreSql::kInsertSaveRow,
+             StoreSql::kDeleteEntry,
+             StoreSql::kSelectEntryHash,
+             StoreSql::kUpsertEntry,
+             StoreSql::kSelectStoredSaves,
+             StoreSql::kFindSaveVersion,
+             StoreSql::kSelectSaveRows,
+             StoreSql::kDeleteSaveRow,
+             StoreSql::kDeleteSaveEntry,
+             StoreSql::kInsertBlob,
+             StoreSql::kMatchBlob,
+             StoreSql::kReleaseBlob,
+             StoreSql::kSelectGlobalVersion,
+             StoreSql::kBumpGlobalVersion,
+         })
+    {
+        statements.Prepare(sql);
+    }
+}
+
+BlobWriter::BlobWriter(StatementCache& statements) :
+    m_statements(statements)
+{
+}
+
+std::int64_t BlobWriter::Intern(const std::string& value, const bool compressed)
+{
+    const auto bindValue = [&](SQLite::Statement& stmt, const int index)
+    {
+        if (compressed)
+        {
+            stmt.bindNoCopy(index, value.data(), static_cast<int>(value.size()));
+        }
+        else
+        {
+            stmt.bind(index, value);
+        }
+    };
+    const std::uint64_t hash = ContentHash::Hash64(value);
+    for (int probe = 0; probe < kMaxBlobProbes; ++probe)
+    {
+        // 在无符号范围内顺延，越过 INT64_MAX 时回绕而不是有符号溢出
+        const auto id = static_cast<std::int64_t>(hash + static_cast<std::uint64_t>(probe));
+        {
+            const auto insert = m_statements.Acquire(StoreSql::kInsertBlob);
+            insert->bind(1, id);
+            bindValue(*insert, 2);
+            if (insert->exec() > 0)
+            {
+                ++m_newBlobs;
+                return id;
+            }
+        }
+
+        const auto match = m_statements.Acquire(StoreSql::kMatchBlob);
+        bindValue(*match, 1);
+        match->bind(2, id);
+        if (match->executeStep() && match->getColumn(0).getInt() != 0)
+        {
+            ++m_sharedBlobs;
+            return id;
+        }
+        // 哈希冲突：内容不同，顺延到下一个 id
+    }
+    throw std::runtime_error("too many blob hash collisions");
+}
+
+int BlobWriter::ReleaseUnreferenced(const std::vector<std::int64_t>& hashes)
+{
+    int released = 0;
+    const auto release = m_statements.Acquire(StoreSql::kReleaseBlob);
+    for (const auto hash : hashes)
+    {
+        release->bind(1, hash);
+        released += release->exec();
+        release->reset();
+    }
+    return released;
+}
+
+ScopeIds::ScopeIds(StatementCache& statements) :
+    m_statements(statements)
+{
+}
+
+std::int64_t ScopeIds::TouchSave(const std::string& savefile)
+{
+    const auto touch = m_statements.Acquire(StoreSql::kTouchSave);
+    touch->bind(1, savefile);
+    touch->executeStep();
+    return touch->getColumn(0).getInt64();
+}
+
+std::int64_t ScopeIds::InternNamespace(const std::string_view prefix)
+{
+    if (const auto id = FindNamespace(prefix); id >= 0)
+    {
+        return id;
+    }
+    const std::string key(prefix);
+    const auto insert = m_statements.Acquire(StoreSql::kInsertNamespace);
+    insert->bind(1, key);
+    insert->executeStep();
+    const auto id = insert->getColumn(0).getInt64();
+    m_namespaces.emplace(key, id);
+    return id;
+}
+
+std::int64_t ScopeIds::FindNamespace(const std::string_view prefix)
+{
+    if (prefix.empty())
+    {
+        return 0;
+    }
+    const std::string key(prefix);
+    if (const auto it = m_namespaces.find(key); it != m_namespaces.end())
+    {
+        return it->second;
+    }
+    const auto query = m_statements.Acquire(StoreSql::kSelectNamespace);
+    query->bind(1, key);
+    const std::int64_t id = query->executeStep() ? query->getColumn(0).getInt64() : -1;
+    if (id >= 0)
+    {
+        m_namespaces.emplace(key, id);
+    }
+    return id;
+}
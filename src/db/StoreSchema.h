@@ -0,0 +1,155 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include <SQLiteCpp/SQLiteCpp.h>
+
+#include "ScriptValue.h"
+#include "StatementCache.h"
+#include "StorageEngine.h"
+
+// Serialized values at least this long are stored once in the content-addressed Blobs
+// table and referenced from Store.hash; shorter values stay inline in Store.value.
+constexpr std::size_t kBlobValueThreshold = 64;
+
+// Set in Store.type on rows whose value, inline or in Blobs, is compressed: a BLOB holding
+// the u32 length of the string in host byte order (little-endian on the x64 targets the
+// plugin ships for) followed by an LZ4 block (see Lz4Block.h).
+constexpr int kCompressedValueFlag = 0x100;
+
+// Saves.id of the global scope (SetG/GetG); Namespaces.id 0 is the empty prefix. Keys are
+// split at NamespacePrefixLength: the prefix is stored once in Namespaces, the rest in Store.key.
+constexpr std::int64_t kGlobalSaveId = 0;
+
+// sqlite3_libversion_number() of the oldest SQLite providing octet_length(), used by StoreSql.
+constexpr int kMinSqliteVersionNumber = 3043000;
+
+// SQL used on every flush, save and load. Prepared once per connection by
+// PrepareStoreStatements and reused through StatementCache.
+namespace StoreSql
+{
+// Blob values of at least ?2 stored bytes (none when ?2 is 0) are returned as a NULL value
+// with their hash and size: octet_length() reads the record header only, so their overflow
+// pages are never loaded.
+inline constexpr char kSelectScope[] = R"sql(
+    SELECT n.prefix || s.key, s.type, s.hash,
+           CASE WHEN ?2 > 0 AND s.hash IS NOT NULL AND octet_length(b.value) >= ?2 THEN NULL
+                ELSE COALESCE(s.value, b.value) END,
+           octet_length(b.value)
+    FROM Store s
+    JOIN Namespaces n ON n.id = s.ns_id
+    LEFT JOIN Blobs b ON b.hash = s.hash
+    WHERE s.save_id = (SELECT id FROM Saves WHERE name = ?1)
+)sql";
+// kSelectScope restricted to the namespace id ?3.
+inline constexpr char kSelectScopeNamespace[] = R"sql(
+    SELECT n.prefix || s.key, s.type, s.hash,
+           CASE WHEN ?2 > 0 AND s.hash IS NOT NULL AND octet_length(b.value) >= ?2 THEN NULL
+                ELSE COALESCE(s.value, b.value) END,
+           octet_length(b.value)
+    FROM Store s
+    JOIN Namespaces n ON n.id = s.ns_id
+    LEFT JOIN Blobs b ON b.hash = s.hash
+    WHERE s.save_id = (SELECT id FROM Saves WHERE name = ?1) AND s.ns_id = ?3
+)sql";
+// Prefixes of the namespaces save ?1 has rows in: one primary key probe per namespace.
+inline constexpr char kSelectScopePrefixes[] =
+    "SELECT prefix FROM Namespaces n WHERE EXISTS "
+    "(SELECT 1 FROM Store WHERE save_id = (SELECT id FROM Saves WHERE name = ?1) AND ns_id = n.id)";
+inline constexpr char kSelectBlob[] = "SELECT value FROM Blobs WHERE hash = ?";
+inline constexpr char kSelectLatestSave[] =
+    "SELECT name FROM Saves WHERE id <> 0 AND EXISTS (SELECT 1 FROM Store WHERE save_id = Saves.id) "
+    "ORDER BY updated_at DESC, id DESC LIMIT 1";
+inline constexpr char kTouchSave[] =
+    "INSERT INTO Saves (name, updated_at) VALUES (?, unixepoch()) "
+    "ON CONFLICT(name) DO UPDATE SET updated_at = excluded.updated_at RETURNING id";
+inline constexpr char kSelectNamespace[] = "SELECT id FROM Namespaces WHERE prefix = ?";
+inline constexpr char kInsertNamespace[] = "INSERT INTO Namespaces (prefix) VALUES (?) RETURNING id";
+inline constexpr char kSelectSaveBlobs[] = "SELECT DISTINCT hash FROM Store WHERE save_id = ? AND hash IS NOT NULL";
+inline constexpr char kDeleteSave[] = "DELETE FROM Store WHERE save_id = ?";
+inline constexpr char kSelectSaveId[] = "SELECT id FROM Saves WHERE name = ?";
+inline constexpr char kSelectSaveNamespaces[] = "SELECT DISTINCT ns_id FROM Store WHERE save_id = ?";
+inline constexpr char kDeleteSaveNamespace[] = "DELETE FROM Store WHERE save_id = ? AND ns_id = ?";
+// Copies the rows of namespace ?3 from save ?2 to save ?1; blobs are shared by hash.
+inline constexpr char kCopySaveNamespace[] =
+    "INSERT INTO Store (save_id, ns_id, key, type, value, hash) "
+    "SELECT ?1, ns_id, key, type, value, hash FROM Store WHERE save_id = ?2 AND ns_id = ?3";
+inline constexpr char kInsertSaveRow[] =
+    "INSERT INTO Store (save_id, ns_id, key, type, value, hash) VALUES (?, ?, ?, ?, ?, ?)";
+// Single-entry changes of a scope: SetG/DelG on the global scope, imports on saves.
+inline constexpr char kDeleteEntry[] = "DELETE FROM Store WHERE save_id = ? AND ns_id = ? AND key = ? RETURNING hash";
+inline constexpr char kSelectEntryHash[] = "SELECT hash FROM Store WHERE save_id = ? AND ns_id = ? AND key = ? AND hash IS NOT NULL";
+inline constexpr char kUpsertEntry[] =
+    "INSERT INTO Store (save_id, ns_id, key, type, value, hash) VALUES (?, ?, ?, ?, ?, ?) "
+    "ON CONFLICT(save_id, ns_id, key) DO UPDATE SET type = excluded.type, value = excluded.value, hash = excluded.hash";
+inline constexpr char kSelectStoredSaves[] =
+    "SELECT s.name, s.updated_at, (SELECT COUNT(*) FROM Store WHERE save_id = s.id) "
+    "FROM Saves s WHERE s.id <> 0";
+inline constexpr char kFindSaveVersion[] = "SELECT id FROM Saves WHERE name = ? AND updated_at = ?";
+inline constexpr char kSelectSaveRows[] = "SELECT ns_id, key, hash FROM Store WHERE save_id = ? LIMIT ?";
+inline constexpr char kDeleteSaveRow[] = "DELETE FROM Store WHERE save_id = ? AND ns_id = ? AND key = ?";
+inline constexpr char kDeleteSaveEntry[] = "DELETE FROM Saves WHERE id = ?";
+inline constexpr char kInsertBlob[] = "INSERT INTO Blobs (hash, value) VALUES (?, ?) ON CONFLICT(hash) DO NOTHING";
+inline constexpr char kMatchBlob[] = "SELECT value = ? FROM Blobs WHERE hash = ?";
+inline constexpr char kSelectGlobalVersion[] = "SELECT CAST(value AS INTEGER) FROM Meta WHERE key = 'global_version'";
+inline constexpr char kBumpGlobalVersion[] =
+    "INSERT INTO Meta (key, value) VALUES ('global_version', 1) "
+    "ON CONFLICT(key) DO UPDATE SET value = CAST(value AS INTEGER) + 1";
+inline constexpr char kReleaseBlob[] =
+    "DELETE FROM Blobs WHERE hash = ?1 AND NOT EXISTS (SELECT 1 FROM Store WHERE hash = ?1)";
+}
+
+// Creates the Store/Saves/Namespaces/Blobs/Meta tables and migrates databases written by
+// older versions.
+// Must run inside a transaction.
+void InitializeSchema(SQLite::Database& db);
+// Prepares every StoreSql statement; call once after InitializeSchema.
+void PrepareStoreStatements(StatementCache& statements);
+
+// Writes values into Blobs, keyed by their content hash, within the current transaction.
+// Identical values shared by many saves are stored once; a hash collision with different
+// content is resolved by probing the next id.
+class BlobWriter
+{
+public:
+    explicit BlobWriter(StatementCache& statements);
+
+    // Returns the Blobs.hash id referencing value, inserting it only if it is new. Compressed
+    // values are bound as BLOBs.
+    std::int64_t Intern(const std::string& value, bool compressed = false);
+    // Deletes the given blobs that are no longer referenced by any Store row.
+    int ReleaseUnreferenced(const std::vector<std::int64_t>& hashes);
+
+    int newBlobCount() const { return m_newBlobs; }
+    int sharedBlobCount() const { return m_sharedBlobs; }
+
+private:
+    StatementCache& m_statements;
+    int m_newBlobs = 0;
+    int m_sharedBlobs = 0;
+};
+
+// Resolves save-file names and key namespaces to their dictionary ids within the current
+// transaction. Ids are cached for the lifetime of the object, which must not outlive the
+// transaction (a rollback would leave new ids dangling), so create one per task.
+class ScopeIds
+{
+public:
+    explicit ScopeIds(StatementCache& statements);
+
+    // Id of savefile, creating it if needed and stamping Saves.updated_at.
+    std::int64_t TouchSave(const std::string& savefile);
+    // Id of the namespace prefix, creating it if needed.
+    std::int64_t InternNamespace(std::string_view prefix);
+    // Id of an existing namespace prefix, or -1.
+    std::int64_t FindNamespace(std::string_view prefix);
+
+private:
+    StatementCache& m_statements;
+    std::unordered_map<std::string, std::int64_t> m_namespaces;
+};
@@ -0,0 +1,87 @@
+#include "VacuumDriver.h"
+
+#include <string>
+
+#include "../log/log.h"
+
+namespace
+{
+// Free pages worth reclaiming at all; smaller freelists are reused by later writes anyway.
+constexpr std::int64_t kMinReclaimPages = 64;
+
+std::int64_t QueryInt64(SQLite::Database& db, const char* sql)
+{
+    SQLite::Statement query(db, sql);
+    return query.executeStep() ? query.getColumn(0).getInt64() : 0;
+}
+}
+
+VacuumStats VacuumStats::Read(SQLite::Database& db)
+{
+    VacuumStats stats;
+    stats.pageSize = QueryInt64(db, "PRAGMA page_size");
+    stats.pageCount = QueryInt64(db, "PRAGMA page_count");
+    stats.freelistCount = QueryInt64(db, "PRAGMA freelist_count");
+    stats.autoVacuum = static_cast<int>(QueryInt64(db, "PRAGMA auto_vacuum"));
+    return stats;
+}
+
+VacuumDriver::VacuumDriver(const std::uint32_t pagesPerStep) :
+    m_pagesPerStep(pagesPerStep > 0 ? pagesPerStep : 1)
+{
+}
+
+bool VacuumDriver::Step(SQLite::Database& db)
+{
+    switch (m_state)
+    {
+    case State::Inspect:
+        {
+            // 只读取文件头中的计数；重建文件的 VACUUM 会让排队的读取等待数秒，留给 kcd2db_tool compact
+            const auto stats = VacuumStats::Read(db);
+            LogDebug("Vacuum stats: %lld pages of %lld bytes, %lld free, auto_vacuum=%d.",
+                     static_cast<long long>(stats.pageCount),
+                     static_cast<long long>(stats.pageSize),
+                     static_cast<long long>(stats.freelistCount),
+                     stats.autoVacuum);
+            if (stats.autoVacuum != 2)
+            {
+                LogInfo("kcd2db.db was created without incremental auto_vacuum: %lld free pages are reused "
+                        "but not returned to the system until kcd2db_tool compact rebuilds the file.",
+                        static_cast<long long>(stats.freelistCount));
+                m_state = State::Disabled;
+                return false;
+            }
+            m_state = State::Check;
+            return true;
+        }
+    case State::Check:
+        {
+            if (QueryInt64(db, "PRAGMA auto_vacuum") != 2
+                || QueryInt64(db, "PRAGMA freelist_count") < kMinReclaimPages)
+            {
+                return false;
+            }
+            m_state = State::Reclaim;
+            m_reclaimedPages = 0;
+            return true;
+        }
+    case State::Reclaim:
+        {
+            const std::int64_t before = QueryInt64(db, "PRAGMA freelist_count");
+            db.exec("PRAGMA incremental_vacuum(" + std::to_string(m_pagesPerStep) + ")");
+            const std::int64_t after = QueryInt64(db, "PRAGMA freelist_count");
+            m_reclaimedPages += before - after;
+            if (after > 0 && after < before)
+            {
+                return true;
+            }
+            LogDebug("Incremental vacuum reclaimed %lld pages.", static_cast<long long>(m_reclaimedPages));
+            m_state = State::Check;
+            return false;
+        }
+    case State::Disabled:
+        return false;
+    }
+    return false;
+}
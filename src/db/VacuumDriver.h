@@ -0,0 +1,46 @@
+#pragma once
+
+#include <cstdint>
+
+#include <SQLiteCpp/SQLiteCpp.h>
+
+// Page statistics used to decide whether the database file needs any vacuum work. Read from
+// the database header only, so it costs the same however large the file is.
+struct VacuumStats
+{
+    std::int64_t pageSize = 0;
+    std::int64_t pageCount = 0;
+    std::int64_t freelistCount = 0;
+    // 0 = NONE, 1 = FULL, 2 = INCREMENTAL
+    int autoVacuum = 0;
+
+    static VacuumStats Read(SQLite::Database& db);
+};
+
+// Reclaims free pages a few at a time with PRAGMA incremental_vacuum while the persistence
+// writer is idle, instead of rewriting the whole file with VACUUM on a schedule. It never
+// rebuilds the file: a database created before auto_vacuum=INCREMENTAL, or a fragmented
+// one, is rebuilt by kcd2db_tool compact while the game is closed.
+class VacuumDriver final
+{
+public:
+    explicit VacuumDriver(std::uint32_t pagesPerStep = 64);
+
+    // Does one short step of work. Runs on the writer thread outside any transaction and
+    // returns true while more steps are needed.
+    bool Step(SQLite::Database& db);
+
+private:
+    enum class State
+    {
+        Inspect,
+        Check,
+        Reclaim,
+        // auto_vacuum is not INCREMENTAL: free pages are reused by later writes only.
+        Disabled,
+    };
+
+    std::uint32_t m_pagesPerStep;
+    State m_state = State::Inspect;
+    std::int64_t m_reclaimedPages = 0;
+};
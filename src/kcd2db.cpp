@@ -512,20 +512,13 @@ static std::atomic<LuaDB*> gLuaDB{nullptr};
 bool __thiscall Hooked_CompleteInit(IGame* pThis)
 {
     LogDebug("Hooked_CompleteInit");
+    // LuaDB is published before the hook is installed and initializes its storage in the
+    // background, so registering the Lua API here never waits for the database.
     LuaDB* luaDB = gLuaDB.load(std::memory_order_acquire);
-    const auto waitStart = std::chrono::steady_clock::now();
-    auto nextWaitLog = waitStart + std::chrono::seconds(1);
-    while (luaDB == nullptr)
+    if (luaDB == nullptr)
     {
-        const auto now = std::chrono::steady_clock::now();
-        if (now >= nextWaitLog)
-        {
-            const auto waitedMs = std::chrono::duration_cast<std::chrono::milliseconds>(now - waitStart).count();
-            LogWarn("Hooked_CompleteInit is waiting for LuaDB initialization (%lld ms).", waitedMs);
-            nextWaitLog = now + std::chrono::seconds(5);
-        }
-        std::this_thread::yield();
-        luaDB = gLuaDB.load(std::memory_order_acquire);
+        LogError("Hooked_CompleteInit ran before LuaDB was created; LuaDB API is unavailable.");
+        return OriginalCompleteInit(pThis);
     }
     // Game Lua state must be touched from the CompleteInit thread.
     luaDB->RegisterLuaAPI();
@@ -570,6 +563,11 @@ void RestoreCompleteInitHook()
 void start()
 {
     LogDebug("Main thread started");
+    LogInfo("Using LuaDB database at: %s", make_expected_db_path().c_str());
+    const auto luaDB = new LuaDB();
+    gLuaDB.store(luaDB, std::memory_order_release);
+    LogDebug("LuaDB created; storage initializes in the background");
+
     if (const auto env_addr = find_env_addr())
     {
         LogDebug("Found environment address: 0x%llX", *env_addr);
@@ -626,10 +624,6 @@ void start()
         }
 
         LogDebug("Hooked CompleteInit function");
-        LogInfo("Using LuaDB database at: %s", make_expected_db_path().c_str());
-        const auto luaDB = new LuaDB();
-        gLuaDB.store(luaDB, std::memory_order_release);
-        LogDebug("LuaDB initialized");
 
         while (env_ptr->pGame->GetIGameFramework() == nullptr
             || !env_ptr->pGame->GetIGameFramework()->IsGameStarted())
@@ -61,7 +61,10 @@ _G.DB = (function()
         DelG = true,
         ExiG = true,
         AllG = true,
+        Prefetch = true,
+        PrefetchG = true,
         Dump = true,
+        CacheStats = true,
         Create = true
     }
 
@@ -246,11 +249,28 @@ _G.DB = (function()
     end
     M.AllG = wrap(allGImpl, 0, M)
 
+    -- 在后台读取尚未加载的大值，之后的 Get/GetG 不再阻塞
+    local function prefetchImpl(prefix)
+        return LuaDB.Prefetch(prefix)
+    end
+    M.Prefetch = wrap(prefetchImpl, 1, M)
+
+    local function prefetchGImpl(prefix)
+        return LuaDB.PrefetchG(prefix)
+    end
+    M.PrefetchG = wrap(prefetchGImpl, 1, M)
+
     local function dumpImpl()
         return LuaDB.Dump()
     end
     M.Dump = wrap(dumpImpl, 0, M)
 
+    -- 缓存占用的内存、命中率与驱逐次数
+    local function cacheStatsImpl()
+        return LuaDB.CacheStats()
+    end
+    M.CacheStats = wrap(cacheStatsImpl, 0, M)
+
 )lua" R"lua(
     local function createMetatable(opts)
         local function warn_failed_assignment(key)
@@ -325,6 +345,11 @@ _G.DB = (function()
             namespace = namespace .. ":"
         end
 
+        -- 在后台读取该命名空间，首次访问时通常无需等待
+        if type(LuaDB.Preload) == "function" then
+            LuaDB.Preload(namespace)
+        end
+
         local instance = {
             L = {},
             G = {}
@@ -371,7 +396,7 @@ _G.DB = (function()
         instance.Exi = wrap(_exiImpl, 1, instance)
 
         local function _allImpl()
-            local result = LuaDB.All() or {}
+            local result = LuaDB.All(namespace) or {}
             if type(result) ~= "table" then
                 log_warning("LuaDB.All returned " .. type(result) .. "; returning an empty table.")
                 return {}
@@ -415,7 +440,8 @@ _G.DB = (function()
         instance.ExiG = wrap(_exiGImpl, 1, instance)
 
         local function _allGImpl()
-            local result = LuaDB.AllG() or {}
+            -- 原生侧只遍历该命名空间的分区
+            local result = LuaDB.AllG(namespace) or {}
             if type(result) ~= "table" then
                 log_warning("LuaDB.AllG returned " .. type(result) .. "; returning an empty table.")
                 return {}
@@ -432,6 +458,17 @@ _G.DB = (function()
         end
         instance.AllG = wrap(_allGImpl, 0, instance)
 
+        -- 省略 key 时预读整个命名空间
+        local function _prefetchImpl(key)
+            return LuaDB.Prefetch(key == nil and namespace or prefix_key(key))
+        end
+        instance.Prefetch = wrap(_prefetchImpl, 1, instance)
+
+        local function _prefetchGImpl(key)
+            return LuaDB.PrefetchG(key == nil and namespace or prefix_key(key))
+        end
+        instance.PrefetchG = wrap(_prefetchGImpl, 1, instance)
+
         local function _dumpImpl()
             System.LogAlways("$6--- [Global Data For: " .. namespace:sub(1, -2) .. "] ---\n")
             local globalResult = instance.AllG()
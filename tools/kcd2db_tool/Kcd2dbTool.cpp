@@ -0,0 +1,546 @@
+// Offline inspection and maintenance of a kcd2db.db file, e.g. one attached to a bug report,
+// without the game. Run it only while the game is closed.
+//
+//   kcd2db_tool export DB [--global] [--save NAME]... [--namespace NAME]... [--output FILE]
+//   kcd2db_tool import DB FILE|- [--batch ROWS] [--replace]
+//   kcd2db_tool report DB
+//   kcd2db_tool compact DB [--output FILE]
+//
+// export   writes the entries of the global scope and every save (or only the given ones),
+//          optionally restricted to some namespaces, one NDJSON line each (see NdJson.h)
+// import   reads such lines and writes them in transactions of --batch rows (default 10000);
+//          --replace first clears every scope the input mentions
+// report   entries and stored bytes per save and per namespace
+// compact  upgrades the schema, drops blobs no entry references and rebuilds the file with
+//          VACUUM, or writes the rebuilt database to FILE with VACUUM INTO
+//
+// Rows are streamed through SQLite statements one at a time, so memory use depends on the
+// import batch size and the largest value, not on the size of the database.
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <unordered_set>
+#include <vector>
+
+#include <SQLiteCpp/SQLiteCpp.h>
+
+#include "NdJson.h"
+#include "SqliteEngine.h"
+#include "StoreSchema.h"
+
+namespace
+{
+struct ToolOptions
+{
+    std::string command;
+    std::filesystem::path database;
+    // import: NDJSON input, "-" for stdin.
+    std::string input;
+    // export and compact: stdout (export) or in place (compact) when empty.
+    std::filesystem::path output;
+    bool global = false;
+    std::vector<std::string> saves;
+    std::vector<std::string> namespaces;
+    std::size_t batchRows = 10000;
+    bool replace = false;
+};
+
+// Same defaults as -kcd2dbCompressMin and -kcd2dbLazyMin, so imported values are stored the
+// way the game would store them.
+constexpr std::size_t kCompressMinBytes = 256;
+constexpr std::size_t kLazyMinBytes = 4096;
+
+std::string FormatBytes(const std::uint64_t bytes)
+{
+    char text[32];
+    if (bytes >= 1024 * 1024)
+    {
+        std::snprintf(text, sizeof(text), "%.1f MB", static_cast<double>(bytes) / (1024.0 * 1024.0));
+    }
+    else if (bytes >= 1024)
+    {
+        std::snprintf(text, sizeof(text), "%.1f KB", static_cast<double>(bytes) / 1024.0);
+    }
+    else
+    {
+        std::snprintf(text, sizeof(text), "%llu B", static_cast<unsigned long long>(bytes));
+    }
+    return text;
+}
+
+std::uint64_t FileSize(const std::filesystem::path& path)
+{
+    std::error_code ec;
+    const auto size = std::filesystem::file_size(path, ec);
+    return ec ? 0 : static_cast<std::uint64_t>(size);
+}
+
+// Database plus WAL, as the game leaves them.
+std::uint64_t DatabaseSize(const std::filesystem::path& path)
+{
+    std::filesystem::path wal = path;
+    wal += "-wal";
+    return FileSize(path) + FileSize(wal);
+}
+
+std::int64_t QueryInt64(SQLite::Database& db, const char* sql)
+{
+    SQLite::Statement query(db, sql);
+    return query.executeStep() ? query.getColumn(0).getInt64() : 0;
+}
+
+// Opens a database written by the current schema for reading. Rows are streamed, so a small
+// page cache is enough, and temporary results of GROUP BY go to disk.
+std::unique_ptr<SQLite::Database> OpenForReading(const std::filesystem::path& path)
+{
+    if (!std::filesystem::exists(path))
+    {
+        throw std::runtime_error("no such file: " + path.string());
+    }
+    auto db = std::make_unique<SQLite::Database>(path.string(), SQLite::OPEN_READONLY);
+    if (!db->tableExists("Namespaces") || !db->tableExists("Blobs") || !db->tableExists("Meta"))
+    {
+        throw std::runtime_error("the database uses an older schema; upgrade it with `compact` first");
+    }
+    db->exec("PRAGMA cache_size=-16384");
+    db->exec("PRAGMA temp_store=FILE");
+    return db;
+}
+
+// "Name:" for a --namespace argument given with or without its colon; "" for keys without one.
+std::string NamespacePrefix(const std::string& name)
+{
+    return name.empty() || name.back() == ':' ? name : name + ":";
+}
+
+void Export(const ToolOptions& options)
+{
+    const auto db = OpenForReading(options.database);
+
+    std::vector<std::string> scopes;
+    if (!options.global && options.saves.empty())
+    {
+        // The global scope is Saves.id 0 and comes first.
+        SQLite::Statement query(*db, "SELECT name FROM Saves ORDER BY id");
+        while (query.executeStep())
+        {
+            scopes.push_back(query.getColumn(0).getString());
+        }
+    }
+    else
+    {
+        if (options.global)
+        {
+            scopes.emplace_back();
+        }
+        SQLite::Statement query(*db, StoreSql::kSelectSaveId);
+        for (const auto& save : options.saves)
+        {
+            query.bind(1, save);
+            if (query.executeStep())
+            {
+                scopes.push_back(save);
+            }
+            else
+            {
+                std::fprintf(stderr, "export: no save named %s\n", save.c_str());
+            }
+            query.reset();
+        }
+    }
+
+    std::vector<std::int64_t> namespaceIds;
+    {
+        SQLite::Statement query(*db, StoreSql::kSelectNamespace);
+        for (const auto& name : options.namespaces)
+        {
+            query.bind(1, NamespacePrefix(name));
+            if (query.executeStep())
+            {
+                namespaceIds.push_back(query.getColumn(0).getInt64());
+            }
+            else
+            {
+                std::fprintf(stderr, "export: no namespace named %s\n", name.c_str());
+            }
+            query.reset();
+        }
+        if (!options.namespaces.empty() && namespaceIds.empty())
+        {
+            scopes.clear();
+        }
+    }
+
+    std::FILE* out = stdout;
+    if (!options.output.empty())
+    {
+        out = std::fopen(options.output.string().c_str(), "wb");
+        if (!out)
+        {
+            throw std::runtime_error("cannot create " + options.output.string());
+        }
+    }
+    std::setvbuf(out, nullptr, _IOFBF, 1 << 20);
+
+    std::uint64_t entries = 0;
+    std::string line;
+    CodecStats stats;
+    const auto writeRows = [&](SQLite::Statement& query, const std::string& scope)
+    {
+        // Blob values are selected inline: the lazy-load threshold is 0.
+        query.bind(1, scope);
+        query.bind(2, 0);
+        while (query.executeStep())
+        {
+            const ScriptValue value = SqliteEngine::ReadStoredValue(query.getColumn(1).getInt(), query.getColumn(3), stats);
+            NdJson::Format(scope, query.getColumn(0).getString(), value, line);
+            line.push_back('\n');
+            if (std::fwrite(line.data(), 1, line.size(), out) != line.size())
+            {
+                throw std::runtime_error("write failed");
+            }
+            ++entries;
+        }
+        query.reset();
+    };
+    try
+    {
+        SQLite::Statement scopeQuery(*db, StoreSql::kSelectScope);
+        SQLite::Statement namespaceQuery(*db, StoreSql::kSelectScopeNamespace);
+        for (const auto& scope : scopes)
+        {
+            if (namespaceIds.empty())
+            {
+                writeRows(scopeQuery, scope);
+                continue;
+            }
+            for (const std::int64_t nsId : namespaceIds)
+            {
+                namespaceQuery.bind(3, nsId);
+                writeRows(namespaceQuery, scope);
+            }
+        }
+        if (std::fflush(out) != 0)
+        {
+            throw std::runtime_error("write failed");
+        }
+    }
+    catch (...)
+    {
+        if (out != stdout)
+        {
+            std::fclose(out);
+        }
+        throw;
+    }
+    if (out != stdout)
+    {
+        std::fclose(out);
+    }
+    std::fprintf(stderr, "Exported %llu entries of %zu scopes.\n", static_cast<unsigned long long>(entries), scopes.size());
+}
+
+void Import(const ToolOptions& options)
+{
+    std::ifstream file;
+    if (options.input != "-")
+    {
+        file.open(options.input, std::ios::binary);
+        if (!file)
+        {
+            throw std::runtime_error("cannot open " + options.input);
+        }
+    }
+    std::istream& in = options.input == "-" ? std::cin : file;
+
+    auto db = std::make_unique<SQLite::Database>(options.database.string(), SQLite::OPEN_READWRITE | SQLite::OPEN_CREATE);
+    SqliteEngine engine(std::move(db),
+                        CheckpointPolicy{},
+                        CompressionPolicy{.minBytes = kCompressMinBytes},
+                        LazyValuePolicy{.minBytes = kLazyMinBytes});
+
+    // Lines of one scope are collected until the batch is full. A deletion after upserts
+    // starts a new batch, since a batch applies its deletions first.
+    std::string scope;
+    GlobalBatch batch;
+    std::unordered_set<std::string> cleared;
+    std::uint64_t transactions = 0;
+    BatchResult total;
+    const auto flush = [&]
+    {
+        if (batch.upserts.empty() && batch.deletes.empty())
+        {
+            return;
+        }
+        const BatchResult result = scope.empty() ? engine.ApplyBatch(batch) : engine.ApplySaveBatch(scope, batch);
+        total.upserted += result.upserted;
+        total.deleted += result.deleted;
+        ++transactions;
+        batch.upserts.clear();
+        batch.deletes.clear();
+    };
+
+    std::string line;
+    std::uint64_t lineNumber = 0;
+    while (std::getline(in, line))
+    {
+        ++lineNumber;
+        if (line.find_first_not_of(" \t\r") == std::string::npos)
+        {
+            continue;
+        }
+        EntryLine entry;
+        try
+        {
+            entry = NdJson::Parse(line);
+        }
+        catch (const std::exception& e)
+        {
+            throw std::runtime_error("line " + std::to_string(lineNumber) + ": " + e.what());
+        }
+        if (entry.savefile != scope
+            || batch.upserts.size() + batch.deletes.size() >= options.batchRows
+            || (entry.deleted && !batch.upserts.empty()))
+        {
+            flush();
+            scope = entry.savefile;
+        }
+        if (options.replace && cleared.insert(entry.savefile).second)
+        {
+            engine.SnapshotSave(entry.savefile, {});
+            ++transactions;
+        }
+        if (entry.deleted)
+        {
+            batch.deletes.push_back(std::move(entry.key));
+        }
+        else
+        {
+            batch.upserts.emplace_back(std::move(entry.key), std::move(entry.value));
+        }
+    }
+    if (in.bad())
+    {
+        throw std::runtime_error("read failed after line " + std::to_string(lineNumber));
+    }
+    flush();
+    std::fprintf(stderr,
+                 "Imported %zu entries and %zu deletions in %llu transactions.\n",
+                 total.upserted,
+                 total.deleted,
+                 static_cast<unsigned long long>(transactions));
+}
+
+void Report(const ToolOptions& options)
+{
+    const auto db = OpenForReading(options.database);
+    const std::int64_t pageSize = QueryInt64(*db, "PRAGMA page_size");
+    std::printf("%s: %s (%lld pages of %lld bytes, %lld free)\n",
+                options.database.string().c_str(),
+                FormatBytes(DatabaseSize(options.database)).c_str(),
+                static_cast<long long>(QueryInt64(*db, "PRAGMA page_count")),
+                static_cast<long long>(pageSize),
+                static_cast<long long>(QueryInt64(*db, "PRAGMA freelist_count")));
+    {
+        SQLite::Statement blobs(*db, "SELECT COUNT(*), COALESCE(SUM(octet_length(value)), 0) FROM Blobs");
+        blobs.executeStep();
+        std::printf("Blobs: %lld values, %s\n",
+                    static_cast<long long>(blobs.getColumn(0).getInt64()),
+                    FormatBytes(static_cast<std::uint64_t>(blobs.getColumn(1).getInt64())).c_str());
+    }
+
+    // Inline bytes are keys and values stored in Store; blob bytes count a shared blob once
+    // per entry referencing it.
+    const auto printTable = [](SQLite::Statement& query, const char* heading)
+    {
+        std::printf("\n%-40s %10s %12s %10s %12s\n", heading, "entries", "inline", "blob refs", "blob bytes");
+        while (query.executeStep())
+        {
+            const std::string name = query.getColumn(0).getString();
+            std::printf("%-40s %10lld %12s %10lld %12s\n",
+                        name.c_str(),
+                        static_cast<long long>(query.getColumn(1).getInt64()),
+                        FormatBytes(static_cast<std::uint64_t>(query.getColumn(2).getInt64())).c_str(),
+                        static_cast<long long>(query.getColumn(3).getInt64()),
+                        FormatBytes(static_cast<std::uint64_t>(query.getColumn(4).getInt64())).c_str());
+        }
+    };
+    // Grouping by save_id follows the primary key, so it needs no temporary table.
+    SQLite::Statement saves(*db, R"sql(
+        SELECT CASE WHEN s.save_id = 0 THEN '(global)' ELSE v.name END, COUNT(*),
+               SUM(octet_length(s.key) + COALESCE(octet_length(s.value), 0)),
+               COUNT(s.hash), COALESCE(SUM(octet_length(b.value)), 0)
+        FROM Store s
+        JOIN Saves v ON v.id = s.save_id
+        LEFT JOIN Blobs b ON b.hash = s.hash
+        GROUP BY s.save_id
+        ORDER BY s.save_id
+    )sql");
+    printTable(saves, "scope");
+    SQLite::Statement namespaces(*db, R"sql(
+        SELECT CASE WHEN s.ns_id = 0 THEN '(no namespace)' ELSE n.prefix END, COUNT(*) AS entries,
+               SUM(octet_length(s.key) + COALESCE(octet_length(s.value), 0)) AS inline,
+               COUNT(s.hash), COALESCE(SUM(octet_length(b.value)), 0) AS blob
+        FROM Store s
+        JOIN Namespaces n ON n.id = s.ns_id
+        LEFT JOIN Blobs b ON b.hash = s.hash
+        GROUP BY s.ns_id
+        ORDER BY inline + blob DESC
+    )sql");
+    printTable(namespaces, "namespace");
+}
+
+void Compact(const ToolOptions& options)
+{
+    if (!std::filesystem::exists(options.database))
+    {
+        throw std::runtime_error("no such file: " + options.database.string());
+    }
+    if (!options.output.empty() && std::filesystem::exists(options.output))
+    {
+        throw std::runtime_error(options.output.string() + " already exists");
+    }
+    const std::uint64_t before = DatabaseSize(options.database);
+    SQLite::Database db(options.database.string(), SQLite::OPEN_READWRITE);
+    db.exec("PRAGMA temp_store=FILE");
+    {
+        SQLite::Transaction transaction(db);
+        InitializeSchema(db);
+        transaction.commit();
+    }
+    const int orphans = db.exec("DELETE FROM Blobs WHERE NOT EXISTS (SELECT 1 FROM Store WHERE Store.hash = Blobs.hash)");
+    // Rebuilt with the auto_vacuum mode the plugin creates databases with: the plugin never
+    // rebuilds a file itself, so this is how older databases get idle incremental vacuum.
+    db.exec("PRAGMA auto_vacuum=INCREMENTAL");
+    if (options.output.empty())
+    {
+        db.exec("VACUUM");
+        db.exec("PRAGMA wal_checkpoint(TRUNCATE)");
+        std::printf("Compacted %s: %s -> %s, %d unreferenced blobs removed.\n",
+                    options.database.string().c_str(),
+                    FormatBytes(before).c_str(),
+                    FormatBytes(DatabaseSize(options.database)).c_str(),
+                    orphans);
+        return;
+    }
+    SQLite::Statement vacuum(db, "VACUUM INTO ?");
+    vacuum.bind(1, options.output.string());
+    vacuum.exec();
+    std::printf("Rewrote %s (%s) to %s (%s), %d unreferenced blobs removed.\n",
+                options.database.string().c_str(),
+                FormatBytes(before).c_str(),
+                options.output.string().c_str(),
+                FormatBytes(FileSize(options.output)).c_str(),
+                orphans);
+}
+
+bool ParseArgs(const int argc, char** argv, ToolOptions& options)
+{
+    if (argc < 3)
+    {
+        return false;
+    }
+    options.command = argv[1];
+    options.database = argv[2];
+    int i = 3;
+    if (options.command == "import")
+    {
+        if (argc < 4)
+        {
+            return false;
+        }
+        options.input = argv[i++];
+    }
+    else if (options.command != "export" && options.command != "report" && options.command != "compact")
+    {
+        return false;
+    }
+    for (; i < argc; ++i)
+    {
+        const char* arg = argv[i];
+        const bool hasValue = i + 1 < argc;
+        if (options.command == "export" && std::strcmp(arg, "--global") == 0)
+        {
+            options.global = true;
+        }
+        else if (options.command == "export" && std::strcmp(arg, "--save") == 0 && hasValue)
+        {
+            options.saves.emplace_back(argv[++i]);
+        }
+        else if (options.command == "export" && std::strcmp(arg, "--namespace") == 0 && hasValue)
+        {
+            options.namespaces.emplace_back(argv[++i]);
+        }
+        else if ((options.command == "export" || options.command == "compact") && std::strcmp(arg, "--output") == 0 && hasValue)
+        {
+            options.output = argv[++i];
+        }
+        else if (options.command == "import" && std::strcmp(arg, "--batch") == 0 && hasValue)
+        {
+            options.batchRows = std::strtoull(argv[++i], nullptr, 10);
+            if (options.batchRows == 0)
+            {
+                return false;
+            }
+        }
+        else if (options.command == "import" && std::strcmp(arg, "--replace") == 0)
+        {
+            options.replace = true;
+        }
+        else
+        {
+            return false;
+        }
+    }
+    return true;
+}
+}
+
+int main(const int argc, char** argv)
+{
+    ToolOptions options;
+    if (!ParseArgs(argc, argv, options))
+    {
+        std::fprintf(stderr,
+                     "usage: %s export DB [--global] [--save NAME]... [--namespace NAME]... [--output FILE]\n"
+                     "       %s import DB FILE|- [--batch ROWS] [--replace]\n"
+                     "       %s report DB\n"
+                     "       %s compact DB [--output FILE]\n",
+                     argv[0],
+                     argv[0],
+                     argv[0],
+                     argv[0]);
+        return 2;
+    }
+    try
+    {
+        if (options.command == "export")
+        {
+            Export(options);
+        }
+        else if (options.command == "import")
+        {
+            Import(options);
+        }
+        else if (options.command == "report")
+        {
+            Report(options);
+        }
+        else
+        {
+            Compact(options);
+        }
+    }
+    catch (const std::exception& e)
+    {
+        std::fprintf(stderr, "%s: %s\n", options.command.c_str(), e.what());
+        return 1;
+    }
+    return 0;
+}
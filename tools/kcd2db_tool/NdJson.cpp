@@ -0,0 +1,559 @@
+#include "NdJson.h"
+
+#include <charconv>
+#include <cmath>
+#include <cstdint>
+#include <stdexcept>
+
+namespace
+{
+constexpr char kBase64Alphabet[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+bool IsValidUtf8(const std::string_view text)
+{
+    std::size_t i = 0;
+    while (i < text.size())
+    {
+        const auto lead = static_cast<unsigned char>(text[i]);
+        if (lead < 0x80)
+        {
+            ++i;
+            continue;
+        }
+        std::size_t length = 0;
+        std::uint32_t codePoint = 0;
+        if ((lead & 0xE0) == 0xC0)
+        {
+            length = 2;
+            codePoint = lead & 0x1F;
+        }
+        else if ((lead & 0xF0) == 0xE0)
+        {
+            length = 3;
+            codePoint = lead & 0x0F;
+        }
+        else if ((lead & 0xF8) == 0xF0)
+        {
+            length = 4;
+            codePoint = lead & 0x07;
+        }
+        else
+        {
+            return false;
+        }
+        if (text.size() - i < length)
+        {
+            return false;
+        }
+        for (std::size_t k = 1; k < length; ++k)
+        {
+            const auto next = static_cast<unsigned char>(text[i + k]);
+            if ((next & 0xC0) != 0x80)
+            {
+                return false;
+            }
+            codePoint = codePoint << 6 | (next & 0x3F);
+        }
+        // Overlong forms, UTF-16 surrogates and code points past U+10FFFF are not UTF-8.
+        constexpr std::uint32_t kMinCodePoint[] = {0, 0, 0x80, 0x800, 0x10000};
+        if (codePoint < kMinCodePoint[length] || (codePoint >= 0xD800 && codePoint <= 0xDFFF) || codePoint > 0x10FFFF)
+        {
+            return false;
+        }
+        i += length;
+    }
+    return true;
+}
+
+void AppendUtf8(const std::uint32_t codePoint, std::string& out)
+{
+    if (codePoint < 0x80)
+    {
+        out.push_back(static_cast<char>(codePoint));
+    }
+    else if (codePoint < 0x800)
+    {
+        out.push_back(static_cast<char>(0xC0 | codePoint >> 6));
+        out.push_back(static_cast<char>(0x80 | (codePoint & 0x3F)));
+    }
+    else if (codePoint < 0x10000)
+    {
+        out.push_back(static_cast<char>(0xE0 | codePoint >> 12));
+        out.push_back(static_cast<char>(0x80 | (codePoint >> 6 & 0x3F)));
+        out.push_back(static_cast<char>(0x80 | (codePoint & 0x3F)));
+    }
+    else
+    {
+        out.push_back(static_cast<char>(0xF0 | codePoint >> 18));
+        out.push_back(static_cast<char>(0x80 | (codePoint >> 12 & 0x3F)));
+        out.push_back(static_cast<char>(0x80 | (codePoint >> 6 & 0x3F)));
+        out.push_back(static_cast<char>(0x80 | (codePoint & 0x3F)));
+    }
+}
+
+void AppendString(const std::string_view text, std::string& out)
+{
+    constexpr char kHex[] = "0123456789abcdef";
+    out.push_back('"');
+    for (const char c : text)
+    {
+        switch (c)
+        {
+        case '"': out += "\\\""; break;
+        case '\\': out += "\\\\"; break;
+        case '\n': out += "\\n"; break;
+        case '\r': out += "\\r"; break;
+        case '\t': out += "\\t"; break;
+        default:
+            if (static_cast<unsigned char>(c) < 0x20)
+            {
+                out += "\\u00";
+                out.push_back(kHex[c >> 4]);
+                out.push_back(kHex[c & 0xF]);
+            }
+            else
+            {
+                out.push_back(c);
+            }
+        }
+    }
+    out.push_back('"');
+}
+
+void AppendBase64(const std::string_view data, std::string& out)
+{
+    out.push_back('"');
+    std::size_t i = 0;
+    for (; i + 3 <= data.size(); i += 3)
+    {
+        const std::uint32_t group = static_cast<unsigned char>(data[i]) << 16
+            | static_cast<unsigned char>(data[i + 1]) << 8
+            | static_cast<unsigned char>(data[i + 2]);
+        out.push_back(kBase64Alphabet[group >> 18]);
+        out.push_back(kBase64Alphabet[group >> 12 & 0x3F]);
+        out.push_back(kBase64Alphabet[group >> 6 & 0x3F]);
+        out.push_back(kBase64Alphabet[group & 0x3F]);
+    }
+    if (const std::size_t rest = data.size() - i; rest > 0)
+    {
+        std::uint32_t group = static_cast<unsigned char>(data[i]) << 16;
+        if (rest == 2)
+        {
+            group |= static_cast<unsigned char>(data[i + 1]) << 8;
+        }
+        out.push_back(kBase64Alphabet[group >> 18]);
+        out.push_back(kBase64Alphabet[group >> 12 & 0x3F]);
+        out.push_back(rest == 2 ? kBase64Alphabet[group >> 6 & 0x3F] : '=');
+        out.push_back('=');
+    }
+    out.push_back('"');
+}
+
+std::string DecodeBase64(const std::string_view text)
+{
+    std::string data;
+    data.reserve(text.size() / 4 * 3);
+    std::uint32_t group = 0;
+    int bits = 0;
+    std::size_t padding = 0;
+    for (const char c : text)
+    {
+        if (c == '=')
+        {
+            ++padding;
+            continue;
+        }
+        const char* found = padding == 0 ? std::char_traits<char>::find(kBase64Alphabet, 64, c) : nullptr;
+        if (!found)
+        {
+            throw std::runtime_error("invalid base64 value");
+        }
+        group = group << 6 | static_cast<std::uint32_t>(found - kBase64Alphabet);
+        bits += 6;
+        if (bits >= 8)
+        {
+            bits -= 8;
+            data.push_back(static_cast<char>(group >> bits & 0xFF));
+        }
+    }
+    if (padding > 2 || (text.size() % 4) != 0)
+    {
+        throw std::runtime_error("invalid base64 value");
+    }
+    return data;
+}
+
+// A JSON value of one of the kinds an entry line uses.
+struct JsonValue
+{
+    enum class Kind
+    {
+        Null,
+        Bool,
+        Number,
+        String,
+    };
+
+    Kind kind = Kind::Null;
+    bool boolean = false;
+    double number = 0.0;
+    std::string text;
+};
+
+// Parses a flat JSON object field by field; nested objects and arrays are rejected.
+class ObjectParser final
+{
+public:
+    explicit ObjectParser(const std::string_view text) : m_text(text) {}
+
+    // Calls field(name, value) for every field of the object.
+    template <typename Field>
+    void Parse(Field&& field)
+    {
+        SkipSpace();
+        Expect('{');
+        SkipSpace();
+        if (Peek() == '}')
+        {
+            ++m_pos;
+        }
+        else
+        {
+            while (true)
+            {
+                SkipSpace();
+                std::string name;
+                ParseString(name);
+                SkipSpace();
+                Expect(':');
+                SkipSpace();
+                field(name, ParseValue());
+                SkipSpace();
+                if (Peek() == ',')
+                {
+                    ++m_pos;
+                    continue;
+                }
+                Expect('}');
+                break;
+            }
+        }
+        SkipSpace();
+        if (m_pos != m_text.size())
+        {
+            Fail("unexpected text after the object");
+        }
+    }
+
+private:
+    [[noreturn]] void Fail(const char* what) const
+    {
+        throw std::runtime_error(std::string(what) + " at column " + std::to_string(m_pos + 1));
+    }
+
+    char Peek() const { return m_pos < m_text.size() ? m_text[m_pos] : '\0'; }
+
+    void SkipSpace()
+    {
+        while (m_pos < m_text.size() && (m_text[m_pos] == ' ' || m_text[m_pos] == '\t' || m_text[m_pos] == '\r'))
+        {
+            ++m_pos;
+        }
+    }
+
+    void Expect(const char c)
+    {
+        if (Peek() != c)
+        {
+            Fail((std::string("expected '") + c + "'").c_str());
+        }
+        ++m_pos;
+    }
+
+    std::uint32_t ParseHex4()
+    {
+        if (m_text.size() - m_pos < 4)
+        {
+            Fail("truncated \\u escape");
+        }
+        std::uint32_t value = 0;
+        const auto [end, error] = std::from_chars(m_text.data() + m_pos, m_text.data() + m_pos + 4, value, 16);
+        if (error != std::errc() || end != m_text.data() + m_pos + 4)
+        {
+            Fail("invalid \\u escape");
+        }
+        m_pos += 4;
+        return value;
+    }
+
+    void ParseString(std::string& out)
+    {
+        Expect('"');
+        while (true)
+        {
+            if (m_pos >= m_text.size())
+            {
+                Fail("unterminated string");
+            }
+            const char c = m_text[m_pos++];
+            if (c == '"')
+            {
+                return;
+            }
+            if (c != '\\')
+            {
+                out.push_back(c);
+                continue;
+            }
+            switch (m_pos < m_text.size() ? m_text[m_pos++] : '\0')
+            {
+            case '"': out.push_back('"'); break;
+            case '\\': out.push_back('\\'); break;
+            case '/': out.push_back('/'); break;
+            case 'b': out.push_back('\b'); break;
+            case 'f': out.push_back('\f'); break;
+            case 'n': out.push_back('\n'); break;
+            case 'r': out.push_back('\r'); break;
+            case 't': out.push_back('\t'); break;
+            case 'u':
+                {
+                    std::uint32_t codePoint = ParseHex4();
+                    if (codePoint >= 0xD800 && codePoint <= 0xDBFF)
+                    {
+                        // A high surrogate must be followed by the escaped low one.
+                        if (m_text.substr(m_pos, 2) != "\\u")
+                        {
+                            Fail("unpaired surrogate");
+                        }
+                        m_pos += 2;
+                        const std::uint32_t low = ParseHex4();
+                        if (low < 0xDC00 || low > 0xDFFF)
+                        {
+                            Fail("unpaired surrogate");
+                        }
+                        codePoint = 0x10000 + ((codePoint - 0xD800) << 10) + (low - 0xDC00);
+                    }
+                    else if (codePoint >= 0xDC00 && codePoint <= 0xDFFF)
+                    {
+                        Fail("unpaired surrogate");
+                    }
+                    AppendUtf8(codePoint, out);
+                    break;
+                }
+            default:
+                Fail("invalid escape");
+            }
+        }
+    }
+
+    JsonValue ParseValue()
+    {
+        JsonValue value;
+        const char c = Peek();
+        if (c == '"')
+        {
+            value.kind = JsonValue::Kind::String;
+            ParseString(value.text);
+        }
+        else if (ConsumeWord("true") || ConsumeWord("false"))
+        {
+            value.kind = JsonValue::Kind::Bool;
+            value.boolean = c == 't';
+        }
+        else if (ConsumeWord("null"))
+        {
+            value.kind = JsonValue::Kind::Null;
+        }
+        else if (c == '-' || (c >= '0' && c <= '9'))
+        {
+            value.kind = JsonValue::Kind::Number;
+            const char* begin = m_text.data() + m_pos;
+            const auto [end, error] = std::from_chars(begin, m_text.data() + m_text.size(), value.number);
+            if (error != std::errc())
+            {
+                Fail("invalid number");
+            }
+            m_pos += static_cast<std::size_t>(end - begin);
+        }
+        else
+        {
+            Fail(c == '{' || c == '[' ? "nested values are not supported" : "invalid value");
+        }
+        return value;
+    }
+
+    bool ConsumeWord(const std::string_view word)
+    {
+        if (m_text.substr(m_pos, word.size()) != word)
+        {
+            return false;
+        }
+        m_pos += word.size();
+        return true;
+    }
+
+    std::string_view m_text;
+    std::size_t m_pos = 0;
+};
+
+float SpecialNumber(const std::string_view text)
+{
+    if (text == "NaN")
+    {
+        return std::nanf("");
+    }
+    if (text == "Infinity")
+    {
+        return HUGE_VALF;
+    }
+    if (text == "-Infinity")
+    {
+        return -HUGE_VALF;
+    }
+    throw std::runtime_error("number value is not a number");
+}
+}
+
+namespace NdJson
+{
+void Format(const std::string_view savefile, const std::string_view key, const ScriptValue& value, std::string& line)
+{
+    line.clear();
+    if (savefile.empty())
+    {
+        line += R"({"scope":"global")";
+    }
+    else
+    {
+        line += R"({"scope":"save","save":)";
+        AppendString(savefile, line);
+    }
+    line += R"(,"key":)";
+    AppendString(key, line);
+    switch (value.type())
+    {
+    case ScriptValue::Type::BOOL:
+        line += value.as_bool() ? R"(,"type":"bool","value":true})" : R"(,"type":"bool","value":false})";
+        return;
+    case ScriptValue::Type::NUMBER:
+        {
+            line += R"(,"type":"number","value":)";
+            const float number = value.as_number();
+            if (std::isnan(number))
+            {
+                line += R"("NaN")";
+            }
+            else if (std::isinf(number))
+            {
+                line += number > 0 ? R"("Infinity")" : R"("-Infinity")";
+            }
+            else
+            {
+                // Shortest decimal form that reads back as the same float.
+                char digits[32];
+                const auto result = std::to_chars(digits, digits + sizeof(digits), number);
+                line.append(digits, result.ptr);
+            }
+            line.push_back('}');
+            return;
+        }
+    case ScriptValue::Type::STRING:
+        if (IsValidUtf8(value.as_string()))
+        {
+            line += R"(,"type":"string","value":)";
+            AppendString(value.as_string(), line);
+        }
+        else
+        {
+            line += R"(,"type":"string","base64":)";
+            AppendBase64(value.as_string(), line);
+        }
+        line.push_back('}');
+        return;
+    case ScriptValue::Type::BLOB_REF:
+        throw std::logic_error("unresolved BlobRef cannot be exported");
+    }
+}
+
+EntryLine Parse(const std::string_view line)
+{
+    EntryLine entry;
+    JsonValue scope;
+    JsonValue save;
+    JsonValue key;
+    JsonValue type;
+    JsonValue value;
+    JsonValue base64;
+    JsonValue deleted;
+    ObjectParser(line).Parse([&](const std::string& name, JsonValue field)
+    {
+        // Unknown fields are ignored so that later versions can add some.
+        JsonValue* target = name == "scope" ? &scope
+            : name == "save" ? &save
+            : name == "key" ? &key
+            : name == "type" ? &type
+            : name == "value" ? &value
+            : name == "base64" ? &base64
+            : name == "deleted" ? &deleted
+            : nullptr;
+        if (target)
+        {
+            *target = std::move(field);
+        }
+    });
+
+    if (key.kind != JsonValue::Kind::String)
+    {
+        throw std::runtime_error("missing \"key\"");
+    }
+    entry.key = std::move(key.text);
+    if (save.kind == JsonValue::Kind::String)
+    {
+        entry.savefile = std::move(save.text);
+    }
+    const bool isSave = scope.kind == JsonValue::Kind::String ? scope.text == "save" : !entry.savefile.empty();
+    if (scope.kind == JsonValue::Kind::String && scope.text != "save" && scope.text != "global")
+    {
+        throw std::runtime_error("\"scope\" must be \"global\" or \"save\"");
+    }
+    if (isSave == entry.savefile.empty())
+    {
+        throw std::runtime_error(isSave ? "save entry without \"save\"" : "global entry with \"save\"");
+    }
+
+    if (deleted.kind == JsonValue::Kind::Bool && deleted.boolean)
+    {
+        entry.deleted = true;
+        return entry;
+    }
+    if (type.kind != JsonValue::Kind::String)
+    {
+        throw std::runtime_error("missing \"type\"");
+    }
+    if (type.text == "bool" && value.kind == JsonValue::Kind::Bool)
+    {
+        entry.value = ScriptValue(value.boolean);
+    }
+    else if (type.text == "number" && value.kind == JsonValue::Kind::Number)
+    {
+        entry.value = ScriptValue(static_cast<float>(value.number));
+    }
+    else if (type.text == "number" && value.kind == JsonValue::Kind::String)
+    {
+        entry.value = ScriptValue(SpecialNumber(value.text));
+    }
+    else if (type.text == "string" && value.kind == JsonValue::Kind::String)
+    {
+        entry.value = ScriptValue(std::move(value.text));
+    }
+    else if (type.text == "string" && base64.kind == JsonValue::Kind::String)
+    {
+        entry.value = ScriptValue(DecodeBase64(base64.text));
+    }
+    else
+    {
+        throw std::runtime_error("\"value\" does not match \"type\"");
+    }
+    return entry;
+}
+}
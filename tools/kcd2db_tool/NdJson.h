@@ -0,0 +1,30 @@
+#pragma once
+
+#include <string>
+#include <string_view>
+
+#include "ScriptValue.h"
+
+// One stored entry per line of an export or import, as newline-delimited JSON:
+//   {"scope":"global","key":"Mod:count","type":"number","value":1.5}
+//   {"scope":"save","save":"quicksave","key":"Mod:flag","type":"bool","value":true}
+//   {"scope":"save","save":"quicksave","key":"Mod:data","type":"string","base64":"AAEC"}
+//   {"scope":"global","key":"Mod:old","deleted":true}
+// Strings that are not valid UTF-8 are written as base64. Numbers JSON cannot represent are
+// written as the strings "NaN", "Infinity" and "-Infinity". Deletions are only read.
+struct EntryLine
+{
+    // Empty for the global scope.
+    std::string savefile;
+    std::string key;
+    ScriptValue value;
+    bool deleted = false;
+};
+
+namespace NdJson
+{
+// Replaces line with the JSON form of an entry, without the newline.
+void Format(std::string_view savefile, std::string_view key, const ScriptValue& value, std::string& line);
+// Parses one line. Throws std::runtime_error describing what is wrong with it.
+EntryLine Parse(std::string_view line);
+}
@@ -0,0 +1,71 @@
+// Replaces src/log for the benchmark: warnings and errors go to stderr, the rest is dropped
+// unless KCD2DB_BENCH_VERBOSE is set.
+#include <cstdarg>
+#include <cstdio>
+#include <cstdlib>
+
+#include "../../src/log/log.h"
+
+namespace
+{
+bool Verbose()
+{
+    static const bool verbose = std::getenv("KCD2DB_BENCH_VERBOSE") != nullptr;
+    return verbose;
+}
+
+void Write(const char* level, const char* format, va_list args)
+{
+    std::fprintf(stderr, "[%s] ", level);
+    std::vfprintf(stderr, format, args);
+    std::fputc('\n', stderr);
+}
+}
+
+void Log_init()
+{
+}
+
+void Log_close()
+{
+}
+
+void LogDebug(const char* format, ...)
+{
+    if (!Verbose())
+    {
+        return;
+    }
+    va_list args;
+    va_start(args, format);
+    Write("DEBUG", format, args);
+    va_end(args);
+}
+
+void LogInfo(const char* format, ...)
+{
+    if (!Verbose())
+    {
+        return;
+    }
+    va_list args;
+    va_start(args, format);
+    Write("INFO", format, args);
+    va_end(args);
+}
+
+void LogWarn(const char* format, ...)
+{
+    va_list args;
+    va_start(args, format);
+    Write("WARN", format, args);
+    va_end(args);
+}
+
+void LogError(const char* format, ...)
+{
+    va_list args;
+    va_start(args, format);
+    Write("ERROR", format, args);
+    va_end(args);
+}
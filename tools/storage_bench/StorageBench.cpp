@@ -0,0 +1,709 @@
+// Runs the same LuaDB workload against every storage engine and prints the time of each phase.
+//
+//   storage_bench [--rows N] [--batches N] [--saves N] [--compress-min BYTES] [--lazy-min BYTES]
+//                 [--load-threads N] [--dir PATH] [--engine sqlite|log|memory]...
+//   storage_bench --hydration [--hydration-rows N,N,...] [--hydration-threads N,N,...]
+//                 [--compress-min BYTES] [--lazy-min BYTES] [--dir PATH]
+//   storage_bench --save-gc [--dir PATH] [--engine sqlite|log|memory]...
+//
+// Phases:
+//   flush     global SetG/DelG batches, one ApplyBatch per simulated OnPostUpdate flush
+//   save      full save snapshots, one SnapshotSave per OnSaveGame, cycling through save names
+//   load      LoadScope of the global scope and of the latest save
+//   idle      background maintenance (checkpoints, vacuum, log compaction) until done
+//   reopen    closing the engine, opening it again and loading the global scope
+//   gc        deleting every save scope in batches, as the save collector does
+//
+// --hydration only measures SqliteEngine::LoadScope of a scope of each given size (default
+// 1k, 100k and 1M rows) with each number of decoding threads (default 0, 1, 2 and 4), best
+// of three runs, and the speedup over decoding on the calling thread.
+//
+// --save-gc checks the save collector against a temporary directory of fake save files:
+// both safeguards that skip a pass, the dry-run report, and deleting orphaned saves in
+// batches through the persistence writer. It exits with 1 when a check fails.
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <functional>
+#include <memory>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <SQLiteCpp/SQLiteCpp.h>
+
+#include "LogEngine.h"
+#include "MemoryEngine.h"
+#include "PersistenceWriter.h"
+#include "SaveCollector.h"
+#include "SqliteEngine.h"
+
+namespace
+{
+struct BenchOptions
+{
+    std::size_t rows = 20000;
+    std::size_t batches = 200;
+    std::size_t saves = 8;
+    // Same default as -kcd2dbCompressMin; 0 disables compression.
+    std::size_t compressMin = 256;
+    // Same default as -kcd2dbLazyMin; 0 loads every value eagerly.
+    std::size_t lazyMin = 4096;
+    // Same default as -kcd2dbLoadThreads; 0 decodes on the calling thread.
+    std::size_t loadThreads = 0;
+    bool hydration = false;
+    bool saveGc = false;
+    std::vector<std::size_t> hydrationRows = {1000, 100000, 1000000};
+    std::vector<std::size_t> hydrationThreads = {0, 1, 2, 4};
+    std::filesystem::path dir = std::filesystem::temp_directory_path() / "kcd2db_storage_bench";
+    std::vector<std::string> engines;
+};
+
+struct Workload
+{
+    std::vector<GlobalBatch> batches;
+    std::vector<ValueMap> saves;
+};
+
+// Keys look like DB.Create keys: "<Mod>:<key>", spread over a few namespaces. Values mix the
+// three supported types; strings range from short flags to serialized tables of a few KB.
+ScriptValue MakeValue(std::mt19937& rng, const std::size_t i, const std::size_t maxItems = 200)
+{
+    switch (i % 4)
+    {
+    case 0: return ScriptValue((rng() & 1) != 0);
+    case 1: return ScriptValue(static_cast<float>(rng() % 100000) / 8.0f);
+    case 2: return ScriptValue(std::string(8 + rng() % 48, static_cast<char>('a' + i % 26)));
+    default:
+        {
+            std::string json = "{\"id\":" + std::to_string(i) + ",\"items\":[";
+            const std::size_t items = 4 + rng() % maxItems;
+            for (std::size_t item = 0; item < items; ++item)
+            {
+                json += "{\"item\":" + std::to_string(rng() % 1000) + ",\"count\":" + std::to_string(1 + rng() % 8) + "},";
+            }
+            json.back() = ']';
+            json += "}";
+            return ScriptValue(std::move(json));
+        }
+    }
+}
+
+std::string MakeKey(const std::size_t i)
+{
+    return "Mod" + std::to_string(i % 12) + ":key" + std::to_string(i);
+}
+
+Workload MakeWorkload(const BenchOptions& options)
+{
+    std::mt19937 rng(12345);
+    Workload workload;
+    // Each flush touches about 1% of the keys and deletes a few of them.
+    const std::size_t perBatch = std::max<std::size_t>(options.rows / 100, 1);
+    for (std::size_t b = 0; b < options.batches; ++b)
+    {
+        GlobalBatch batch;
+        for (std::size_t i = 0; i < perBatch; ++i)
+        {
+            const std::size_t key = rng() % options.rows;
+            batch.upserts.emplace_back(MakeKey(key), MakeValue(rng, key));
+        }
+        for (std::size_t i = 0; i < perBatch / 20; ++i)
+        {
+            batch.deletes.push_back(MakeKey(rng() % options.rows));
+        }
+        workload.batches.push_back(std::move(batch));
+    }
+    // Consecutive saves share most of their values, as in a real playthrough.
+    ValueMap save;
+    for (std::size_t i = 0; i < options.rows; ++i)
+    {
+        save.emplace(MakeKey(i), MakeValue(rng, i));
+    }
+    for (std::size_t s = 0; s < options.saves; ++s)
+    {
+        for (std::size_t i = 0; i < options.rows / 20; ++i)
+        {
+            const std::size_t key = rng() % options.rows;
+            save.insert_or_assign(MakeKey(key), MakeValue(rng, key));
+        }
+        workload.saves.push_back(save);
+    }
+    return workload;
+}
+
+std::unique_ptr<StorageEngine> OpenEngine(const std::string& kind,
+                                          const std::filesystem::path& dir,
+                                          const BenchOptions& options,
+                                          const std::size_t loadThreads)
+{
+    if (kind == "memory")
+    {
+        return std::make_unique<MemoryEngine>();
+    }
+    if (kind == "log")
+    {
+        return std::make_unique<LogEngine>(dir / "bench.kvlog");
+    }
+    // Same settings as the plugin with its default options.
+    auto db = std::make_unique<SQLite::Database>((dir / "bench.db").string(), SQLite::OPEN_READWRITE | SQLite::OPEN_CREATE);
+    db->exec("PRAGMA auto_vacuum=INCREMENTAL");
+    db->exec("PRAGMA journal_mode=WAL");
+    db->exec("PRAGMA synchronous=NORMAL");
+    db->exec("PRAGMA wal_autocheckpoint=0");
+    return std::make_unique<SqliteEngine>(std::move(db),
+                                          CheckpointPolicy{.enabled = true, .walLimitBytes = 16u * 1024 * 1024},
+                                          CompressionPolicy{.minBytes = options.compressMin},
+                                          LazyValuePolicy{.minBytes = options.lazyMin},
+                                          BackupPolicy{},
+                                          HydrationPolicy{.threads = loadThreads});
+}
+
+std::uintmax_t DirectorySize(const std::filesystem::path& dir)
+{
+    std::uintmax_t size = 0;
+    std::error_code ec;
+    for (const auto& entry : std::filesystem::directory_iterator(dir, ec))
+    {
+        if (entry.is_regular_file(ec))
+        {
+            size += entry.file_size(ec);
+        }
+    }
+    return size;
+}
+
+double Measure(const std::function<void()>& phase)
+{
+    const auto start = std::chrono::steady_clock::now();
+    phase();
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+void RunEngine(const std::string& kind, const BenchOptions& options, const Workload& workload)
+{
+    const auto dir = options.dir / kind;
+    std::filesystem::remove_all(dir);
+    std::filesystem::create_directories(dir);
+
+    auto engine = OpenEngine(kind, dir, options, options.loadThreads);
+    const double flushMs = Measure([&]
+    {
+        for (const auto& batch : workload.batches)
+        {
+            engine->ApplyBatch(batch);
+            engine->AfterTask();
+        }
+    });
+    const double saveMs = Measure([&]
+    {
+        for (std::size_t s = 0; s < workload.saves.size(); ++s)
+        {
+            engine->SnapshotSave("saves/playline0/save" + std::to_string(s % 4) + ".whs", workload.saves[s]);
+            engine->AfterTask();
+        }
+    });
+    std::size_t loaded = 0;
+    const double loadMs = Measure([&]
+    {
+        ValueMap global;
+        engine->LoadScope("", global);
+        ValueMap save;
+        engine->LoadScope(engine->LatestSave(), save);
+        loaded = global.size() + save.size();
+    });
+    const double idleMs = Measure([&]
+    {
+        while (engine->HasIdleWork() && engine->Idle())
+        {
+        }
+    });
+    const std::uintmax_t diskBytes = DirectorySize(dir);
+    CodecStats codec;
+    if (const auto* sqlite = dynamic_cast<const SqliteEngine*>(engine.get()))
+    {
+        codec = sqlite->codecStats();
+    }
+    const double reopenMs = Measure([&]
+    {
+        if (kind != "memory")
+        {
+            engine.reset();
+            engine = OpenEngine(kind, dir, options, options.loadThreads);
+        }
+        ValueMap global;
+        engine->LoadScope("", global);
+    });
+    std::uint64_t collected = 0;
+    const double gcMs = Measure([&]
+    {
+        for (const auto& save : engine->ListSaves())
+        {
+            while (const std::uint64_t deleted = engine->DeleteScope(save, 256))
+            {
+                collected += deleted;
+                engine->AfterTask();
+            }
+        }
+    });
+
+    std::printf("%-8s %10.1f %10.1f %10.1f %10.1f %10.1f %10.1f %10zu %10llu %12.1f\n",
+                kind.c_str(),
+                flushMs,
+                saveMs,
+                loadMs,
+                idleMs,
+                reopenMs,
+                gcMs,
+                loaded,
+                static_cast<unsigned long long>(collected),
+                static_cast<double>(diskBytes) / (1024.0 * 1024.0));
+    if (codec.compressedValues > 0)
+    {
+        std::printf("%-8s compressed %llu values %.1f -> %.1f MB (ratio %.2f) in %.1f ms, decompressed %llu in %.1f ms\n",
+                    "",
+                    static_cast<unsigned long long>(codec.compressedValues),
+                    static_cast<double>(codec.rawBytes) / (1024.0 * 1024.0),
+                    static_cast<double>(codec.storedBytes) / (1024.0 * 1024.0),
+                    codec.ratio(),
+                    std::chrono::duration<double, std::milli>(codec.compressTime).count(),
+                    static_cast<unsigned long long>(codec.decompressedValues),
+                    std::chrono::duration<double, std::milli>(codec.decompressTime).count());
+    }
+    engine.reset();
+    std::filesystem::remove_all(dir);
+}
+
+void RunHydration(const BenchOptions& options)
+{
+    const auto dir = options.dir / "hydration";
+    std::printf("%10s %10s %10s %12s %10s\n", "rows", "threads", "load ms", "rows/s", "speedup");
+    for (const std::size_t rows : options.hydrationRows)
+    {
+        std::filesystem::remove_all(dir);
+        std::filesystem::create_directories(dir);
+        {
+            // Written to the global scope in batches so that 1M rows never sit in memory at once.
+            auto engine = OpenEngine("sqlite", dir, options, 0);
+            std::mt19937 rng(12345);
+            constexpr std::size_t kWriteBatch = 50000;
+            for (std::size_t first = 0; first < rows; first += kWriteBatch)
+            {
+                GlobalBatch batch;
+                for (std::size_t i = first; i < std::min(rows, first + kWriteBatch); ++i)
+                {
+                    batch.upserts.emplace_back(MakeKey(i), MakeValue(rng, i, 16));
+                }
+                engine->ApplyBatch(batch);
+            }
+            while (engine->HasIdleWork() && engine->Idle())
+            {
+            }
+        }
+        double baselineMs = 0.0;
+        for (const std::size_t threads : options.hydrationThreads)
+        {
+            auto engine = OpenEngine("sqlite", dir, options, threads);
+            double bestMs = 0.0;
+            for (int run = 0; run < 3; ++run)
+            {
+                ValueMap loaded;
+                const double ms = Measure([&] { engine->LoadScope("", loaded); });
+                if (loaded.size() != rows)
+                {
+                    throw std::runtime_error("loaded " + std::to_string(loaded.size()) + " of " + std::to_string(rows) + " rows");
+                }
+                bestMs = run == 0 ? ms : std::min(bestMs, ms);
+            }
+            if (baselineMs == 0.0)
+            {
+                baselineMs = bestMs;
+            }
+            std::printf("%10zu %10zu %10.1f %12.0f %9.2fx\n",
+                        rows,
+                        threads,
+                        bestMs,
+                        static_cast<double>(rows) / (bestMs / 1000.0),
+                        baselineMs / bestMs);
+        }
+    }
+    std::filesystem::remove_all(dir);
+}
+
+// Passes everything through to another engine and records how DeleteScope was called.
+class DeleteRecordingEngine final : public StorageEngine
+{
+public:
+    struct Deletes
+    {
+        std::size_t calls = 0;
+        std::uint64_t largestBatch = 0;
+    };
+
+    DeleteRecordingEngine(std::unique_ptr<StorageEngine> engine, std::shared_ptr<Deletes> deletes) :
+        m_engine(std::move(engine)),
+        m_deletes(std::move(deletes))
+    {
+    }
+
+    const char* name() const override { return m_engine->name(); }
+    void LoadScope(const std::string& savefile, ValueMap& out) override { m_engine->LoadScope(savefile, out); }
+    std::string LatestSave() override { return m_engine->LatestSave(); }
+    BatchResult ApplyBatch(const GlobalBatch& batch) override { return m_engine->ApplyBatch(batch); }
+    void SnapshotSave(const std::string& savefile, const ValueMap& entries) override { m_engine->SnapshotSave(savefile, entries); }
+    std::vector<StoredSave> ListSaves() override { return m_engine->ListSaves(); }
+    std::uint64_t DeleteScope(const StoredSave& save, const std::uint32_t maxEntries) override
+    {
+        const std::uint64_t deleted = m_engine->DeleteScope(save, maxEntries);
+        ++m_deletes->calls;
+        m_deletes->largestBatch = std::max(m_deletes->largestBatch, deleted);
+        return deleted;
+    }
+    void AfterTask() override { m_engine->AfterTask(); }
+
+private:
+    std::unique_ptr<StorageEngine> m_engine;
+    std::shared_ptr<Deletes> m_deletes;
+};
+
+void TouchFile(const std::filesystem::path& path)
+{
+    std::filesystem::create_directories(path.parent_path());
+    std::FILE* file = std::fopen(path.string().c_str(), "wb");
+    if (!file)
+    {
+        throw std::runtime_error("cannot create " + path.string());
+    }
+    std::fputs("whs", file);
+    std::fclose(file);
+}
+
+// Returns false and prints the check when it failed.
+bool Check(const std::string& kind, const bool passed, const char* what)
+{
+    std::printf("%-8s %-4s %s\n", kind.c_str(), passed ? "ok" : "FAIL", what);
+    return passed;
+}
+
+bool RunSaveGcChecks(const std::string& kind, const BenchOptions& options)
+{
+    const auto dir = options.dir / ("save_gc_" + kind);
+    std::filesystem::remove_all(dir);
+    std::filesystem::create_directories(dir);
+
+    // The game directory layout, with names stored the ways the game and mods refer to them.
+    const auto saveDir = dir / "kingdomcome2";
+    TouchFile(saveDir / "saves" / "playline0" / "quicksave.whs");
+    TouchFile(saveDir / "saves" / "playline0" / "Save1.whs");
+    TouchFile(saveDir / "saves" / "playline1" / "autosave.whs");
+    TouchFile(saveDir / "profiles" / "default" / "attributes.xml");
+    const std::vector<std::pair<std::string, std::size_t>> present = {
+        {"saves/playline0/quicksave.whs", 40},
+        {"%USER%/saves/playline1/autosave.whs", 30},
+        {"C:\\Users\\Henry\\Saved Games\\kingdomcome2\\saves\\playline0\\save1.whs", 20},
+    };
+    const std::vector<std::pair<std::string, std::size_t>> orphaned = {
+        {"saves/playline0/deleted.whs", 1000},
+        {"saves/playline2/old.whs", 300},
+    };
+    // Not on disk yet, like a save the game is still writing.
+    const std::string loadedSave = "saves/playline0/current.whs";
+    constexpr std::uint32_t kBatchRows = 64;
+
+    const auto deletes = std::make_shared<DeleteRecordingEngine::Deletes>();
+    PersistenceWriter writer(
+        std::make_unique<DeleteRecordingEngine>(OpenEngine(kind, dir, options, 0), deletes),
+        std::chrono::milliseconds(1000));
+    std::mt19937 rng(12345);
+    const auto store = [&](const std::string& savefile, const std::size_t rows)
+    {
+        ValueMap entries;
+        for (std::size_t i = 0; i < rows; ++i)
+        {
+            entries.emplace(MakeKey(i), MakeValue(rng, i, 16));
+        }
+        writer.Wait(writer.Submit("Bench save", [savefile, entries = std::move(entries)](StorageEngine& engine)
+        {
+            engine.SnapshotSave(savefile, entries);
+        }));
+    };
+    for (const auto& [savefile, rows] : present)
+    {
+        store(savefile, rows);
+    }
+    for (const auto& [savefile, rows] : orphaned)
+    {
+        store(savefile, rows);
+    }
+    store(loadedSave, 10);
+    const std::size_t storedSaves = present.size() + orphaned.size() + 1;
+
+    const auto storedNames = [&]
+    {
+        std::vector<std::string> names;
+        writer.Run([&](StorageEngine& engine)
+        {
+            for (const auto& save : engine.ListSaves())
+            {
+                names.push_back(save.savefile);
+            }
+        });
+        std::sort(names.begin(), names.end());
+        return names;
+    };
+    const auto allStored = storedNames();
+
+    bool passed = Check(kind, allStored.size() == storedSaves, "every fake save is stored");
+
+    {
+        const auto report = SaveCollector(writer, {dir / "missing", false, kBatchRows}).RunPass({loadedSave});
+        passed &= Check(kind, report.skipped && report.deletedRows == 0 && storedNames() == allStored,
+                        "a missing save directory skips the pass");
+    }
+    {
+        std::filesystem::create_directories(dir / "empty");
+        const auto report = SaveCollector(writer, {dir / "empty", false, kBatchRows}).RunPass({loadedSave});
+        passed &= Check(kind, report.skipped && report.deletedRows == 0 && storedNames() == allStored,
+                        "an empty save directory skips the pass");
+    }
+    {
+        // A wrong directory that still has files: no stored save matches any of them.
+        TouchFile(dir / "elsewhere" / "saves" / "playline0" / "unrelated.whs");
+        const auto report = SaveCollector(writer, {dir / "elsewhere", false, kBatchRows}).RunPass({loadedSave});
+        passed &= Check(kind, report.skipped && report.orphans.size() == storedSaves - 1 && report.deletedRows == 0
+                                  && storedNames() == allStored,
+                        "a directory matching no stored save skips the pass");
+    }
+    {
+        const auto report = SaveCollector(writer, {saveDir, true, kBatchRows}).RunPass({loadedSave});
+        std::vector<std::pair<std::string, std::size_t>> reported;
+        for (const auto& orphan : report.orphans)
+        {
+            reported.emplace_back(orphan.savefile, static_cast<std::size_t>(orphan.rows));
+        }
+        std::sort(reported.begin(), reported.end());
+        passed &= Check(kind, !report.skipped && report.dryRun && report.storedSaves == storedSaves,
+                        "dry run looks at every stored save");
+        passed &= Check(kind, reported == orphaned, "dry run reports exactly the orphaned saves and their rows");
+        passed &= Check(kind, report.deletedRows == 0 && deletes->calls == 0 && storedNames() == allStored,
+                        "dry run deletes nothing");
+    }
+    {
+        const auto report = SaveCollector(writer, {saveDir, false, kBatchRows}).RunPass({loadedSave});
+        std::uint64_t orphanRows = 0;
+        std::vector<std::string> expected = {loadedSave};
+        for (const auto& [savefile, rows] : orphaned)
+        {
+            orphanRows += rows;
+        }
+        for (const auto& [savefile, rows] : present)
+        {
+            expected.push_back(savefile);
+        }
+        std::sort(expected.begin(), expected.end());
+        passed &= Check(kind, report.deletedRows == orphanRows && storedNames() == expected,
+                        "orphaned saves are deleted and every other save is kept");
+        // The memory and log engines drop a whole save in one step, whatever the batch size.
+        if (kind == "sqlite")
+        {
+            passed &= Check(kind, deletes->largestBatch <= kBatchRows && deletes->calls >= orphanRows / kBatchRows,
+                            "deletes are split into tasks of at most the batch size");
+        }
+
+        std::size_t keptRows = 0;
+        writer.Run([&](StorageEngine& engine)
+        {
+            for (const auto& [savefile, rows] : present)
+            {
+                ValueMap loaded;
+                engine.LoadScope(savefile, loaded);
+                keptRows += loaded.size() == rows ? rows : 0;
+            }
+        });
+        std::size_t presentRows = 0;
+        for (const auto& [savefile, rows] : present)
+        {
+            presentRows += rows;
+        }
+        passed &= Check(kind, keptRows == presentRows, "kept saves still load every entry");
+    }
+    {
+        const auto report = SaveCollector(writer, {saveDir, false, kBatchRows}).RunPass({loadedSave});
+        passed &= Check(kind, report.orphans.empty() && report.deletedRows == 0, "a second pass finds nothing");
+    }
+    return passed;
+}
+
+bool RunSaveGc(const BenchOptions& options)
+{
+    bool passed = true;
+    for (const auto& kind : options.engines)
+    {
+        passed &= RunSaveGcChecks(kind, options);
+    }
+    for (const auto& kind : options.engines)
+    {
+        std::filesystem::remove_all(options.dir / ("save_gc_" + kind));
+    }
+    return passed;
+}
+
+std::vector<std::size_t> ParseSizeList(const char* value)
+{
+    std::vector<std::size_t> sizes;
+    for (const char* p = value; *p;)
+    {
+        char* end = nullptr;
+        sizes.push_back(std::strtoull(p, &end, 10));
+        p = *end == ',' ? end + 1 : end;
+        if (end == p && *p)
+        {
+            return {};
+        }
+    }
+    return sizes;
+}
+
+bool ParseArgs(const int argc, char** argv, BenchOptions& options)
+{
+    for (int i = 1; i < argc; ++i)
+    {
+        const auto next = [&]() -> const char* { return i + 1 < argc ? argv[++i] : nullptr; };
+        const char* value = nullptr;
+        if (std::strcmp(argv[i], "--rows") == 0 && (value = next()))
+        {
+            options.rows = std::max<std::size_t>(std::strtoull(value, nullptr, 10), 1);
+        }
+        else if (std::strcmp(argv[i], "--batches") == 0 && (value = next()))
+        {
+            options.batches = std::strtoull(value, nullptr, 10);
+        }
+        else if (std::strcmp(argv[i], "--saves") == 0 && (value = next()))
+        {
+            options.saves = std::strtoull(value, nullptr, 10);
+        }
+        else if (std::strcmp(argv[i], "--compress-min") == 0 && (value = next()))
+        {
+            options.compressMin = std::strtoull(value, nullptr, 10);
+        }
+        else if (std::strcmp(argv[i], "--lazy-min") == 0 && (value = next()))
+        {
+            options.lazyMin = std::strtoull(value, nullptr, 10);
+        }
+        else if (std::strcmp(argv[i], "--load-threads") == 0 && (value = next()))
+        {
+            options.loadThreads = std::strtoull(value, nullptr, 10);
+        }
+        else if (std::strcmp(argv[i], "--hydration") == 0)
+        {
+            options.hydration = true;
+        }
+        else if (std::strcmp(argv[i], "--save-gc") == 0)
+        {
+            options.saveGc = true;
+        }
+        else if (std::strcmp(argv[i], "--hydration-rows") == 0 && (value = next()))
+        {
+            options.hydrationRows = ParseSizeList(value);
+        }
+        else if (std::strcmp(argv[i], "--hydration-threads") == 0 && (value = next()))
+        {
+            options.hydrationThreads = ParseSizeList(value);
+        }
+        else if (std::strcmp(argv[i], "--dir") == 0 && (value = next()))
+        {
+            options.dir = value;
+        }
+        else if (std::strcmp(argv[i], "--engine") == 0 && (value = next()))
+        {
+            options.engines.emplace_back(value);
+        }
+        else
+        {
+            return false;
+        }
+    }
+    if (options.hydrationRows.empty() || options.hydrationThreads.empty())
+    {
+        return false;
+    }
+    if (options.engines.empty())
+    {
+        options.engines = {"sqlite", "log", "memory"};
+    }
+    return std::all_of(options.engines.begin(), options.engines.end(), [](const std::string& kind)
+    {
+        return kind == "sqlite" || kind == "log" || kind == "memory";
+    });
+}
+}
+
+int main(const int argc, char** argv)
+{
+    BenchOptions options;
+    if (!ParseArgs(argc, argv, options))
+    {
+        std::fprintf(stderr,
+                     "usage: %s [--rows N] [--batches N] [--saves N] [--compress-min BYTES] [--lazy-min BYTES] "
+                     "[--load-threads N] [--dir PATH] [--engine sqlite|log|memory]...\n"
+                     "       %s --hydration [--hydration-rows N,N,...] [--hydration-threads N,N,...] "
+                     "[--compress-min BYTES] [--lazy-min BYTES] [--dir PATH]\n"
+                     "       %s --save-gc [--dir PATH] [--engine sqlite|log|memory]...\n",
+                     argv[0],
+                     argv[0],
+                     argv[0]);
+        return 2;
+    }
+    if (options.hydration)
+    {
+        try
+        {
+            RunHydration(options);
+        }
+        catch (const std::exception& e)
+        {
+            std::fprintf(stderr, "hydration: %s\n", e.what());
+            return 1;
+        }
+        return 0;
+    }
+
+    if (options.saveGc)
+    {
+        try
+        {
+            return RunSaveGc(options) ? 0 : 1;
+        }
+        catch (const std::exception& e)
+        {
+            std::fprintf(stderr, "save-gc: %s\n", e.what());
+            return 1;
+        }
+    }
+
+    const Workload workload = MakeWorkload(options);
+    std::printf("%zu rows, %zu flushes of %zu keys, %zu saves\n\n",
+                options.rows,
+                workload.batches.size(),
+                workload.batches.empty() ? std::size_t{0} : workload.batches.front().upserts.size(),
+                workload.saves.size());
+    std::printf("%-8s %10s %10s %10s %10s %10s %10s %10s %10s %12s\n",
+                "engine", "flush ms", "save ms", "load ms", "idle ms", "reopen ms", "gc ms", "loaded", "collected", "disk MB");
+    for (const auto& kind : options.engines)
+    {
+        try
+        {
+            RunEngine(kind, options, workload);
+        }
+        catch (const std::exception& e)
+        {
+            std::fprintf(stderr, "%s: %s\n", kind.c_str(), e.what());
+            return 1;
+        }
+    }
+    return 0;
+}